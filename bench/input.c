@@ -0,0 +1,76 @@
+// Line reading benchmark: the old vhod reader (fgetc into a doubling
+// buffer, then copied into the string) against input_read_line().
+// Both read the same file of LINES lines (default 5M) and build one
+// String per line, as vhod does.
+//   make bench-input LINES=20000000
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// The reader vhod used before, minus the interpreter around it
+static String* fgetc_read_line(FILE* f) {
+    size_t capacity = 128;
+    size_t length = 0;
+    char* buffer = (char*)malloc(capacity);
+    int ch;
+    while ((ch = fgetc(f)) != EOF) {
+        if (ch == '\n') break;
+        if (length + 1 >= capacity) {
+            capacity *= 2;
+            buffer = (char*)realloc(buffer, capacity);
+        }
+        buffer[length++] = (char)ch;
+    }
+    if (length == 0 && ch == EOF) { free(buffer); return NULL; }
+    buffer[length] = '\0';
+    String* s = string_new(buffer, length);
+    free(buffer);
+    return s;
+}
+
+static void report(const char* name, double seconds, size_t lines, size_t bytes) {
+    printf("%-10s %8.3f s %12.0f lines/s %8.1f MB/s\n", name, seconds,
+           (double)lines / seconds, (double)bytes / seconds / 1e6);
+}
+
+int main(int argc, char** argv) {
+    size_t lines = argc > 1 ? strtoul(argv[1], NULL, 10) : 5000000;
+    char path[] = "/tmp/hypescript-input-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) { perror("mkstemp"); return 1; }
+    FILE* gen = fdopen(fd, "w");
+    for (size_t i = 0; i < lines; i++)
+        fprintf(gen, "%zu,%zu.%02zu,record-%zu,some text in the middle\n", i, i * 7 % 1000, i % 100, i);
+    fclose(gen);
+
+    size_t n = 0, bytes = 0;
+    FILE* f = fopen(path, "r");
+    double t = now();
+    for (String* s; (s = fgetc_read_line(f)); n++) { bytes += s->length + 1; string_release(s); }
+    report("fgetc", now() - t, n, bytes);
+    fclose(f);
+
+    Input in;
+    input_init(&in, open(path, O_RDONLY), INPUT_DEFAULT_BLOCK);
+    n = bytes = 0;
+    t = now();
+    for (String* s; (s = input_read_line(&in)); n++) { bytes += s->length + 1; string_release(s); }
+    report("read+memchr", now() - t, n, bytes);
+    close(in.fd);
+    input_free(&in);
+
+    unlink(path);
+    return 0;
+}
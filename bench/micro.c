@@ -0,0 +1,241 @@
+// Component benchmarks: the lexer, the parser, editor re-parsing, variable
+// lookup and string values, each timed on its own so that a change in
+// whole-script timings (make bench) can be traced to the part of the
+// interpreter behind it.
+// The lexer and the parser run on a generated script of MB megabytes
+// (default 10).
+//   make microbench MB=50
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "env.h"
+#include "array.h"
+#include "mem.h"
+#include "document.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Keeps results alive so the compiler cannot drop the work
+static volatile size_t sink;
+
+// A script of at least `bytes` bytes: prikol definitions with loops and
+// branches, map and array literals, calls and indexing, repeated with
+// fresh names
+static char* generate_script(size_t bytes, size_t* length) {
+    size_t capacity = bytes + 4096;
+    char* src = (char*)malloc(capacity);
+    size_t n = (size_t)snprintf(src, capacity, "!HYPE!\n");
+    for (int i = 0; n < bytes; i++) {
+        n += (size_t)snprintf(src + n, capacity - n,
+            "prikol f%d(a, b) {\n"
+            "  s = a + b * 2 - %d;\n"
+            "  dlya (j = 0; j < 10; j = j + 1) { s = s + j %% 3; }\n"
+            "  esli (s > 100 && !lozh) { pechat(\"big\", s); } inache { t = [1, 2.5, s]; t[0] = s; }\n"
+            "}\n"
+            "m%d = {\"k\": %d, \"v\": \"stroka %d\"};\n"
+            "x%d = m%d[\"k\"] + dlina(\"abc\") * 3.5;\n"
+            "poka (x%d > 0) { x%d = x%d - 1; f%d(x%d, 1); }\n",
+            i, i, i, i, i, i, i, i, i, i, i, i);
+        if (n + 1024 > capacity) {
+            capacity *= 2;
+            src = (char*)realloc(src, capacity);
+        }
+    }
+    *length = n;
+    return src;
+}
+
+static size_t count_expr(const Expr* e);
+
+static size_t count_exprs(Expr** list, int count) {
+    size_t n = 0;
+    for (int i = 0; i < count; i++) n += count_expr(list[i]);
+    return n;
+}
+
+static size_t count_expr(const Expr* e) {
+    if (!e) return 0;
+    switch (e->type) {
+        case EXPR_ASSIGN: return 1 + count_expr(e->as.assign.value);
+        case EXPR_BINARY: return 1 + count_expr(e->as.binary.left) + count_expr(e->as.binary.right);
+        case EXPR_UNARY: return 1 + count_expr(e->as.unary.expr);
+        case EXPR_CALL: return 1 + count_exprs(e->as.call.args, e->as.call.arg_count);
+        case EXPR_ARRAY: return 1 + count_exprs(e->as.array.items, e->as.array.count);
+        case EXPR_MAP: return 1 + count_exprs(e->as.map.keys, e->as.map.count) + count_exprs(e->as.map.values, e->as.map.count);
+        case EXPR_INDEX: return 1 + count_expr(e->as.index.object) + count_expr(e->as.index.index);
+        case EXPR_INDEX_ASSIGN:
+            return 1 + count_expr(e->as.index_assign.object) + count_expr(e->as.index_assign.index) + count_expr(e->as.index_assign.value);
+        default: return 1;
+    }
+}
+
+static size_t count_stmt(const Stmt* s);
+
+static size_t count_list(const StmtList* list) {
+    size_t n = 0;
+    for (; list; list = list->next) n += count_stmt(list->stmt);
+    return n;
+}
+
+// Statements and expressions in the tree
+static size_t count_stmt(const Stmt* s) {
+    if (!s) return 0;
+    switch (s->type) {
+        case STMT_EXPR: return 1 + count_expr(s->as.expr.expr);
+        case STMT_BLOCK: return 1 + count_list(s->as.block.statements);
+        case STMT_IF:
+            return 1 + count_expr(s->as.ifstmt.condition) + count_stmt(s->as.ifstmt.then_branch) + count_stmt(s->as.ifstmt.else_branch);
+        case STMT_WHILE: return 1 + count_expr(s->as.whilestmt.condition) + count_stmt(s->as.whilestmt.body);
+        case STMT_FOR:
+            return 1 + count_stmt(s->as.forstmt.init) + count_expr(s->as.forstmt.condition)
+                + count_expr(s->as.forstmt.increment) + count_stmt(s->as.forstmt.body);
+        case STMT_FUNC: return 1 + count_stmt(s->as.func.body);
+        case STMT_SECTION: return 1 + count_stmt(s->as.section.body);
+        default: return 1;
+    }
+}
+
+static void bench_lexer(const char* src, size_t length) {
+    Lexer lexer;
+    lexer_init(&lexer, src);
+    size_t tokens = 0;
+    double t = now();
+    for (;;) {
+        Token tok = lexer_next(&lexer);
+        tokens++;
+        TokenType type = tok.type;
+        token_free(&tok);
+        if (type == TOK_EOF) break;
+    }
+    double s = now() - t;
+    printf("%-24s %8.3f s %12.0f tokens/s %8.1f MB/s\n", "lexer_next", s, (double)tokens / s, (double)length / s / 1e6);
+}
+
+static void bench_parser(const char* src, size_t length, bool lazy) {
+    Parser p;
+    parser_init(&p, src);
+    p.lazy = lazy;
+    double t = now();
+    StmtList* program = parse_program(&p);
+    double s = now() - t;
+    size_t nodes = count_list(program);
+    if (p.had_error) fprintf(stderr, "the generated script has syntax errors\n");
+    printf("%-24s %8.3f s %12.0f nodes/s %8.1f MB/s\n", lazy ? "parse_program (lazy)" : "parse_program (strict)",
+           s, (double)nodes / s, (double)length / s / 1e6);
+    stmt_list_free(program);
+}
+
+// A keystroke in the middle of the script, typing a character and deleting
+// it, as the language server re-parses it (see document.h)
+static void bench_document(const char* src, size_t length) {
+    double t = now();
+    Document* d = document_new(src, length);
+    double open = now() - t;
+    printf("%-24s %8.3f s %12zu statements\n", "document_new", open, document_statements(d));
+    int line = 0;
+    for (size_t i = 0; i < length / 2; i++) line += src[i] == '\n';
+    int edits = 1000;
+    size_t reparsed = 0;
+    t = now();
+    for (int i = 0; i < edits; i++) {
+        document_edit(d, line, 2, line, 2, "x", 1);
+        reparsed += document_reparsed(d);
+        document_edit(d, line, 2, line, 3, "", 0);
+        reparsed += document_reparsed(d);
+    }
+    double s = now() - t;
+    printf("%-24s %8.3f ms/edit %8.1f statements/edit\n", "document_edit", s * 1e3 / (2 * edits),
+           (double)reparsed / (2 * edits));
+    document_free(d);
+}
+
+// env_get of a variable in the outermost of `depth` scopes, each holding
+// `vars` variables, the way a prikol body deep in blocks reads a global
+static void bench_env_get(int depth, int vars) {
+    Env* envs[64];
+    char name[32];
+    for (int d = 0; d < depth; d++) {
+        envs[d] = env_create(d ? envs[d - 1] : NULL);
+        for (int v = 0; v < vars; v++) {
+            snprintf(name, sizeof(name), "v%d_%d", d, v);
+            env_set(envs[d], name, value_number(v));
+        }
+    }
+    // Defined first, so the last one a scope's list reaches
+    snprintf(name, sizeof(name), "v0_0");
+    size_t iterations = 20000000 / (size_t)(depth * vars);
+    Value out;
+    double t = now();
+    for (size_t i = 0; i < iterations; i++) sink += env_get(envs[depth - 1], name, &out);
+    double s = now() - t;
+    char label[48];
+    snprintf(label, sizeof(label), "env_get depth %d vars %d", depth, vars);
+    printf("%-24s %8.1f ns/lookup\n", label, s / (double)iterations * 1e9);
+    for (int d = depth; d-- > 0;) env_free(envs[d]);
+}
+
+static void bench_strings(size_t length) {
+    char* chars = (char*)malloc(length + 1);
+    memset(chars, 'x', length);
+    chars[length] = '\0';
+    size_t iterations = 200000000 / (length + 64);
+    double t = now();
+    for (size_t i = 0; i < iterations; i++) {
+        Value v = value_string_len(chars, length);
+        sink += v.data.as_string->length;
+        value_free(&v);
+    }
+    double s = now() - t;
+    char label[48];
+    snprintf(label, sizeof(label), "value_string %zu B", length);
+    printf("%-24s %8.1f ns/op %12.0f ops/s %8.1f MB/s\n", label, s / (double)iterations * 1e9,
+           (double)iterations / s, (double)(iterations * length) / s / 1e6);
+    free(chars);
+}
+
+static void bench_clone(const char* label, Value v) {
+    size_t iterations = 20000000;
+    double t = now();
+    for (size_t i = 0; i < iterations; i++) {
+        Value copy = value_clone(&v);
+        sink += copy.type;
+        value_free(&copy);
+    }
+    double s = now() - t;
+    printf("%-24s %8.1f ns/op %12.0f ops/s\n", label, s / (double)iterations * 1e9, (double)iterations / s);
+    value_free(&v);
+}
+
+int main(int argc, char** argv) {
+    double mb = argc > 1 ? atof(argv[1]) : 10;
+    if (mb <= 0) mb = 10;
+    size_t length;
+    char* src = generate_script((size_t)(mb * 1e6), &length);
+    printf("generated script: %.1f MB\n", (double)length / 1e6);
+    bench_lexer(src, length);
+    bench_parser(src, length, false);
+    bench_parser(src, length, true);
+    bench_document(src, length);
+    free(src);
+
+    int shapes[][2] = { {1, 1}, {1, 16}, {4, 4}, {16, 1}, {16, 16}, {64, 4} };
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) bench_env_get(shapes[i][0], shapes[i][1]);
+
+    size_t lengths[] = { 8, 64, 1024, 65536 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) bench_strings(lengths[i]);
+    bench_clone("value_clone number", value_number(42));
+    bench_clone("value_clone string", value_string("a string shared by refcount"));
+    Array* a = array_new(0);
+    bench_clone("value_clone array", value_array(a));
+    printf("heap left: %zu bytes\n", mem_in_use());
+    return 0;
+}
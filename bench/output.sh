@@ -0,0 +1,19 @@
+#!/bin/sh
+# Output throughput benchmark: prints LINES lines (10M by default) through a
+# pipe once per --output-buffer mode and reports wall time and lines/s.
+#   BIN=./hypescript LINES=10000000 sh bench/output.sh
+set -e
+BIN=${BIN:-./hypescript}
+LINES=${LINES:-10000000}
+SCRIPT=$(dirname "$0")/pechat_lines.hype
+
+now_ns() { date +%s%N; }
+
+printf '%-8s %10s %14s\n' mode seconds lines/s
+for mode in block 1m line none; do
+    start=$(now_ns)
+    echo "$LINES" | "$BIN" --output-buffer="$mode" "$SCRIPT" | cat > /dev/null
+    end=$(now_ns)
+    awk -v m="$mode" -v ns="$((end - start))" -v n="$LINES" \
+        'BEGIN { s = ns / 1e9; printf "%-8s %10.3f %14.0f\n", m, s, n / s }'
+done
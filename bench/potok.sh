@@ -0,0 +1,27 @@
+#!/bin/sh
+# Thread scaling benchmark: runs bench/potok.hype with 1, 2, 4, ... threads
+# up to the number of CPUs (or THREADS="1 2 8") and reports the speedup.
+#   BIN=./hypescript sh bench/potok.sh
+set -e
+BIN=${BIN:-./hypescript}
+SCRIPT=$(dirname "$0")/potok.hype
+if [ -z "$THREADS" ]; then
+    cpus=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+    THREADS=1
+    n=2
+    while [ "$n" -le "$cpus" ]; do THREADS="$THREADS $n"; n=$((n * 2)); done
+fi
+
+now_ns() { date +%s%N; }
+
+printf '%-8s %10s %8s\n' threads seconds speedup
+base=
+for t in $THREADS; do
+    start=$(now_ns)
+    echo "$t" | "$BIN" "$SCRIPT" > /dev/null
+    end=$(now_ns)
+    ns=$((end - start))
+    [ -n "$base" ] || base=$ns
+    awk -v t="$t" -v ns="$ns" -v base="$base" \
+        'BEGIN { printf "%-8s %10.3f %8.2f\n", t, ns / 1e9, base / ns }'
+done
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Benchmark suite: runs every bench/suite/*.hype RUNS times (7 by default)
+# and reports the median and p95 of the time each workload measures itself
+# with vremya() (its last output line, "vremya_ms N"). The results go to
+# stdout as a table and to OUT (bench/results.json) as JSON. With a
+# baseline (BASELINE, by default bench/baseline.json if it exists) a
+# workload whose median got more than TOLERANCE percent (10) slower fails
+# the run.
+#   BIN=./hypescript RUNS=7 sh bench/run.sh
+#   sh bench/run.sh && cp bench/results.json bench/baseline.json
+set -e
+BIN=${BIN:-./hypescript}
+RUNS=${RUNS:-7}
+TOLERANCE=${TOLERANCE:-10}
+DIR=$(dirname "$0")
+OUT=${OUT:-$DIR/results.json}
+if [ -z "${BASELINE+set}" ] && [ -f "$DIR/baseline.json" ]; then BASELINE=$DIR/baseline.json; fi
+
+# Input for the parsing workload, the same every time
+INPUT=$(mktemp)
+trap 'rm -f "$INPUT" "$INPUT.times"' EXIT
+awk 'BEGIN { for (i = 0; i < 100000; i++) printf "id%d,%d,%d,%.2f\n", i % 5000, i, i * 3, i / 7 }' > "$INPUT"
+
+printf '{\n  "runs": %d,\n  "workloads": {\n' "$RUNS" > "$OUT"
+printf '%-12s %10s %10s %10s\n' workload median_ms p95_ms baseline
+failed=0
+first=1
+for script in "$DIR"/suite/*.hype; do
+    name=$(basename "$script" .hype)
+    : > "$INPUT.times"
+    i=0
+    while [ "$i" -lt "$RUNS" ]; do
+        "$BIN" "$script" < "$INPUT" | tail -n 1 | awk '$1 == "vremya_ms" { print $2 }' >> "$INPUT.times"
+        i=$((i + 1))
+    done
+    if [ "$(wc -l < "$INPUT.times")" -ne "$RUNS" ]; then
+        echo "$name: no vremya_ms line in its output" >&2
+        exit 1
+    fi
+    # Median and nearest-rank p95 of the sorted times
+    stats=$(sort -g "$INPUT.times" | awk '
+        { t[NR] = $1 }
+        END {
+            median = NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+            rank = int(NR * 0.95); if (rank < NR * 0.95) rank++
+            runs = ""; for (i = 1; i <= NR; i++) runs = runs (i > 1 ? ", " : "") sprintf("%.3f", t[i])
+            printf "%.3f %.3f %s\n", median, t[rank], runs
+        }')
+    median=${stats%% *}
+    rest=${stats#* }
+    p95=${rest%% *}
+    runs=${rest#* }
+    base=
+    if [ -n "$BASELINE" ]; then
+        base=$(awk -v n="\"$name\"" '$1 == n":" { sub(/.*"median_ms": /, ""); sub(/,.*/, ""); print }' "$BASELINE")
+    fi
+    verdict=
+    if [ -n "$base" ] && awk -v m="$median" -v b="$base" -v t="$TOLERANCE" 'BEGIN { exit !(m > b * (1 + t / 100)) }'; then
+        verdict=" SLOWER"
+        failed=1
+    fi
+    printf '%-12s %10s %10s %10s%s\n' "$name" "$median" "$p95" "${base:--}" "$verdict"
+    [ "$first" = 1 ] || printf ',\n' >> "$OUT"
+    first=0
+    printf '    "%s": {"median_ms": %s, "p95_ms": %s, "runs_ms": [%s]}' "$name" "$median" "$p95" "$runs" >> "$OUT"
+done
+printf '\n  }\n}\n' >> "$OUT"
+echo "results in $OUT"
+if [ "$failed" = 1 ]; then
+    echo "slower than $BASELINE by more than $TOLERANCE%" >&2
+    exit 1
+fi
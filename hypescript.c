@@ -1,50 +1,264 @@
 // HypeScript interpreter main
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "src/parser.h"
 #include "src/interp.h"
+#include "src/output.h"
+#include "src/cache.h"
+#include "src/snapshot.h"
+#include "src/hypescript.h"
+#include "src/server.h"
+#include "src/lsp.h"
+#include "src/profile.h"
+#include "src/stats.h"
+#include "src/budget.h"
+#include "src/mem.h"
+#include "src/memo.h"
 
-#define VERSION "0.1.0"
+#define VERSION HYPESCRIPT_VERSION
 
 static char* read_all(FILE* f) {
     fseek(f, 0, SEEK_END);
     long size = ftell(f);
     fseek(f, 0, SEEK_SET);
-    char* buf = (char*)malloc((size_t)size + 1);
+    char* buf = (char*)mem_alloc((size_t)size + 1);
     if (!buf) return NULL;
     size_t n = fread(buf, 1, (size_t)size, f);
     buf[n] = '\0';
     return buf;
 }
 
+// A whole positive number for --max-steps and the like
+static bool parse_count(const char* spec, uint64_t* n) {
+    char* end;
+    if (*spec < '0' || *spec > '9') return false;
+    unsigned long long v = strtoull(spec, &end, 10);
+    if (*end != '\0' || v == 0) return false;
+    *n = v;
+    return true;
+}
+
+static int bad_count(const char* option) {
+    fprintf(stderr, "Invalid %s value, expected a positive whole number\n", option);
+    return 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: hypescript [options] filename\n"
+        "       hypescript [options] -e program\n"
+        "       hypescript --serve SOCK\n"
+        "       hypescript --lsp\n"
+        "Options:\n"
+        "  --output-buffer=none|line|block|SIZE  how pechat output is buffered\n"
+        "  --strict  parse every prikol body up front (default: on first call)\n"
+        "  --cache[=DIR]  reuse the parsed program from DIR (default ~/.cache/hypescript)\n"
+        "  --snapshot=FILE  save the state after nachalo to FILE, then continue\n"
+        "  --resume=FILE    start from the state saved in FILE instead of nachalo\n"
+        "  --serve SOCK     keep scripts parsed and run them for --connect clients\n"
+        "  --connect=SOCK   run the file on the server at SOCK\n"
+        "  --lsp            language server for editors, on stdin and stdout\n"
+        "  --profile[=FILE]  sample the running prikols, write flame graph stacks to FILE\n"
+        "                    (default hypescript.folded) and print the hot lines\n"
+        "  --stats[=FILE]    count what the interpreter does, as JSON to FILE (default stderr)\n"
+        "  --memo[=N]        cache calls of prikols that only compute globals from\n"
+        "                    their arguments, N per prikol (default 4096)\n"
+        "  --trace-alloc     report heap use by kind and by source line at exit\n"
+        "  --max-heap=SIZE   stop the program when its heap would grow past SIZE (like 512m)\n"
+        "  --max-steps=N     stop after N loop iterations and prikol calls (per thread)\n"
+        "  --timeout-ms=N    stop after N milliseconds\n"
+        "  --max-depth=N     stop when prikol calls nest deeper than N\n"
+        "  -n       run the program once per line of stdin (line in zapis, number in nomer)\n"
+        "  -p       like -n, and print zapis after each line\n"
+        "  -e CODE  program text given on the command line\n");
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: hypescript [filename]\n");
-        return 1;
+    const char* path = NULL;
+    const char* code = NULL;
+    bool records = false, print_records = false;
+    char* cache_dir = NULL;
+    bool strict = false;
+    const char* snapshot_path = NULL;
+    const char* resume_path = NULL;
+    const char* serve_path = NULL;
+    const char* connect_path = NULL;
+    bool lsp = false;
+    const char* profile_path = NULL;
+    const char* stats_path = NULL;
+    Limits limits = { 0, 0, 0 };
+    bool limited = false;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--output-buffer", 15) == 0) {
+            const char* spec = NULL;
+            if (arg[15] == '=') spec = arg + 16;
+            else if (arg[15] == '\0' && i + 1 < argc) spec = argv[++i];
+            OutputMode mode; size_t block = OUTPUT_DEFAULT_BLOCK;
+            if (!spec || !output_parse_mode(spec, &mode, &block)) {
+                fprintf(stderr, "Invalid --output-buffer value, expected none, line, block or a size like 256k\n");
+                return 1;
+            }
+            output_configure(output_stdout(), mode, block);
+        } else if (strcmp(arg, "--cache") == 0 || strncmp(arg, "--cache=", 8) == 0) {
+            mem_free(cache_dir);
+            if (arg[7] == '=') { cache_dir = (char*)mem_alloc(strlen(arg + 8) + 1); strcpy(cache_dir, arg + 8); }
+            else cache_dir = cache_default_dir();
+        } else if (strncmp(arg, "--snapshot=", 11) == 0 && arg[11]) {
+            snapshot_path = arg + 11;
+        } else if (strncmp(arg, "--resume=", 9) == 0 && arg[9]) {
+            resume_path = arg + 9;
+        } else if (strncmp(arg, "--serve", 7) == 0 && (arg[7] == '=' || arg[7] == '\0')) {
+            if (arg[7] == '=') serve_path = arg + 8;
+            else if (i + 1 < argc) serve_path = argv[++i];
+            if (!serve_path || !*serve_path) { usage(); return 1; }
+        } else if (strncmp(arg, "--connect=", 10) == 0 && arg[10]) {
+            connect_path = arg + 10;
+        } else if (strcmp(arg, "--lsp") == 0) {
+            lsp = true;
+        } else if (strcmp(arg, "--profile") == 0) {
+            profile_path = "hypescript.folded";
+        } else if (strncmp(arg, "--profile=", 10) == 0 && arg[10]) {
+            profile_path = arg + 10;
+        } else if (strcmp(arg, "--stats") == 0 || strncmp(arg, "--stats=", 8) == 0) {
+            stats_path = arg[7] == '=' ? arg + 8 : "";
+            stats_enabled = true;
+        } else if (strcmp(arg, "--memo") == 0) {
+            memo_capacity = 4096;
+        } else if (strncmp(arg, "--memo=", 7) == 0) {
+            uint64_t n;
+            if (!parse_count(arg + 7, &n) || n > SIZE_MAX) return bad_count("--memo");
+            memo_capacity = (size_t)n;
+        } else if (strcmp(arg, "--trace-alloc") == 0) {
+            mem_trace();
+        } else if (strncmp(arg, "--max-heap=", 11) == 0) {
+            size_t limit;
+            if (!mem_parse_size(arg + 11, &limit)) {
+                fprintf(stderr, "Invalid --max-heap value, expected a size like 512m\n");
+                return 1;
+            }
+            mem_set_limit(limit);
+        } else if (strncmp(arg, "--max-steps=", 12) == 0) {
+            if (!parse_count(arg + 12, &limits.max_steps)) return bad_count("--max-steps");
+            limited = true;
+        } else if (strncmp(arg, "--timeout-ms=", 13) == 0) {
+            if (!parse_count(arg + 13, &limits.timeout_ms)) return bad_count("--timeout-ms");
+            limited = true;
+        } else if (strncmp(arg, "--max-depth=", 12) == 0) {
+            uint64_t depth;
+            if (!parse_count(arg + 12, &depth) || depth > INT_MAX) return bad_count("--max-depth");
+            limits.max_depth = (int)depth;
+            limited = true;
+        } else if (strcmp(arg, "--strict") == 0) {
+            strict = true;
+        } else if (strcmp(arg, "-n") == 0) {
+            records = true;
+        } else if (strcmp(arg, "-p") == 0) {
+            records = print_records = true;
+        } else if (strcmp(arg, "-e") == 0 && i + 1 < argc && !code) {
+            code = argv[++i];
+        } else if (arg[0] == '-' && arg[1]) {
+            usage();
+            return 1;
+        } else if (!path) {
+            path = arg;
+        } else {
+            usage();
+            return 1;
+        }
     }
-
-    FILE* file = fopen(argv[1], "r");
-    if (!file) {
-        fprintf(stderr, "Target file doesn't exists!\n");
+    if (limited) budget_configure(&limits);
+    if (serve_path) {
+        if (path || code || profile_path || stats_path || lsp) { usage(); return 1; }
+        return server_run(serve_path);
+    }
+    if (lsp) {
+        if (path || code || connect_path || profile_path || stats_path) { usage(); return 1; }
+        return lsp_run();
+    }
+    if (!path == !code) {
+        usage();
         return 1;
     }
+    if (connect_path) {
+        if (code || profile_path || stats_path || limited || memo_capacity) { usage(); return 1; }
+        return server_request(connect_path, path, records, print_records);
+    }
 
-    char* src = read_all(file);
-    fclose(file);
-    if (!src) { fprintf(stderr, "Failed to read file\n"); return 1; }
+    char* src;
+    if (code) {
+        src = (char*)mem_alloc(strlen(code) + 1);
+        strcpy(src, code);
+    } else {
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            fprintf(stderr, "Target file doesn't exists!\n");
+            return 1;
+        }
+        src = read_all(file);
+        fclose(file);
+        if (!src) { fprintf(stderr, "Failed to read file\n"); return 1; }
+    }
 
-    Parser p; parser_init(&p, src);
-    StmtList* program = parse_program(&p);
-    if (p.had_error) { free(src); stmt_list_free(program); return 1; }
+    size_t src_length = strlen(src);
+    StmtList* program = cache_dir ? cache_load(cache_dir, VERSION, !strict, src, src_length) : NULL;
+    if (!program) {
+        Parser p; parser_init(&p, src);
+        p.lazy = !strict;
+        program = parse_program(&p);
+        if (p.had_error) { mem_free(src); mem_free(cache_dir); stmt_list_free(program); return 1; }
+        // Best effort: a read-only or missing cache directory just means no cache
+        if (cache_dir) cache_store(cache_dir, VERSION, !strict, src, src_length, program);
+    }
+    mem_free(cache_dir);
 
     Interpreter in; interpreter_init(&in);
-    interpret(&in, program);
+    // podklyuchit paths are relative to the script, or to the working directory for -e
+    char* dir = NULL;
+    const char* slash = path ? strrchr(path, '/') : NULL;
+    if (slash) {
+        dir = (char*)mem_alloc((size_t)(slash - path) + 1);
+        memcpy(dir, path, (size_t)(slash - path));
+        dir[slash - path] = '\0';
+        in.dir = dir;
+    }
+    if (profile_path && !profile_start(&in)) {
+        fprintf(stderr, "hypescript: could not start the profiler\n");
+        profile_path = NULL;
+    }
+    bool resumed = false;
+    if (resume_path) {
+        resumed = snapshot_load(resume_path, VERSION, src, src_length, &in);
+        if (!resumed) fprintf(stderr, "hypescript: snapshot %s is unusable, starting from the beginning\n", resume_path);
+    }
+    bool imported = true;
+    if (!resumed) {
+        imported = interpret_start(&in, program);
+        if (imported && snapshot_path && !in.halted && !snapshot_save(snapshot_path, VERSION, src, src_length, &in))
+            fprintf(stderr, "hypescript: could not write snapshot %s\n", snapshot_path);
+    }
+    // A podklyuchit that failed stops the program before anything runs, as
+    // a syntax error does
+    if (imported && records) interpret_records_finish(&in, program, print_records);
+    else if (imported) interpret_finish(&in, program);
+    if (profile_path) profile_stop(&in, profile_path);
+    if (stats_path) {
+        output_flush(in.out);
+        FILE* f = *stats_path ? fopen(stats_path, "w") : stderr;
+        if (f) stats_write(f);
+        else fprintf(stderr, "hypescript: could not write stats %s\n", stats_path);
+        if (f && f != stderr) fclose(f);
+    }
 
     // cleanup
-    interpreter_free(&in);
+    interpreter_free(&in); // joins the potok threads
     stmt_list_free(program);
-    free(src);
-    return 0;
+    mem_free(src);
+    mem_free(dir);
+    return !imported || budget_breached() ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#define MEM_KIND MEM_ARRAY
+#include "mem.h"
+
+// Vector kernels over unboxed doubles. AVX is used when the compiler targets
+// it (-mavx), SSE2 otherwise on x86-64; other targets get the scalar loops,
+// which still keep several independent accumulators.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define HS_VEC 4
+typedef __m256d vec_t;
+#define vec_load(p)     _mm256_loadu_pd(p)
+#define vec_store(p, v) _mm256_storeu_pd((p), (v))
+#define vec_set1(x)     _mm256_set1_pd(x)
+#define vec_add(a, b)   _mm256_add_pd((a), (b))
+#define vec_mul(a, b)   _mm256_mul_pd((a), (b))
+#define vec_min(a, b)   _mm256_min_pd((a), (b))
+#define vec_max(a, b)   _mm256_max_pd((a), (b))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HS_VEC 2
+typedef __m128d vec_t;
+#define vec_load(p)     _mm_loadu_pd(p)
+#define vec_store(p, v) _mm_storeu_pd((p), (v))
+#define vec_set1(x)     _mm_set1_pd(x)
+#define vec_add(a, b)   _mm_add_pd((a), (b))
+#define vec_mul(a, b)   _mm_mul_pd((a), (b))
+#define vec_min(a, b)   _mm_min_pd((a), (b))
+#define vec_max(a, b)   _mm_max_pd((a), (b))
+#endif
+
+#ifdef HS_VEC
+static double vec_hsum(vec_t v) {
+    double lanes[HS_VEC]; vec_store(lanes, v);
+    double s = 0; for (int i = 0; i < HS_VEC; i++) s += lanes[i];
+    return s;
+}
+#endif
+
+static double kernel_sum(const double* x, size_t n) {
+    size_t i = 0;
+    double s = 0;
+#ifdef HS_VEC
+    if (n >= 4 * HS_VEC) {
+        vec_t s0 = vec_set1(0), s1 = vec_set1(0), s2 = vec_set1(0), s3 = vec_set1(0);
+        for (; i + 4 * HS_VEC <= n; i += 4 * HS_VEC) {
+            s0 = vec_add(s0, vec_load(x + i));
+            s1 = vec_add(s1, vec_load(x + i + HS_VEC));
+            s2 = vec_add(s2, vec_load(x + i + 2 * HS_VEC));
+            s3 = vec_add(s3, vec_load(x + i + 3 * HS_VEC));
+        }
+        s = vec_hsum(vec_add(vec_add(s0, s1), vec_add(s2, s3)));
+    }
+#else
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (; i + 4 <= n; i += 4) { s0 += x[i]; s1 += x[i+1]; s2 += x[i+2]; s3 += x[i+3]; }
+    s = (s0 + s1) + (s2 + s3);
+#endif
+    for (; i < n; i++) s += x[i];
+    return s;
+}
+
+static double kernel_dot(const double* x, const double* y, size_t n) {
+    size_t i = 0;
+    double s = 0;
+#ifdef HS_VEC
+    if (n >= 2 * HS_VEC) {
+        vec_t s0 = vec_set1(0), s1 = vec_set1(0);
+        for (; i + 2 * HS_VEC <= n; i += 2 * HS_VEC) {
+            s0 = vec_add(s0, vec_mul(vec_load(x + i), vec_load(y + i)));
+            s1 = vec_add(s1, vec_mul(vec_load(x + i + HS_VEC), vec_load(y + i + HS_VEC)));
+        }
+        s = vec_hsum(vec_add(s0, s1));
+    }
+#else
+    double s0 = 0, s1 = 0;
+    for (; i + 2 <= n; i += 2) { s0 += x[i] * y[i]; s1 += x[i+1] * y[i+1]; }
+    s = s0 + s1;
+#endif
+    for (; i < n; i++) s += x[i] * y[i];
+    return s;
+}
+
+// n must be > 0
+static double kernel_min(const double* x, size_t n) {
+    size_t i = 0;
+    double m = x[0];
+#ifdef HS_VEC
+    if (n >= HS_VEC) {
+        vec_t vm = vec_load(x);
+        for (i = HS_VEC; i + HS_VEC <= n; i += HS_VEC) vm = vec_min(vm, vec_load(x + i));
+        double lanes[HS_VEC]; vec_store(lanes, vm);
+        for (int k = 0; k < HS_VEC; k++) if (lanes[k] < m) m = lanes[k];
+    }
+#endif
+    for (; i < n; i++) if (x[i] < m) m = x[i];
+    return m;
+}
+
+static double kernel_max(const double* x, size_t n) {
+    size_t i = 0;
+    double m = x[0];
+#ifdef HS_VEC
+    if (n >= HS_VEC) {
+        vec_t vm = vec_load(x);
+        for (i = HS_VEC; i + HS_VEC <= n; i += HS_VEC) vm = vec_max(vm, vec_load(x + i));
+        double lanes[HS_VEC]; vec_store(lanes, vm);
+        for (int k = 0; k < HS_VEC; k++) if (lanes[k] > m) m = lanes[k];
+    }
+#endif
+    for (; i < n; i++) if (x[i] > m) m = x[i];
+    return m;
+}
+
+static void kernel_scale(double* x, size_t n, double k) {
+    size_t i = 0;
+#ifdef HS_VEC
+    vec_t vk = vec_set1(k);
+    for (; i + HS_VEC <= n; i += HS_VEC) vec_store(x + i, vec_mul(vec_load(x + i), vk));
+#endif
+    for (; i < n; i++) x[i] *= k;
+}
+
+static void kernel_fill(double* x, size_t n, double v) {
+    size_t i = 0;
+#ifdef HS_VEC
+    vec_t vv = vec_set1(v);
+    for (; i + HS_VEC <= n; i += HS_VEC) vec_store(x + i, vv);
+#endif
+    for (; i < n; i++) x[i] = v;
+}
+
+static void out_of_memory(size_t length) {
+    fprintf(stderr, "hypescript: out of memory for an array of %zu elements\n", length);
+    exit(1);
+}
+
+Array* array_try_new(size_t capacity) {
+    if (capacity > ARRAY_MAX_LENGTH) return NULL;
+    Array* a = (Array*)mem_alloc(sizeof(Array));
+    if (!a) return NULL;
+    a->refcount = 1;
+    a->boxed = false;
+    a->length = 0;
+    a->capacity = capacity;
+    a->nums = capacity ? (double*)mem_alloc(sizeof(double) * capacity) : NULL;
+    a->items = NULL;
+    if (capacity && !a->nums) {
+        mem_free(a);
+        return NULL;
+    }
+    return a;
+}
+
+Array* array_new(size_t capacity) {
+    Array* a = array_try_new(capacity);
+    if (!a) out_of_memory(capacity);
+    return a;
+}
+
+Array* array_retain(Array* a) {
+    if (a) a->refcount++;
+    return a;
+}
+
+void array_release(Array* a) {
+    if (!a || --a->refcount > 0) return;
+    if (a->boxed) {
+        for (size_t i = 0; i < a->length; i++) value_free(&a->items[i]);
+        mem_free(a->items);
+    } else {
+        mem_free(a->nums);
+    }
+    mem_free(a);
+}
+
+static void array_box(Array* a) {
+    if (a->boxed) return;
+    Value* items = (Value*)mem_alloc(sizeof(Value) * (a->capacity ? a->capacity : 1));
+    if (!items) out_of_memory(a->capacity);
+    for (size_t i = 0; i < a->length; i++) items[i] = value_number(a->nums[i]);
+    mem_free(a->nums);
+    a->nums = NULL;
+    a->items = items;
+    a->boxed = true;
+}
+
+// False, with a unchanged, when the memory cannot be had
+static bool array_reserve(Array* a, size_t needed) {
+    if (needed <= a->capacity) return true;
+    size_t cap = a->capacity < 8 ? 8 : a->capacity * 2;
+    while (cap < needed) cap *= 2;
+    if (a->boxed) {
+        Value* items = (Value*)mem_realloc(a->items, sizeof(Value) * cap);
+        if (!items) return false;
+        a->items = items;
+    } else {
+        double* nums = (double*)mem_realloc(a->nums, sizeof(double) * cap);
+        if (!nums) return false;
+        a->nums = nums;
+    }
+    a->capacity = cap;
+    return true;
+}
+
+void array_push(Array* a, Value v) {
+    if (!a->boxed && v.type != VAL_NUMBER) array_box(a);
+    if (!array_reserve(a, a->length + 1)) out_of_memory(a->length + 1);
+    if (a->boxed) a->items[a->length++] = v;
+    else a->nums[a->length++] = v.data.as_number;
+}
+
+Value array_peek(const Array* a, size_t index) {
+    if (a->boxed) return a->items[index];
+    return value_number(a->nums[index]);
+}
+
+bool array_set(Array* a, size_t index, Value v) {
+    if (index < a->length) {
+        if (!a->boxed && v.type != VAL_NUMBER) array_box(a);
+        if (a->boxed) { value_free(&a->items[index]); a->items[index] = v; }
+        else a->nums[index] = v.data.as_number;
+        return true;
+    }
+    if (index - a->length > ARRAY_MAX_GAP || !array_reserve(a, index + 1)) {
+        value_free(&v);
+        return false;
+    }
+    while (a->length < index) array_push(a, value_null());
+    array_push(a, v);
+    return true;
+}
+
+Array* array_slice(const Array* a, size_t from, size_t to) {
+    if (to > a->length) to = a->length;
+    if (from > to) from = to;
+    size_t n = to - from;
+    Array* out = array_new(n);
+    if (a->boxed) {
+        array_box(out);
+        for (size_t i = 0; i < n; i++) out->items[i] = value_clone(&a->items[from + i]);
+    } else if (n) {
+        memcpy(out->nums, a->nums + from, sizeof(double) * n);
+    }
+    out->length = n;
+    return out;
+}
+
+double array_sum(const Array* a) {
+    if (!a->boxed) return kernel_sum(a->nums, a->length);
+    double s = 0;
+    for (size_t i = 0; i < a->length; i++)
+        if (a->items[i].type == VAL_NUMBER) s += a->items[i].data.as_number;
+    return s;
+}
+
+static bool boxed_extreme(const Array* a, int want_max, double* out) {
+    bool found = false;
+    double m = 0;
+    for (size_t i = 0; i < a->length; i++) {
+        if (a->items[i].type != VAL_NUMBER) continue;
+        double x = a->items[i].data.as_number;
+        if (!found || (want_max ? x > m : x < m)) { m = x; found = true; }
+    }
+    if (found) *out = m;
+    return found;
+}
+
+bool array_min(const Array* a, double* out) {
+    if (a->boxed) return boxed_extreme(a, 0, out);
+    if (a->length == 0) return false;
+    *out = kernel_min(a->nums, a->length);
+    return true;
+}
+
+bool array_max(const Array* a, double* out) {
+    if (a->boxed) return boxed_extreme(a, 1, out);
+    if (a->length == 0) return false;
+    *out = kernel_max(a->nums, a->length);
+    return true;
+}
+
+double array_dot(const Array* a, const Array* b) {
+    size_t n = a->length < b->length ? a->length : b->length;
+    if (!a->boxed && !b->boxed) return kernel_dot(a->nums, b->nums, n);
+    double s = 0;
+    for (size_t i = 0; i < n; i++) {
+        Value x = array_peek(a, i), y = array_peek(b, i);
+        if (x.type == VAL_NUMBER && y.type == VAL_NUMBER) s += x.data.as_number * y.data.as_number;
+    }
+    return s;
+}
+
+void array_scale(Array* a, double k) {
+    if (!a->boxed) { kernel_scale(a->nums, a->length, k); return; }
+    for (size_t i = 0; i < a->length; i++)
+        if (a->items[i].type == VAL_NUMBER) a->items[i].data.as_number *= k;
+}
+
+void array_fill(Array* a, const Value* v) {
+    if (v->type == VAL_NUMBER) {
+        if (a->boxed) {
+            // Every element becomes a number again: drop back to unboxed storage
+            for (size_t i = 0; i < a->length; i++) value_free(&a->items[i]);
+            mem_free(a->items);
+            a->items = NULL;
+            a->nums = (double*)mem_alloc(sizeof(double) * (a->capacity ? a->capacity : 1));
+            if (!a->nums) out_of_memory(a->capacity);
+            a->boxed = false;
+        }
+        kernel_fill(a->nums, a->length, v->data.as_number);
+        return;
+    }
+    array_box(a);
+    for (size_t i = 0; i < a->length; i++) {
+        value_free(&a->items[i]);
+        a->items[i] = value_clone(v);
+    }
+}
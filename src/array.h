@@ -0,0 +1,49 @@
+#ifndef HYPESCRIPT_ARRAY_H
+#define HYPESCRIPT_ARRAY_H
+
+#include <stddef.h>
+#include "value.h"
+
+// Contiguous, reference-counted array. While every element is a number the
+// elements are kept unboxed in `nums`, so the bulk operations below run
+// SIMD kernels straight over doubles. Storing anything else switches the
+// array to boxed `items` for good (only array_fill with a number unboxes).
+struct Array {
+    int refcount;
+    bool boxed;
+    size_t length;
+    size_t capacity;
+    double* nums;  // unboxed storage, valid when !boxed
+    Value* items;  // boxed storage, valid when boxed
+};
+
+// The most elements an array is made with, and how far past the end
+// array_set pads with NICHTO
+#define ARRAY_MAX_LENGTH ((size_t)1 << 28)
+#define ARRAY_MAX_GAP ((size_t)1 << 20)
+
+// array_new exits with a message when the memory cannot be had;
+// array_try_new returns NULL, as it does for more than ARRAY_MAX_LENGTH
+Array* array_new(size_t capacity);
+Array* array_try_new(size_t capacity);
+Array* array_retain(Array* a);
+void array_release(Array* a);
+
+void array_push(Array* a, Value v);              // takes ownership of v
+Value array_peek(const Array* a, size_t index);  // borrowed, index < length
+// Takes ownership of v; pads with NICHTO up to index. False, with v freed
+// and a unchanged, when index is more than ARRAY_MAX_GAP past the end or
+// the memory cannot be had.
+bool array_set(Array* a, size_t index, Value v);
+Array* array_slice(const Array* a, size_t from, size_t to);
+
+// Bulk operations. Non-number elements of boxed arrays count as 0 in sum
+// and dot and are skipped by min/max.
+double array_sum(const Array* a);
+bool array_min(const Array* a, double* out);
+bool array_max(const Array* a, double* out);
+double array_dot(const Array* a, const Array* b); // over the shorter length
+void array_scale(Array* a, double k);
+void array_fill(Array* a, const Value* v);
+
+#endif
@@ -2,30 +2,37 @@
 #include <string.h>
 
 #include "ast.h"
+#include "builtins.h"
+#include "token.h"
+#define MEM_KIND MEM_AST
+#include "mem.h"
 
 static char* str_dup(const char* s) {
     size_t len = strlen(s);
-    char* out = (char*)malloc(len + 1);
+    char* out = (char*)mem_alloc(len + 1);
     memcpy(out, s, len + 1);
     return out;
 }
 
 Expr* expr_literal(Value v) {
-    Expr* e = (Expr*)malloc(sizeof(Expr));
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
     e->type = EXPR_LITERAL;
+    // Literals are shared by every run of the program, possibly on
+    // several threads at once, so their strings must never change
+    if (v.type == VAL_STRING) string_make_immortal(v.data.as_string);
     e->as.literal.value = v;
     return e;
 }
 
 Expr* expr_variable(const char* name) {
-    Expr* e = (Expr*)malloc(sizeof(Expr));
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
     e->type = EXPR_VARIABLE;
     e->as.variable.name = str_dup(name);
     return e;
 }
 
 Expr* expr_assign(const char* name, Expr* value) {
-    Expr* e = (Expr*)malloc(sizeof(Expr));
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
     e->type = EXPR_ASSIGN;
     e->as.assign.name = str_dup(name);
     e->as.assign.value = value;
@@ -33,7 +40,7 @@ Expr* expr_assign(const char* name, Expr* value) {
 }
 
 Expr* expr_binary(int op, Expr* left, Expr* right) {
-    Expr* e = (Expr*)malloc(sizeof(Expr));
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
     e->type = EXPR_BINARY;
     e->as.binary.op = op;
     e->as.binary.left = left;
@@ -42,7 +49,7 @@ Expr* expr_binary(int op, Expr* left, Expr* right) {
 }
 
 Expr* expr_unary(int op, Expr* expr) {
-    Expr* e = (Expr*)malloc(sizeof(Expr));
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
     e->type = EXPR_UNARY;
     e->as.unary.op = op;
     e->as.unary.expr = expr;
@@ -50,31 +57,69 @@ Expr* expr_unary(int op, Expr* expr) {
 }
 
 Expr* expr_call(const char* name, Expr** args, int count) {
-    Expr* e = (Expr*)malloc(sizeof(Expr));
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
     e->type = EXPR_CALL;
     e->as.call.callee = str_dup(name);
+    e->as.call.builtin = builtin_lookup(name);
     e->as.call.args = args;
     e->as.call.arg_count = count;
     return e;
 }
 
+Expr* expr_array(Expr** items, int count) {
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
+    e->type = EXPR_ARRAY;
+    e->as.array.items = items;
+    e->as.array.count = count;
+    return e;
+}
+
+Expr* expr_map(Expr** keys, Expr** values, int count) {
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
+    e->type = EXPR_MAP;
+    e->as.map.keys = keys;
+    e->as.map.values = values;
+    e->as.map.count = count;
+    return e;
+}
+
+Expr* expr_index(Expr* object, Expr* index) {
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
+    e->type = EXPR_INDEX;
+    e->as.index.object = object;
+    e->as.index.index = index;
+    return e;
+}
+
+Expr* expr_index_assign(Expr* object, Expr* index, Expr* value) {
+    Expr* e = (Expr*)mem_alloc(sizeof(Expr));
+    e->type = EXPR_INDEX_ASSIGN;
+    e->as.index_assign.object = object;
+    e->as.index_assign.index = index;
+    e->as.index_assign.value = value;
+    return e;
+}
+
 Stmt* stmt_expr(Expr* expr) {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_EXPR;
+    s->line = s->column = 0;
     s->as.expr.expr = expr;
     return s;
 }
 
 Stmt* stmt_block(StmtList* stmts) {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_BLOCK;
+    s->line = s->column = 0;
     s->as.block.statements = stmts;
     return s;
 }
 
 Stmt* stmt_if(Expr* cond, Stmt* thenb, Stmt* elseb) {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_IF;
+    s->line = s->column = 0;
     s->as.ifstmt.condition = cond;
     s->as.ifstmt.then_branch = thenb;
     s->as.ifstmt.else_branch = elseb;
@@ -82,37 +127,63 @@ Stmt* stmt_if(Expr* cond, Stmt* thenb, Stmt* elseb) {
 }
 
 Stmt* stmt_while(Expr* cond, Stmt* body) {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_WHILE;
+    s->line = s->column = 0;
     s->as.whilestmt.condition = cond;
     s->as.whilestmt.body = body;
     return s;
 }
 
 Stmt* stmt_for(Stmt* init, Expr* cond, Expr* inc, Stmt* body) {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_FOR;
+    s->line = s->column = 0;
     s->as.forstmt.init = init;
     s->as.forstmt.condition = cond;
     s->as.forstmt.increment = inc;
     s->as.forstmt.body = body;
+    s->as.forstmt.parallel = false;
+    s->as.forstmt.reductions = NULL;
+    s->as.forstmt.reduction_count = 0;
     return s;
 }
 
+static bool is_variable(const Expr* e, const char* name) {
+    return e && e->type == EXPR_VARIABLE && strcmp(e->as.variable.name, name) == 0;
+}
+
+bool stmt_for_is_range(const StmtFor* f) {
+    const Expr* init = f->init && f->init->type == STMT_EXPR ? f->init->as.expr.expr : NULL;
+    if (!init || init->type != EXPR_ASSIGN) return false;
+    const char* var = init->as.assign.name;
+    const Expr* cond = f->condition;
+    if (!cond || cond->type != EXPR_BINARY || !is_variable(cond->as.binary.left, var)) return false;
+    int op = cond->as.binary.op;
+    if (op != TOK_LESS && op != TOK_LESS_EQUAL && op != TOK_GREATER && op != TOK_GREATER_EQUAL) return false;
+    const Expr* inc = f->increment;
+    if (!inc || inc->type != EXPR_ASSIGN || strcmp(inc->as.assign.name, var) != 0) return false;
+    const Expr* step = inc->as.assign.value;
+    return step->type == EXPR_BINARY && is_variable(step->as.binary.left, var)
+        && (step->as.binary.op == TOK_PLUS || step->as.binary.op == TOK_MINUS);
+}
+
 Stmt* stmt_break() {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_BREAK;
+    s->line = s->column = 0;
     return s;
 }
 
 Stmt* stmt_continue() {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_CONTINUE;
+    s->line = s->column = 0;
     return s;
 }
 
 StmtList* stmt_list_append(StmtList* list, Stmt* stmt) {
-    StmtList* node = (StmtList*)malloc(sizeof(StmtList));
+    StmtList* node = (StmtList*)mem_alloc(sizeof(StmtList));
     node->stmt = stmt;
     node->next = NULL;
     if (!list) return node;
@@ -122,13 +193,42 @@ StmtList* stmt_list_append(StmtList* list, Stmt* stmt) {
     return list;
 }
 
+StmtList** stmt_list_push(StmtList** tail, Stmt* stmt) {
+    StmtList* node = (StmtList*)mem_alloc(sizeof(StmtList));
+    node->stmt = stmt;
+    node->next = NULL;
+    *tail = node;
+    return &node->next;
+}
+
 Stmt* stmt_func(const char* name, char** params, int param_count, Stmt* body) {
-    Stmt* s = (Stmt*)malloc(sizeof(Stmt));
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
     s->type = STMT_FUNC;
+    s->line = s->column = 0;
     s->as.func.name = str_dup(name);
     s->as.func.params = params;
     s->as.func.param_count = param_count;
     s->as.func.body = body;
+    s->as.func.lazy_body = NULL;
+    s->as.func.lazy_line = 0;
+    s->as.func.lazy_column = 0;
+    return s;
+}
+
+Stmt* stmt_section(SectionKind kind, Stmt* body) {
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
+    s->type = STMT_SECTION;
+    s->line = s->column = 0;
+    s->as.section.kind = kind;
+    s->as.section.body = body;
+    return s;
+}
+
+Stmt* stmt_import(const char* path) {
+    Stmt* s = (Stmt*)mem_alloc(sizeof(Stmt));
+    s->type = STMT_IMPORT;
+    s->line = s->column = 0;
+    s->as.import.path = str_dup(path);
     return s;
 }
 
@@ -136,13 +236,13 @@ void expr_free(Expr* e) {
     if (!e) return;
     switch (e->type) {
         case EXPR_LITERAL:
-            value_free(&e->as.literal.value);
+            if (e->as.literal.value.type == VAL_STRING) string_free_immortal(e->as.literal.value.data.as_string);
             break;
         case EXPR_VARIABLE:
-            free(e->as.variable.name);
+            mem_free(e->as.variable.name);
             break;
         case EXPR_ASSIGN:
-            free(e->as.assign.name);
+            mem_free(e->as.assign.name);
             expr_free(e->as.assign.value);
             break;
         case EXPR_BINARY:
@@ -153,19 +253,37 @@ void expr_free(Expr* e) {
             expr_free(e->as.unary.expr);
             break;
         case EXPR_CALL:
-            free(e->as.call.callee);
+            mem_free(e->as.call.callee);
             for (int i = 0; i < e->as.call.arg_count; i++) expr_free(e->as.call.args[i]);
-            free(e->as.call.args);
+            mem_free(e->as.call.args);
+            break;
+        case EXPR_ARRAY:
+            for (int i = 0; i < e->as.array.count; i++) expr_free(e->as.array.items[i]);
+            mem_free(e->as.array.items);
+            break;
+        case EXPR_MAP:
+            for (int i = 0; i < e->as.map.count; i++) { expr_free(e->as.map.keys[i]); expr_free(e->as.map.values[i]); }
+            mem_free(e->as.map.keys);
+            mem_free(e->as.map.values);
+            break;
+        case EXPR_INDEX:
+            expr_free(e->as.index.object);
+            expr_free(e->as.index.index);
+            break;
+        case EXPR_INDEX_ASSIGN:
+            expr_free(e->as.index_assign.object);
+            expr_free(e->as.index_assign.index);
+            expr_free(e->as.index_assign.value);
             break;
     }
-    free(e);
+    mem_free(e);
 }
 
 void stmt_list_free(StmtList* list) {
     while (list) {
         StmtList* next = list->next;
         stmt_free(list->stmt);
-        free(list);
+        mem_free(list);
         list = next;
     }
 }
@@ -193,18 +311,26 @@ void stmt_free(Stmt* s) {
             expr_free(s->as.forstmt.condition);
             expr_free(s->as.forstmt.increment);
             stmt_free(s->as.forstmt.body);
+            for (int i = 0; i < s->as.forstmt.reduction_count; i++) mem_free(s->as.forstmt.reductions[i].name);
+            mem_free(s->as.forstmt.reductions);
             break;
         case STMT_BREAK:
         case STMT_CONTINUE:
             break;
         case STMT_FUNC:
-            free(s->as.func.name);
-            for (int i = 0; i < s->as.func.param_count; i++) free(s->as.func.params[i]);
-            free(s->as.func.params);
+            mem_free(s->as.func.name);
+            for (int i = 0; i < s->as.func.param_count; i++) mem_free(s->as.func.params[i]);
+            mem_free(s->as.func.params);
             stmt_free(s->as.func.body);
             break;
+        case STMT_SECTION:
+            stmt_free(s->as.section.body);
+            break;
+        case STMT_IMPORT:
+            mem_free(s->as.import.path);
+            break;
     }
-    free(s);
+    mem_free(s);
 }
 
 
@@ -11,6 +11,10 @@ typedef enum {
     EXPR_BINARY,
     EXPR_UNARY,
     EXPR_CALL,
+    EXPR_ARRAY,
+    EXPR_MAP,
+    EXPR_INDEX,
+    EXPR_INDEX_ASSIGN,
 } ExprType;
 
 typedef struct Expr Expr;
@@ -41,11 +45,34 @@ typedef struct {
 } ExprUnary;
 
 typedef struct {
-    char* callee; // only built-ins like pechat, vhod
+    char* callee; // built-ins like pechat, vhod, or a prikol function
+    int builtin;  // BuiltinId, BI_NONE for user functions
     Expr** args;
     int arg_count;
 } ExprCall;
 
+typedef struct {
+    Expr** items; // [a, b, c]
+    int count;
+} ExprArray;
+
+typedef struct {
+    Expr** keys; // {k: v, ...}
+    Expr** values;
+    int count;
+} ExprMap;
+
+typedef struct {
+    Expr* object; // object[index]
+    Expr* index;
+} ExprIndex;
+
+typedef struct {
+    Expr* object; // object[index] = value
+    Expr* index;
+    Expr* value;
+} ExprIndexAssign;
+
 struct Expr {
     ExprType type;
     union {
@@ -55,6 +82,10 @@ struct Expr {
         ExprBinary binary;
         ExprUnary unary;
         ExprCall call;
+        ExprArray array;
+        ExprMap map;
+        ExprIndex index;
+        ExprIndexAssign index_assign;
     } as;
 };
 
@@ -66,7 +97,9 @@ typedef enum {
     STMT_FOR,
     STMT_BREAK,
     STMT_CONTINUE,
-    STMT_FUNC
+    STMT_FUNC,
+    STMT_SECTION,
+    STMT_IMPORT
 } StmtType;
 
 typedef struct StmtList {
@@ -88,11 +121,29 @@ typedef struct {
     Stmt* else_branch; // nullable
 } StmtIf;
 
+// Reduction clause of dlya parallelno: how the workers' copies of a
+// variable are combined into the variable after the loop
+typedef enum {
+    REDUCE_SUM, // summa
+    REDUCE_MIN, // minimum
+    REDUCE_MAX  // maksimum
+} ReduceOp;
+
+typedef struct {
+    ReduceOp op;
+    char* name;
+} Reduction;
+
 typedef struct {
     Stmt* init;     // nullable
     Expr* condition;// nullable
     Expr* increment;// nullable
     Stmt* body;
+    // dlya parallelno (i = a; i < b; i = i + k; summa s, ...), whose
+    // header always passes stmt_for_is_range (see parallel.h)
+    bool parallel;
+    Reduction* reductions;
+    int reduction_count;
 } StmtFor;
 
 typedef struct {
@@ -104,11 +155,33 @@ typedef struct {
     char* name;
     char** params;
     int param_count;
-    Stmt* body;
+    Stmt* body;            // NULL while the body is not parsed yet
+    const char* lazy_body; // lazy mode: body source after '{', borrowed
+    int lazy_line;
+    int lazy_column;
 } StmtFunc;
 
+// Top-level nachalo { ... } / konec { ... }: run before and after the main
+// statements (before the first and after the last record with -n / -p)
+typedef enum {
+    SECTION_BEGIN,
+    SECTION_END
+} SectionKind;
+
+typedef struct {
+    SectionKind kind;
+    Stmt* body; // STMT_BLOCK
+} StmtSection;
+
+// Top-level podklyuchit "path"; (see module.h)
+typedef struct {
+    char* path;
+} StmtImport;
+
 struct Stmt {
     StmtType type;
+    int line;   // where the statement starts; 0 if unknown
+    int column;
     union {
         StmtExpr expr;
         StmtBlock block;
@@ -116,6 +189,8 @@ struct Stmt {
         StmtWhile whilestmt;
         StmtFor forstmt;
         StmtFunc func;
+        StmtSection section;
+        StmtImport import;
     } as;
 };
 
@@ -126,17 +201,28 @@ Expr* expr_assign(const char* name, Expr* value);
 Expr* expr_binary(int op, Expr* left, Expr* right);
 Expr* expr_unary(int op, Expr* expr);
 Expr* expr_call(const char* name, Expr** args, int count);
+Expr* expr_array(Expr** items, int count);
+Expr* expr_map(Expr** keys, Expr** values, int count);
+Expr* expr_index(Expr* object, Expr* index);
+Expr* expr_index_assign(Expr* object, Expr* index, Expr* value);
 
 Stmt* stmt_expr(Expr* expr);
 Stmt* stmt_block(StmtList* stmts);
 Stmt* stmt_if(Expr* cond, Stmt* thenb, Stmt* elseb);
 Stmt* stmt_while(Expr* cond, Stmt* body);
 Stmt* stmt_for(Stmt* init, Expr* cond, Expr* inc, Stmt* body);
+// The header is (i = a; i < b; i = i + k) with <, <=, > or >= and + or -
+bool stmt_for_is_range(const StmtFor* f);
 Stmt* stmt_break();
 Stmt* stmt_continue();
 Stmt* stmt_func(const char* name, char** params, int param_count, Stmt* body);
+Stmt* stmt_section(SectionKind kind, Stmt* body);
+Stmt* stmt_import(const char* path);
 
 StmtList* stmt_list_append(StmtList* list, Stmt* stmt);
+// Appends at `tail` (the last node's next link, or &head of an empty list)
+// and returns the new tail link, for building a list in O(1) per node
+StmtList** stmt_list_push(StmtList** tail, Stmt* stmt);
 
 void expr_free(Expr* e);
 void stmt_free(Stmt* s);
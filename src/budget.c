@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 199309L
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "budget.h"
+
+#define CHECK_STEPS 4096 // between clock readings while there is a timeout
+
+static Limits limits;
+static uint64_t deadline_ns; // 0: none
+static atomic_flag reported = ATOMIC_FLAG_INIT;
+static atomic_bool breached;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void budget_configure(const Limits* l) {
+    limits = *l;
+    budget_restart();
+}
+
+void budget_restart(void) {
+    deadline_ns = limits.timeout_ms ? now_ns() + limits.timeout_ms * 1000000u : 0;
+    atomic_flag_clear(&reported);
+    atomic_store(&breached, false);
+}
+
+// Steps until the next check: the rest of --max-steps, and few enough to
+// notice the timeout within a millisecond or so
+static void refill(Interpreter* in) {
+    int64_t chunk = INT64_MAX;
+    if (limits.max_steps) {
+        uint64_t rest = limits.max_steps > in->steps ? limits.max_steps - in->steps : 0;
+        // Run out one step past the limit, so the breach is that step
+        chunk = rest < (uint64_t)INT64_MAX ? (int64_t)rest + 1 : INT64_MAX;
+    }
+    if (deadline_ns && chunk > CHECK_STEPS) chunk = CHECK_STEPS;
+    in->step_chunk = in->steps_left = chunk;
+}
+
+void budget_init(Interpreter* in) {
+    in->steps = 0;
+    in->halted = false;
+    in->depth_left = limits.max_depth ? limits.max_depth : INT_MAX;
+    refill(in);
+}
+
+// Reports the first breach in the process; the others are its echoes
+// in potok threads and parallel workers
+void budget_halt(Interpreter* in, const Stmt* where, const char* what) {
+    in->halted = true;
+    in->steps_left = 0;
+    atomic_store(&breached, true);
+    if (atomic_flag_test_and_set(&reported)) return;
+    output_flush(in->out);
+    if (where && where->line) fprintf(stderr, "Stopped at line %d col %d: %s\n", where->line, where->column, what);
+    else fprintf(stderr, "Stopped: %s\n", what);
+}
+
+bool budget_breached(void) {
+    return atomic_load(&breached);
+}
+
+bool budget_check(Interpreter* in, const Stmt* where) {
+    if (in->halted) { in->steps_left = 0; return true; }
+    in->steps += (uint64_t)(in->step_chunk - in->steps_left);
+    char what[96];
+    if (limits.max_steps && in->steps > limits.max_steps) {
+        snprintf(what, sizeof(what), "more than %llu steps (--max-steps)", (unsigned long long)limits.max_steps);
+        budget_halt(in, where, what);
+        return true;
+    }
+    if (deadline_ns && now_ns() >= deadline_ns) {
+        snprintf(what, sizeof(what), "ran for more than %llu ms (--timeout-ms)", (unsigned long long)limits.timeout_ms);
+        budget_halt(in, where, what);
+        return true;
+    }
+    refill(in);
+    return false;
+}
+
+void budget_too_deep(Interpreter* in, const Stmt* where) {
+    char what[96];
+    snprintf(what, sizeof(what), "prikol calls nested more than %d deep (--max-depth)", limits.max_depth);
+    budget_halt(in, where, what);
+}
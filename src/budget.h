@@ -0,0 +1,44 @@
+#ifndef HYPESCRIPT_BUDGET_H
+#define HYPESCRIPT_BUDGET_H
+
+#include <stdint.h>
+
+#include "interp.h"
+
+// Limits for runaway scripts: --max-steps, --timeout-ms and --max-depth.
+//
+// A step is one loop iteration or one prikol call. The interpreter counts
+// steps down in Interpreter.steps_left and calls budget_check only when
+// that reaches zero, at most every few thousand steps, so the clock is
+// read rarely and a script without limits pays one decrement per step. On
+// a breach the position is reported and the interpreter halts: loops and
+// calls unwind, nothing after them runs, konec sections included. Steps
+// and depth are counted per interpreter (per potok thread); the timeout
+// is one deadline for the whole process.
+
+typedef struct {
+    uint64_t max_steps;  // 0: no limit
+    uint64_t timeout_ms;
+    int max_depth;
+} Limits;
+
+// Sets the limits for every interpreter and starts the timeout
+void budget_configure(const Limits* limits);
+// Starts the timeout again, as for a new request of the fork server
+void budget_restart(void);
+// Fresh counters for in; part of interpreter_init_io
+void budget_init(Interpreter* in);
+
+// steps_left ran out: counts the steps taken, checks the limits and
+// returns true if in must halt. `where` is the loop or prikol taking the
+// step, for the message.
+bool budget_check(Interpreter* in, const Stmt* where);
+// depth_left ran out: reports it and halts in
+void budget_too_deep(Interpreter* in, const Stmt* where);
+// Halts in as a breach does, for a runtime error the program cannot go
+// on from; where may be NULL
+void budget_halt(Interpreter* in, const Stmt* where, const char* what);
+// Whether any interpreter has hit a limit since the timeout started
+bool budget_breached(void);
+
+#endif
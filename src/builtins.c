@@ -0,0 +1,55 @@
+#include <string.h>
+
+#include "builtins.h"
+
+static const char* const names[BI_COUNT] = {
+    [BI_NONE] = "",
+    [BI_PECHAT] = "pechat",
+    [BI_VHOD] = "vhod",
+    [BI_SON] = "son",
+    [BI_VREMYA] = "vremya",
+    [BI_CHISLO] = "chislo",
+    [BI_STROKA] = "stroka",
+    [BI_LOGIKA] = "logika",
+    [BI_UKAZATEL] = "ukazatel",
+    [BI_ZNACH] = "znach",
+    [BI_PRISVOIT] = "prisvoit",
+    [BI_SBROS] = "sbros",
+    [BI_MASSIV] = "massiv",
+    [BI_DLINA] = "dlina",
+    [BI_DOBAVIT] = "dobavit",
+    [BI_SUMMA] = "summa",
+    [BI_MINIMUM] = "minimum",
+    [BI_MAKSIMUM] = "maksimum",
+    [BI_UMNOZHIT] = "umnozhit",
+    [BI_SKALYAR] = "skalyar",
+    [BI_ZAPOLNIT] = "zapolnit",
+    [BI_SREZ] = "srez",
+    [BI_CHISLA] = "chisla",
+    [BI_POLYA] = "polya",
+    [BI_FAJL] = "fajl",
+    [BI_STROKI] = "stroki",
+    [BI_NAYTI] = "nayti",
+    [BI_SLOVAR] = "slovar",
+    [BI_KLYUCHI] = "klyuchi",
+    [BI_ZNACHENIYA] = "znacheniya",
+    [BI_EST] = "est",
+    [BI_UDALIT] = "udalit",
+    [BI_POTOK] = "potok",
+    [BI_ZHDAT] = "zhdat",
+    [BI_KANAL] = "kanal",
+    [BI_OTPRAVIT] = "otpravit",
+    [BI_POLUCHIT] = "poluchit",
+    [BI_ZAKRYT] = "zakryt",
+    [BI_ZADACHA] = "zadacha",
+    [BI_PAMYAT] = "pamyat",
+};
+
+BuiltinId builtin_lookup(const char* name) {
+    for (int i = 1; i < BI_COUNT; i++) if (strcmp(names[i], name) == 0) return (BuiltinId)i;
+    return BI_NONE;
+}
+
+const char* builtin_name(BuiltinId id) {
+    return (id > BI_NONE && id < BI_COUNT) ? names[id] : "";
+}
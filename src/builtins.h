@@ -0,0 +1,60 @@
+#ifndef HYPESCRIPT_BUILTINS_H
+#define HYPESCRIPT_BUILTINS_H
+
+// Built-in functions are resolved by name once, when the call node is built,
+// so the interpreter dispatches on the id instead of comparing strings.
+typedef enum {
+    BI_NONE = 0,  // not a builtin: user function (prikol)
+    BI_PECHAT,
+    BI_VHOD,
+    BI_SON,
+    BI_VREMYA,
+    BI_CHISLO,
+    BI_STROKA,
+    BI_LOGIKA,
+    BI_UKAZATEL,
+    BI_ZNACH,
+    BI_PRISVOIT,
+    BI_SBROS,
+    // arrays
+    BI_MASSIV,
+    BI_DLINA,
+    BI_DOBAVIT,
+    BI_SUMMA,
+    BI_MINIMUM,
+    BI_MAKSIMUM,
+    BI_UMNOZHIT,
+    BI_SKALYAR,
+    BI_ZAPOLNIT,
+    BI_SREZ,
+    BI_CHISLA,
+    BI_POLYA,
+    // files
+    BI_FAJL,
+    BI_STROKI,
+    BI_NAYTI,
+    // maps
+    BI_SLOVAR,
+    BI_KLYUCHI,
+    BI_ZNACHENIYA,
+    BI_EST,
+    BI_UDALIT,
+    // threads and channels
+    BI_POTOK,
+    BI_ZHDAT,
+    BI_KANAL,
+    BI_OTPRAVIT,
+    BI_POLUCHIT,
+    BI_ZAKRYT,
+    // tasks
+    BI_ZADACHA,
+    // memory
+    BI_PAMYAT,
+    BI_COUNT
+} BuiltinId;
+
+BuiltinId builtin_lookup(const char* name);
+const char* builtin_name(BuiltinId id);
+
+#endif
+
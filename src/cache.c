@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "codec.h"
+#include "builtins.h"
+#include "token.h"
+#include "mem.h"
+
+// Bump whenever the payload encoding or the AST it describes changes
+#define CACHE_FORMAT 5
+
+// Token and builtin numbering is compiled in, so it is part of the key too
+#define CACHE_LAYOUT ((uint32_t)TOK_OR_OR << 16 | (uint32_t)BI_COUNT << 8 | (uint32_t)sizeof(void*))
+
+typedef struct {
+    char magic[8];            // "HSCACHE\0"
+    uint32_t format;          // CACHE_FORMAT
+    uint32_t layout;          // CACHE_LAYOUT
+    uint32_t lazy;            // prikol bodies stored as source ranges
+    uint32_t reserved;
+    uint64_t version;         // hash of the interpreter version string
+    uint64_t source_hash[2];  // two independently seeded hashes of the source
+    uint64_t source_length;
+    uint64_t payload_length;
+    uint64_t payload_hash;
+} CacheHeader;
+
+static const char cache_magic[8] = "HSCACHE";
+
+static void fill_header(CacheHeader* h, const char* version, bool lazy, const char* source, size_t length) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, cache_magic, sizeof(h->magic));
+    h->format = CACHE_FORMAT;
+    h->layout = CACHE_LAYOUT;
+    h->lazy = lazy;
+    h->version = codec_hash(version, strlen(version), 1);
+    h->source_hash[0] = codec_hash(source, length, 2);
+    h->source_hash[1] = codec_hash(source, length, 3);
+    h->source_length = length;
+}
+
+static char* entry_path(const char* dir, const CacheHeader* h) {
+    size_t n = strlen(dir) + 32;
+    char* path = (char*)mem_alloc(n);
+    snprintf(path, n, "%s/%016llx%s.hsc", dir, (unsigned long long)h->source_hash[0], h->lazy ? "" : "-strict");
+    return path;
+}
+
+char* cache_default_dir(void) {
+    const char* env = getenv("HYPESCRIPT_CACHE_DIR");
+    if (env && *env) {
+        char* out = (char*)mem_alloc(strlen(env) + 1);
+        strcpy(out, env);
+        return out;
+    }
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* suffix = "/hypescript";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.cache/hypescript";
+    }
+    if (!base || !*base) return NULL;
+    char* out = (char*)mem_alloc(strlen(base) + strlen(suffix) + 1);
+    strcpy(out, base);
+    strcat(out, suffix);
+    return out;
+}
+
+// mkdir -p for the cache directory
+static bool make_dirs(const char* dir) {
+    char* path = (char*)mem_alloc(strlen(dir) + 1);
+    strcpy(path, dir);
+    bool ok = true;
+    for (char* p = path + 1; ok; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char c = *p;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) ok = false;
+        *p = c;
+        if (c == '\0') break;
+    }
+    mem_free(path);
+    return ok;
+}
+
+bool cache_store(const char* dir, const char* version, bool lazy, const char* source, size_t length, StmtList* program) {
+    CodecWriter w = {0};
+    w.source = source;
+    w.source_length = length;
+    codec_put_list(&w, program);
+    if (w.failed || !make_dirs(dir)) { mem_free(w.data); return false; }
+
+    CacheHeader h;
+    fill_header(&h, version, lazy, source, length);
+    h.payload_length = w.length;
+    h.payload_hash = codec_hash(w.data, w.length, 4);
+
+    char* path = entry_path(dir, &h);
+    bool ok = codec_write_file(path, &h, sizeof(h), &w);
+    mem_free(path);
+    mem_free(w.data);
+    return ok;
+}
+
+StmtList* cache_load(const char* dir, const char* version, bool lazy, const char* source, size_t length) {
+    CacheHeader expected;
+    fill_header(&expected, version, lazy, source, length);
+    char* path = entry_path(dir, &expected);
+    int fd = open(path, O_RDONLY);
+    mem_free(path);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader)) { close(fd); return NULL; }
+    size_t size = (size_t)st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    StmtList* program = NULL;
+    CacheHeader h;
+    memcpy(&h, data, sizeof(h));
+    const unsigned char* payload = (const unsigned char*)data + sizeof(h);
+    bool valid = memcmp(h.magic, expected.magic, sizeof(h.magic)) == 0
+        && h.format == expected.format && h.layout == expected.layout && h.lazy == expected.lazy
+        && h.version == expected.version
+        && h.source_hash[0] == expected.source_hash[0] && h.source_hash[1] == expected.source_hash[1]
+        && h.source_length == expected.source_length
+        && h.payload_length == size - sizeof(h)
+        && h.payload_hash == codec_hash(payload, (size_t)h.payload_length, 4);
+    if (valid) {
+        CodecReader r = { payload, payload + h.payload_length, false, source, length };
+        program = codec_get_list(&r);
+        // An empty program also comes back as NULL; the caller just parses it
+        if (r.failed || r.p != r.end) { stmt_list_free(program); program = NULL; }
+    }
+    munmap(data, size);
+    return program;
+}
@@ -0,0 +1,26 @@
+#ifndef HYPESCRIPT_CACHE_H
+#define HYPESCRIPT_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ast.h"
+
+// Compiled-program cache. A parsed program is serialized to
+// <dir>/<source hash>[-strict].hsc; the next run with the same source maps
+// that file and rebuilds the AST from it instead of lexing and parsing. The
+// header records the format, the interpreter version and the full source
+// hash and length, and the payload carries a checksum, so a stale, foreign
+// or damaged file is rejected and the caller simply parses again.
+
+// Default directory: $HYPESCRIPT_CACHE_DIR, else $XDG_CACHE_HOME/hypescript,
+// else ~/.cache/hypescript. Returns a malloc'd path, NULL if none applies.
+char* cache_default_dir(void);
+
+// The program for `source`, or NULL when there is no usable cache entry.
+// Lazy (see Parser.lazy) and strict parses are cached separately; a lazy
+// program keeps pointing into `source` for the bodies it has not parsed.
+StmtList* cache_load(const char* dir, const char* version, bool lazy, const char* source, size_t length);
+// Writes the entry atomically (temporary file + rename); false on failure
+bool cache_store(const char* dir, const char* version, bool lazy, const char* source, size_t length, StmtList* program);
+
+#endif
@@ -0,0 +1,484 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "token.h"
+#include "mem.h"
+
+uint64_t codec_hash(const void* data, size_t n, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = seed ^ (0x9E3779B97F4A7C15ull * (uint64_t)(n + 1));
+    while (n >= 8) {
+        uint64_t w; memcpy(&w, p, 8);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+        p += 8; n -= 8;
+    }
+    uint64_t tail = 0;
+    for (size_t i = 0; i < n; i++) tail |= (uint64_t)p[i] << (8 * i);
+    h = (h ^ tail) * 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---- encoding ----
+
+void codec_put(CodecWriter* w, const void* p, size_t n) {
+    if (w->length + n > w->capacity) {
+        size_t cap = w->capacity < 256 ? 256 : w->capacity;
+        while (w->length + n > cap) cap *= 2;
+        w->data = (unsigned char*)mem_realloc(w->data, cap);
+        w->capacity = cap;
+    }
+    memcpy(w->data + w->length, p, n);
+    w->length += n;
+}
+
+void codec_put_u8(CodecWriter* w, uint8_t v) { codec_put(w, &v, 1); }
+void codec_put_u32(CodecWriter* w, uint32_t v) { codec_put(w, &v, 4); }
+void codec_put_u64(CodecWriter* w, uint64_t v) { codec_put(w, &v, 8); }
+void codec_put_f64(CodecWriter* w, double v) { codec_put(w, &v, 8); }
+
+// Length, bytes and a NUL, so the loader can hand out C strings in place
+void codec_put_str(CodecWriter* w, const char* s, size_t n) {
+    codec_put_u32(w, (uint32_t)n);
+    codec_put(w, s, n);
+    codec_put_u8(w, 0);
+}
+
+static void put_expr(CodecWriter* w, const Expr* e) {
+    if (!e) { codec_put_u8(w, 0); return; }
+    codec_put_u8(w, (uint8_t)(e->type + 1));
+    switch (e->type) {
+        case EXPR_LITERAL: {
+            const Value* v = &e->as.literal.value;
+            codec_put_u8(w, (uint8_t)v->type);
+            switch (v->type) {
+                case VAL_NULL: break;
+                case VAL_BOOL: codec_put_u8(w, v->data.as_bool); break;
+                case VAL_NUMBER: codec_put_f64(w, v->data.as_number); break;
+                case VAL_STRING: codec_put_str(w, v->data.as_string->chars, v->data.as_string->length); break;
+                default: w->failed = true; break;
+            }
+            break;
+        }
+        case EXPR_VARIABLE:
+            codec_put_str(w, e->as.variable.name, strlen(e->as.variable.name));
+            break;
+        case EXPR_ASSIGN:
+            codec_put_str(w, e->as.assign.name, strlen(e->as.assign.name));
+            put_expr(w, e->as.assign.value);
+            break;
+        case EXPR_BINARY:
+            codec_put_u32(w, (uint32_t)e->as.binary.op);
+            put_expr(w, e->as.binary.left);
+            put_expr(w, e->as.binary.right);
+            break;
+        case EXPR_UNARY:
+            codec_put_u32(w, (uint32_t)e->as.unary.op);
+            put_expr(w, e->as.unary.expr);
+            break;
+        case EXPR_CALL:
+            codec_put_str(w, e->as.call.callee, strlen(e->as.call.callee));
+            codec_put_u32(w, (uint32_t)e->as.call.arg_count);
+            for (int i = 0; i < e->as.call.arg_count; i++) put_expr(w, e->as.call.args[i]);
+            break;
+        case EXPR_ARRAY:
+            codec_put_u32(w, (uint32_t)e->as.array.count);
+            for (int i = 0; i < e->as.array.count; i++) put_expr(w, e->as.array.items[i]);
+            break;
+        case EXPR_MAP:
+            codec_put_u32(w, (uint32_t)e->as.map.count);
+            for (int i = 0; i < e->as.map.count; i++) {
+                put_expr(w, e->as.map.keys[i]);
+                put_expr(w, e->as.map.values[i]);
+            }
+            break;
+        case EXPR_INDEX:
+            put_expr(w, e->as.index.object);
+            put_expr(w, e->as.index.index);
+            break;
+        case EXPR_INDEX_ASSIGN:
+            put_expr(w, e->as.index_assign.object);
+            put_expr(w, e->as.index_assign.index);
+            put_expr(w, e->as.index_assign.value);
+            break;
+    }
+}
+
+void codec_put_list(CodecWriter* w, const StmtList* list) {
+    uint32_t n = 0;
+    for (const StmtList* it = list; it; it = it->next) n++;
+    codec_put_u32(w, n);
+    for (const StmtList* it = list; it; it = it->next) codec_put_stmt(w, it->stmt);
+}
+
+void codec_put_stmt(CodecWriter* w, const Stmt* s) {
+    if (!s) { codec_put_u8(w, 0); return; }
+    codec_put_u8(w, (uint8_t)(s->type + 1));
+    codec_put_u32(w, (uint32_t)s->line);
+    codec_put_u32(w, (uint32_t)s->column);
+    switch (s->type) {
+        case STMT_EXPR: put_expr(w, s->as.expr.expr); break;
+        case STMT_BLOCK: codec_put_list(w, s->as.block.statements); break;
+        case STMT_IF:
+            put_expr(w, s->as.ifstmt.condition);
+            codec_put_stmt(w, s->as.ifstmt.then_branch);
+            codec_put_stmt(w, s->as.ifstmt.else_branch);
+            break;
+        case STMT_WHILE:
+            put_expr(w, s->as.whilestmt.condition);
+            codec_put_stmt(w, s->as.whilestmt.body);
+            break;
+        case STMT_FOR:
+            codec_put_stmt(w, s->as.forstmt.init);
+            put_expr(w, s->as.forstmt.condition);
+            put_expr(w, s->as.forstmt.increment);
+            codec_put_stmt(w, s->as.forstmt.body);
+            codec_put_u8(w, s->as.forstmt.parallel);
+            codec_put_u32(w, (uint32_t)s->as.forstmt.reduction_count);
+            for (int i = 0; i < s->as.forstmt.reduction_count; i++) {
+                const Reduction* r = &s->as.forstmt.reductions[i];
+                codec_put_u8(w, (uint8_t)r->op);
+                codec_put_str(w, r->name, strlen(r->name));
+            }
+            break;
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+            break;
+        case STMT_FUNC:
+            codec_put_str(w, s->as.func.name, strlen(s->as.func.name));
+            codec_put_u32(w, (uint32_t)s->as.func.param_count);
+            for (int i = 0; i < s->as.func.param_count; i++)
+                codec_put_str(w, s->as.func.params[i], strlen(s->as.func.params[i]));
+            if (s->as.func.body) {
+                codec_put_u8(w, 1);
+                codec_put_stmt(w, s->as.func.body);
+            } else {
+                // Not parsed yet: stored as a position in the source
+                const char* body = s->as.func.lazy_body;
+                if (!body || body < w->source || body > w->source + w->source_length) { w->failed = true; break; }
+                codec_put_u8(w, 0);
+                codec_put_u32(w, (uint32_t)(body - w->source));
+                codec_put_u32(w, (uint32_t)s->as.func.lazy_line);
+                codec_put_u32(w, (uint32_t)s->as.func.lazy_column);
+            }
+            break;
+        case STMT_SECTION:
+            codec_put_u8(w, (uint8_t)s->as.section.kind);
+            codec_put_stmt(w, s->as.section.body);
+            break;
+        case STMT_IMPORT:
+            codec_put_str(w, s->as.import.path, strlen(s->as.import.path));
+            break;
+    }
+}
+
+
+static bool write_fully(int fd, const void* data, size_t n) {
+    const char* p = (const char*)data;
+    while (n > 0) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += k; n -= (size_t)k;
+    }
+    return true;
+}
+
+bool codec_write_file(const char* path, const void* header, size_t header_length, const CodecWriter* w) {
+    size_t n = strlen(path) + 32;
+    char* tmp = (char*)mem_alloc(n);
+    snprintf(tmp, n, "%s.%ld.tmp", path, (long)getpid());
+    bool ok = false;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ok = write_fully(fd, header, header_length) && write_fully(fd, w->data, w->length);
+        ok = close(fd) == 0 && ok;
+        // rename() is atomic, so concurrent runs see the old file or the new one
+        if (ok) ok = rename(tmp, path) == 0;
+        if (!ok) unlink(tmp);
+    }
+    mem_free(tmp);
+    return ok;
+}
+
+// ---- decoding ----
+
+bool codec_get(CodecReader* r, void* out, size_t n) {
+    if (r->failed || (size_t)(r->end - r->p) < n) { r->failed = true; return false; }
+    memcpy(out, r->p, n);
+    r->p += n;
+    return true;
+}
+
+uint8_t codec_get_u8(CodecReader* r) { uint8_t v = 0; codec_get(r, &v, 1); return v; }
+uint32_t codec_get_u32(CodecReader* r) { uint32_t v = 0; codec_get(r, &v, 4); return v; }
+uint64_t codec_get_u64(CodecReader* r) { uint64_t v = 0; codec_get(r, &v, 8); return v; }
+double codec_get_f64(CodecReader* r) { double v = 0; codec_get(r, &v, 8); return v; }
+
+// Points into the mapping; NULL (and failed) if it is not a NUL-terminated run
+const char* codec_get_str(CodecReader* r, size_t* length) {
+    uint32_t n = codec_get_u32(r);
+    if (r->failed || (size_t)(r->end - r->p) <= n || r->p[n] != '\0') { r->failed = true; return NULL; }
+    const char* s = (const char*)r->p;
+    r->p += (size_t)n + 1;
+    if (length) *length = n;
+    return s;
+}
+
+// Element counts are bounded by the bytes left, which also caps allocations
+int codec_get_count(CodecReader* r) {
+    uint32_t n = codec_get_u32(r);
+    if (r->failed || n > (size_t)(r->end - r->p)) { r->failed = true; return 0; }
+    return (int)n;
+}
+
+static bool get_op(CodecReader* r, int* op) {
+    uint32_t v = codec_get_u32(r);
+    if (v > TOK_OR_OR) r->failed = true;
+    *op = (int)v;
+    return !r->failed;
+}
+
+static Expr* get_expr(CodecReader* r);
+
+static Expr** get_exprs(CodecReader* r, int count) {
+    Expr** items = count ? (Expr**)mem_alloc(sizeof(Expr*) * (size_t)count) : NULL;
+    for (int i = 0; i < count; i++) items[i] = get_expr(r);
+    return items;
+}
+
+static void free_exprs(Expr** items, int count) {
+    for (int i = 0; i < count; i++) expr_free(items[i]);
+    mem_free(items);
+}
+
+// Children are decoded first; if anything failed the node is not built and
+// what was decoded is freed, so a bad file never leaks or half-builds
+static Expr* get_expr(CodecReader* r) {
+    uint8_t tag = codec_get_u8(r);
+    if (r->failed || tag == 0) return NULL;
+    switch ((ExprType)(tag - 1)) {
+        case EXPR_LITERAL: {
+            uint8_t type = codec_get_u8(r);
+            switch (type) {
+                case VAL_NULL: return r->failed ? NULL : expr_literal(value_null());
+                case VAL_BOOL: { uint8_t b = codec_get_u8(r); return r->failed ? NULL : expr_literal(value_bool(b != 0)); }
+                case VAL_NUMBER: { double d = codec_get_f64(r); return r->failed ? NULL : expr_literal(value_number(d)); }
+                case VAL_STRING: {
+                    size_t n;
+                    const char* s = codec_get_str(r, &n);
+                    return s ? expr_literal(value_string_len(s, n)) : NULL;
+                }
+                default: r->failed = true; return NULL;
+            }
+        }
+        case EXPR_VARIABLE: {
+            const char* name = codec_get_str(r, NULL);
+            return name ? expr_variable(name) : NULL;
+        }
+        case EXPR_ASSIGN: {
+            const char* name = codec_get_str(r, NULL);
+            Expr* value = get_expr(r);
+            if (r->failed) { expr_free(value); return NULL; }
+            return expr_assign(name, value);
+        }
+        case EXPR_BINARY: {
+            int op;
+            if (!get_op(r, &op)) return NULL;
+            Expr* left = get_expr(r);
+            Expr* right = get_expr(r);
+            if (r->failed) { expr_free(left); expr_free(right); return NULL; }
+            return expr_binary(op, left, right);
+        }
+        case EXPR_UNARY: {
+            int op;
+            if (!get_op(r, &op)) return NULL;
+            Expr* operand = get_expr(r);
+            if (r->failed) { expr_free(operand); return NULL; }
+            return expr_unary(op, operand);
+        }
+        case EXPR_CALL: {
+            const char* callee = codec_get_str(r, NULL);
+            int count = codec_get_count(r);
+            Expr** args = get_exprs(r, count);
+            if (r->failed) { free_exprs(args, count); return NULL; }
+            return expr_call(callee, args, count);
+        }
+        case EXPR_ARRAY: {
+            int count = codec_get_count(r);
+            Expr** items = get_exprs(r, count);
+            if (r->failed) { free_exprs(items, count); return NULL; }
+            return expr_array(items, count);
+        }
+        case EXPR_MAP: {
+            int count = codec_get_count(r);
+            Expr** keys = count ? (Expr**)mem_alloc(sizeof(Expr*) * (size_t)count) : NULL;
+            Expr** values = count ? (Expr**)mem_alloc(sizeof(Expr*) * (size_t)count) : NULL;
+            for (int i = 0; i < count; i++) { keys[i] = get_expr(r); values[i] = get_expr(r); }
+            if (r->failed) { free_exprs(keys, count); free_exprs(values, count); return NULL; }
+            return expr_map(keys, values, count);
+        }
+        case EXPR_INDEX: {
+            Expr* object = get_expr(r);
+            Expr* index = get_expr(r);
+            if (r->failed) { expr_free(object); expr_free(index); return NULL; }
+            return expr_index(object, index);
+        }
+        case EXPR_INDEX_ASSIGN: {
+            Expr* object = get_expr(r);
+            Expr* index = get_expr(r);
+            Expr* value = get_expr(r);
+            if (r->failed) { expr_free(object); expr_free(index); expr_free(value); return NULL; }
+            return expr_index_assign(object, index, value);
+        }
+    }
+    r->failed = true;
+    return NULL;
+}
+
+static Stmt* get_stmt_body(CodecReader* r, uint8_t tag) {
+    switch ((StmtType)(tag - 1)) {
+        case STMT_EXPR: {
+            Expr* e = get_expr(r);
+            if (r->failed) { expr_free(e); return NULL; }
+            return stmt_expr(e);
+        }
+        case STMT_BLOCK: {
+            StmtList* list = codec_get_list(r);
+            return r->failed ? NULL : stmt_block(list);
+        }
+        case STMT_IF: {
+            Expr* cond = get_expr(r);
+            Stmt* then_branch = codec_get_stmt(r);
+            Stmt* else_branch = codec_get_stmt(r);
+            if (r->failed) { expr_free(cond); stmt_free(then_branch); stmt_free(else_branch); return NULL; }
+            return stmt_if(cond, then_branch, else_branch);
+        }
+        case STMT_WHILE: {
+            Expr* cond = get_expr(r);
+            Stmt* body = codec_get_stmt(r);
+            if (r->failed) { expr_free(cond); stmt_free(body); return NULL; }
+            return stmt_while(cond, body);
+        }
+        case STMT_FOR: {
+            Stmt* init = codec_get_stmt(r);
+            Expr* cond = get_expr(r);
+            Expr* inc = get_expr(r);
+            Stmt* body = codec_get_stmt(r);
+            bool parallel = codec_get_u8(r) != 0;
+            int count = codec_get_count(r);
+            Reduction* reductions = count ? (Reduction*)mem_alloc(sizeof(Reduction) * (size_t)count) : NULL;
+            int got = 0;
+            for (; got < count; got++) {
+                uint8_t op = codec_get_u8(r);
+                size_t n;
+                const char* name = codec_get_str(r, &n);
+                if (!name || op > REDUCE_MAX) { r->failed = true; break; }
+                reductions[got].op = (ReduceOp)op;
+                reductions[got].name = (char*)mem_alloc(n + 1);
+                memcpy(reductions[got].name, name, n + 1);
+            }
+            Stmt* loop = r->failed ? NULL : stmt_for(init, cond, inc, body);
+            if (!loop) {
+                stmt_free(init); expr_free(cond); expr_free(inc); stmt_free(body);
+                for (int i = 0; i < got; i++) mem_free(reductions[i].name);
+                mem_free(reductions);
+                return NULL;
+            }
+            loop->as.forstmt.parallel = parallel;
+            loop->as.forstmt.reductions = reductions;
+            loop->as.forstmt.reduction_count = count;
+            if (parallel && !stmt_for_is_range(&loop->as.forstmt)) { stmt_free(loop); r->failed = true; return NULL; }
+            return loop;
+        }
+        case STMT_BREAK: return stmt_break();
+        case STMT_CONTINUE: return stmt_continue();
+        case STMT_FUNC: {
+            const char* name = codec_get_str(r, NULL);
+            int count = codec_get_count(r);
+            char** params = count ? (char**)mem_alloc(sizeof(char*) * (size_t)count) : NULL;
+            int got = 0;
+            for (; got < count; got++) {
+                size_t n;
+                const char* param = codec_get_str(r, &n);
+                if (!param) break;
+                params[got] = (char*)mem_alloc(n + 1);
+                memcpy(params[got], param, n + 1);
+            }
+            Stmt* body = NULL;
+            uint32_t offset = 0, line = 0, column = 0;
+            if (codec_get_u8(r)) {
+                body = codec_get_stmt(r);
+            } else {
+                offset = codec_get_u32(r);
+                line = codec_get_u32(r);
+                column = codec_get_u32(r);
+                if (offset > r->source_length) r->failed = true;
+            }
+            if (r->failed) {
+                for (int i = 0; i < got; i++) mem_free(params[i]);
+                mem_free(params);
+                stmt_free(body);
+                return NULL;
+            }
+            Stmt* fn = stmt_func(name, params, count, body);
+            if (!body) {
+                fn->as.func.lazy_body = r->source + offset;
+                fn->as.func.lazy_line = (int)line;
+                fn->as.func.lazy_column = (int)column;
+            }
+            return fn;
+        }
+        case STMT_SECTION: {
+            uint8_t kind = codec_get_u8(r);
+            if (kind > SECTION_END) r->failed = true;
+            Stmt* body = codec_get_stmt(r);
+            if (r->failed || !body || body->type != STMT_BLOCK) { stmt_free(body); r->failed = true; return NULL; }
+            return stmt_section((SectionKind)kind, body);
+        }
+        case STMT_IMPORT: {
+            const char* path = codec_get_str(r, NULL);
+            if (!path) { r->failed = true; return NULL; }
+            return stmt_import(path);
+        }
+    }
+    r->failed = true;
+    return NULL;
+}
+
+Stmt* codec_get_stmt(CodecReader* r) {
+    uint8_t tag = codec_get_u8(r);
+    if (r->failed || tag == 0) return NULL;
+    uint32_t line = codec_get_u32(r);
+    uint32_t column = codec_get_u32(r);
+    Stmt* s = r->failed ? NULL : get_stmt_body(r, tag);
+    if (s) {
+        s->line = (int)line;
+        s->column = (int)column;
+    }
+    return s;
+}
+
+StmtList* codec_get_list(CodecReader* r) {
+    int count = codec_get_count(r);
+    StmtList* head = NULL;
+    StmtList** tail = &head;
+    for (int i = 0; i < count && !r->failed; i++) {
+        Stmt* s = codec_get_stmt(r);
+        if (r->failed) break;
+        tail = stmt_list_push(tail, s);
+    }
+    if (r->failed) { stmt_list_free(head); return NULL; }
+    return head;
+}
@@ -0,0 +1,56 @@
+#ifndef HYPESCRIPT_CODEC_H
+#define HYPESCRIPT_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// Binary encoding shared by the program cache and interpreter snapshots:
+// fixed-width native-endian scalars, length-prefixed NUL-terminated
+// strings, and the AST in pre-order. Files are only read back by the same
+// build on the same machine, which their headers check. The reader is
+// bounds-checked; any malformed input sets `failed`, and the AST decoders
+// then return NULL without leaking what they had built.
+
+typedef struct {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+    bool failed; // the AST holds something the format cannot express
+    const char* source; // lazy prikol bodies are stored as offsets into it
+    size_t source_length;
+} CodecWriter;
+
+typedef struct {
+    const unsigned char* p;
+    const unsigned char* end;
+    bool failed;
+    const char* source;
+    size_t source_length;
+} CodecReader;
+
+uint64_t codec_hash(const void* data, size_t n, uint64_t seed);
+
+void codec_put(CodecWriter* w, const void* p, size_t n);
+void codec_put_u8(CodecWriter* w, uint8_t v);
+void codec_put_u32(CodecWriter* w, uint32_t v);
+void codec_put_u64(CodecWriter* w, uint64_t v);
+void codec_put_f64(CodecWriter* w, double v);
+void codec_put_str(CodecWriter* w, const char* s, size_t n);
+void codec_put_stmt(CodecWriter* w, const Stmt* s); // NULL allowed
+void codec_put_list(CodecWriter* w, const StmtList* list);
+// Writes header + payload to a temporary file renamed over `path`
+bool codec_write_file(const char* path, const void* header, size_t header_length, const CodecWriter* w);
+
+bool codec_get(CodecReader* r, void* out, size_t n);
+uint8_t codec_get_u8(CodecReader* r);
+uint32_t codec_get_u32(CodecReader* r);
+uint64_t codec_get_u64(CodecReader* r);
+double codec_get_f64(CodecReader* r);
+const char* codec_get_str(CodecReader* r, size_t* length); // points into the input
+int codec_get_count(CodecReader* r); // bounded by the bytes left
+Stmt* codec_get_stmt(CodecReader* r);
+StmtList* codec_get_list(CodecReader* r);
+
+#endif
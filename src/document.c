@@ -0,0 +1,250 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "document.h"
+#include "lexer.h"
+#include "parser.h"
+#include "mem.h"
+
+// One top-level statement and the whitespace and comments after it, up to
+// the next one
+typedef struct {
+    size_t start;     // its first token; 0 for the first, which has !HYPE! before it
+    int line, column; // of start
+    Diagnostic* diagnostics;
+    int diagnostic_count;
+} Span;
+
+struct Document {
+    char* text; // NUL-terminated for the lexer
+    size_t length, capacity;
+    Span* spans;
+    size_t count, span_capacity;
+    size_t reparsed;
+};
+
+static void span_clear(Span* s) {
+    for (int i = 0; i < s->diagnostic_count; i++) mem_free(s->diagnostics[i].message);
+    mem_free(s->diagnostics);
+    s->diagnostics = NULL;
+    s->diagnostic_count = 0;
+}
+
+static void on_error(void* ctx, int line, int column, const char* message) {
+    Span* s = (Span*)ctx;
+    s->diagnostics = (Diagnostic*)mem_realloc(s->diagnostics, sizeof(Diagnostic) * (size_t)(s->diagnostic_count + 1));
+    Diagnostic* d = &s->diagnostics[s->diagnostic_count++];
+    d->line = line;
+    d->column = column;
+    d->message = (char*)mem_alloc(strlen(message) + 1);
+    strcpy(d->message, message);
+}
+
+// The last span starting before offset, 0 if none does
+static size_t span_before(const Span* spans, size_t count, size_t offset) {
+    size_t lo = 0, hi = count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (spans[mid].start < offset) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// The span starting exactly at offset, or count
+static size_t span_at(const Span* spans, size_t count, size_t offset) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (spans[mid].start < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < count && spans[lo].start == offset ? lo : count;
+}
+
+// Where line (from 1) begins, scanning from the last span that starts on
+// or before it rather than from the top
+static size_t line_start(const Document* d, int line) {
+    size_t offset = 0;
+    int at = 1;
+    size_t lo = 0, hi = d->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (d->spans[mid].line <= line) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0) {
+        offset = d->spans[lo - 1].start;
+        at = d->spans[lo - 1].line;
+        while (offset > 0 && d->text[offset - 1] != '\n') offset--;
+    }
+    while (at < line) {
+        const char* nl = (const char*)memchr(d->text + offset, '\n', d->length - offset);
+        if (!nl) return d->length;
+        offset = (size_t)(nl - d->text) + 1;
+        at++;
+    }
+    return offset;
+}
+
+static size_t utf8_length(unsigned char c) {
+    return c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+}
+
+static size_t offset_of(const Document* d, int line, int character) {
+    size_t offset = line_start(d, line + 1);
+    for (int units = 0; offset < d->length && d->text[offset] != '\n' && units < character;) {
+        size_t n = utf8_length((unsigned char)d->text[offset]);
+        units += n == 4 ? 2 : 1;
+        offset += n;
+    }
+    return offset < d->length ? offset : d->length;
+}
+
+int document_character(const Document* d, int line, int column) {
+    size_t offset = line_start(d, line);
+    size_t end = offset + (size_t)(column > 1 ? column - 1 : 0);
+    int units = 0;
+    while (offset < end && offset < d->length && d->text[offset] != '\n') {
+        size_t n = utf8_length((unsigned char)d->text[offset]);
+        units += n == 4 ? 2 : 1;
+        offset += n;
+    }
+    return units;
+}
+
+static int count_lines(const char* s, size_t n) {
+    int lines = 0;
+    for (const char* nl = s; (nl = (const char*)memchr(nl, '\n', n - (size_t)(nl - s))) != NULL; nl++) lines++;
+    return lines;
+}
+
+// Parses d->text from span `from` on, until a statement ends at or after
+// `stable` where an old span - moved by `delta` bytes and `line_delta`
+// lines - starts: the spans parsed replace the old ones before it, which
+// are kept with their positions shifted.
+static void reparse(Document* d, size_t from, size_t stable, long delta, int line_delta) {
+    Span* fresh = NULL;
+    size_t count = 0, capacity = 0;
+    d->reparsed = 0;
+
+    Parser p;
+    if (from == 0) {
+        parser_init(&p, d->text);
+        parse_header(&p);
+    } else {
+        parser_init_at(&p, d->text + d->spans[from].start, d->spans[from].line, d->spans[from].column);
+    }
+    p.on_error = on_error;
+    size_t taken = d->count;
+    while (p.current.type != TOK_EOF) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            fresh = (Span*)mem_realloc(fresh, sizeof(Span) * capacity);
+        }
+        Span* s = &fresh[count++];
+        bool first = from == 0 && count == 1;
+        s->start = first ? 0 : (size_t)(p.current.start - d->text);
+        s->line = first ? 1 : p.current.line;
+        s->column = first ? 1 : p.current.column;
+        s->diagnostics = NULL;
+        s->diagnostic_count = 0;
+        p.error_ctx = s;
+        stmt_free(parse_top_level(&p));
+
+        size_t end = (size_t)(p.current.start - d->text);
+        if (p.current.type == TOK_EOF || end < stable) continue;
+        size_t j = span_at(d->spans, d->count, (size_t)((long)end - delta));
+        if (j < d->count && j > from && d->spans[j].line + line_delta == p.current.line
+            && d->spans[j].column == p.current.column) {
+            taken = j;
+            break;
+        }
+    }
+    token_free(&p.current);
+    token_free(&p.previous);
+    d->reparsed = count;
+
+    for (size_t i = from; i < taken; i++) span_clear(&d->spans[i]);
+    size_t kept = d->count - taken;
+    if (from + count + kept > d->span_capacity) {
+        d->span_capacity = (from + count + kept) * 2;
+        d->spans = (Span*)mem_realloc(d->spans, sizeof(Span) * d->span_capacity);
+    }
+    memmove(d->spans + from + count, d->spans + taken, sizeof(Span) * kept);
+    if (count) memcpy(d->spans + from, fresh, sizeof(Span) * count);
+    d->count = from + count + kept;
+    for (size_t i = from + count; i < d->count; i++) {
+        Span* s = &d->spans[i];
+        s->start = (size_t)((long)s->start + delta);
+        if (!line_delta) continue;
+        s->line += line_delta;
+        for (int k = 0; k < s->diagnostic_count; k++) s->diagnostics[k].line += line_delta;
+    }
+    mem_free(fresh);
+}
+
+Document* document_new(const char* text, size_t length) {
+    Document* d = (Document*)mem_alloc(sizeof(Document));
+    d->capacity = length + 1;
+    d->text = (char*)mem_alloc(d->capacity);
+    memcpy(d->text, text, length);
+    d->text[length] = '\0';
+    d->length = length;
+    d->spans = NULL;
+    d->count = d->span_capacity = 0;
+    reparse(d, 0, 0, 0, 0);
+    return d;
+}
+
+void document_free(Document* d) {
+    if (!d) return;
+    for (size_t i = 0; i < d->count; i++) span_clear(&d->spans[i]);
+    mem_free(d->spans);
+    mem_free(d->text);
+    mem_free(d);
+}
+
+void document_edit(Document* d, int start_line, int start_character, int end_line, int end_character,
+                   const char* text, size_t length) {
+    size_t a = offset_of(d, start_line, start_character);
+    size_t b = offset_of(d, end_line, end_character);
+    if (b < a) b = a;
+
+    // The statement the edit starts in, or the one before when the edit
+    // touches its first token: esli looks past its end for inache
+    size_t from = span_before(d->spans, d->count, a);
+    if (from > 0) {
+        Lexer l;
+        lexer_init(&l, d->text + d->spans[from].start);
+        Token first = lexer_next(&l);
+        token_free(&first);
+        if (a <= d->spans[from].start + (size_t)(l.current - l.source)) from--;
+    }
+
+    int line_delta = count_lines(text, length) - count_lines(d->text + a, b - a);
+    size_t new_length = d->length - (b - a) + length;
+    if (new_length + 1 > d->capacity) {
+        d->capacity = (new_length + 1) * 2;
+        d->text = (char*)mem_realloc(d->text, d->capacity);
+    }
+    memmove(d->text + a + length, d->text + b, d->length - b + 1);
+    memcpy(d->text + a, text, length);
+    d->length = new_length;
+
+    reparse(d, from, a + length, (long)length - (long)(b - a), line_delta);
+}
+
+void document_diagnostics(const Document* d, void (*fn)(void* ctx, const Diagnostic* diagnostic), void* ctx) {
+    for (size_t i = 0; i < d->count; i++)
+        for (int k = 0; k < d->spans[i].diagnostic_count; k++) fn(ctx, &d->spans[i].diagnostics[k]);
+}
+
+size_t document_statements(const Document* d) {
+    return d->count;
+}
+
+size_t document_reparsed(const Document* d) {
+    return d->reparsed;
+}
@@ -0,0 +1,39 @@
+#ifndef HYPESCRIPT_DOCUMENT_H
+#define HYPESCRIPT_DOCUMENT_H
+
+#include <stddef.h>
+
+// A source file open in an editor, kept parsed for the language server.
+//
+// The text is held as its top-level statements - prikol definitions,
+// sections, everything else - each parsed on its own by parse_top_level,
+// every body included, with the syntax errors found in it. An edit is
+// re-lexed and re-parsed from the statement it starts in, and only until
+// a statement ends where an old one, moved by the edit, begins: from
+// there on the old statements are taken over with their lines shifted.
+// A keystroke in a script of many thousands of lines thus costs about the
+// statement it lands in.
+
+typedef struct {
+    int line;   // from 1
+    int column; // from 1, in bytes, as the lexer counts
+    char* message;
+} Diagnostic;
+
+typedef struct Document Document;
+
+Document* document_new(const char* text, size_t length);
+void document_free(Document* d);
+// Replaces the text between two positions, given as in the Language
+// Server Protocol: lines from 0, characters in UTF-16 code units
+void document_edit(Document* d, int start_line, int start_character, int end_line, int end_character,
+                   const char* text, size_t length);
+// Calls fn with every syntax error of the text, in order
+void document_diagnostics(const Document* d, void (*fn)(void* ctx, const Diagnostic* diagnostic), void* ctx);
+// The UTF-16 character, from 0, at a diagnostic's line and column
+int document_character(const Document* d, int line, int column);
+// Top-level statements in the text, and how many the last edit parsed
+size_t document_statements(const Document* d);
+size_t document_reparsed(const Document* d);
+
+#endif
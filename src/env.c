@@ -1,17 +1,23 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "env.h"
+#include "ast.h"
+#include "stats.h"
+#include "memo.h"
+#define MEM_KIND MEM_ENV
+#include "mem.h"
 
 static char* str_dup(const char* s) {
     size_t len = strlen(s);
-    char* out = (char*)malloc(len + 1);
+    char* out = (char*)mem_alloc(len + 1);
     memcpy(out, s, len + 1);
     return out;
 }
 
 Env* env_create(Env* parent) {
-    Env* e = (Env*)malloc(sizeof(Env));
+    Env* e = (Env*)mem_alloc(sizeof(Env));
     e->head = NULL;
     e->parent = parent;
     return e;
@@ -22,16 +28,16 @@ void env_free(Env* env) {
     VarEntry* cur = env->head;
     while (cur) {
         VarEntry* next = cur->next;
-        free(cur->name);
+        mem_free(cur->name);
         value_free(&cur->value);
-        free(cur);
+        mem_free(cur);
         cur = next;
     }
-    free(env);
+    mem_free(env);
 }
 
 bool env_set(Env* env, const char* name, Value value) {
-    VarEntry* e = (VarEntry*)malloc(sizeof(VarEntry));
+    VarEntry* e = (VarEntry*)mem_alloc(sizeof(VarEntry));
     e->name = str_dup(name);
     e->value = value;
     e->next = env->head;
@@ -39,7 +45,24 @@ bool env_set(Env* env, const char* name, Value value) {
     return true;
 }
 
+// For --stats: how far a lookup of name walks. Done as a separate walk so
+// that the lookups themselves stay as they are while stats are off.
+static void count_walk(Env* env, const char* name, bool assign) {
+    uint64_t scopes = 0, names = 0;
+    bool found = false;
+    for (Env* e = env; e && !found; e = e->parent) {
+        scopes++;
+        for (VarEntry* v = e->head; v; v = v->next) {
+            names++;
+            if (strcmp(v->name, name) == 0) { found = true; break; }
+        }
+    }
+    if (assign) { stats_local.env_assigns++; stats_local.env_assign_scopes += scopes; stats_local.env_assign_entries += names; }
+    else { stats_local.env_gets++; stats_local.env_get_scopes += scopes; stats_local.env_get_entries += names; }
+}
+
 bool env_assign(Env* env, const char* name, Value value) {
+    if (stats_enabled) count_walk(env, name, true);
     for (Env* e = env; e; e = e->parent) {
         for (VarEntry* v = e->head; v; v = v->next) {
             if (strcmp(v->name, name) == 0) {
@@ -53,6 +76,7 @@ bool env_assign(Env* env, const char* name, Value value) {
 }
 
 bool env_get(Env* env, const char* name, Value* out) {
+    if (stats_enabled) count_walk(env, name, false);
     for (Env* e = env; e; e = e->parent) {
         for (VarEntry* v = e->head; v; v = v->next) {
             if (strcmp(v->name, name) == 0) {
@@ -64,34 +88,86 @@ bool env_get(Env* env, const char* name, Value* out) {
     return false;
 }
 
-void funcs_init(Functions* f) { f->head = NULL; }
+void funcs_init(Functions* f) {
+    f->head = NULL;
+    f->buckets = NULL;
+    f->bucket_mask = 0;
+    f->count = 0;
+}
+
+static size_t name_hash(const char* name) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+static void bucket_insert(Functions* f, FunctionDef* def) {
+    FunctionDef** bucket = &f->buckets[name_hash(def->name) & f->bucket_mask];
+    def->next_in_bucket = *bucket;
+    *bucket = def;
+}
+
+// Doubles the table; definitions are re-inserted oldest first so that
+// each bucket keeps the newest definition of a name in front
+static void funcs_grow(Functions* f) {
+    size_t size = f->buckets ? (f->bucket_mask + 1) * 2 : 64;
+    mem_free(f->buckets);
+    f->buckets = (FunctionDef**)mem_calloc(size, sizeof(FunctionDef*));
+    f->bucket_mask = size - 1;
+    FunctionDef** defs = (FunctionDef**)mem_alloc(sizeof(FunctionDef*) * (f->count ? f->count : 1));
+    size_t i = f->count;
+    for (FunctionDef* d = f->head; d; d = d->next) defs[--i] = d;
+    for (i = 0; i < f->count; i++) bucket_insert(f, defs[i]);
+    mem_free(defs);
+}
 
 void funcs_free(Functions* f) {
     FunctionDef* cur = f->head;
     while (cur) {
         FunctionDef* next = cur->next;
-        free(cur->name);
-        for (int i = 0; i < cur->param_count; i++) free(cur->params[i]);
-        free(cur->params);
-        // body is owned by AST program; do not free here to avoid double free
+        mem_free(cur->name);
+        // Parameters and a body from the AST belong to the program
+        if (cur->owns_params) {
+            for (int i = 0; i < cur->param_count; i++) mem_free(cur->params[i]);
+            mem_free(cur->params);
+        }
+        if (cur->owns_body) stmt_free(cur->body);
+        memo_free(cur->memo);
         cur->body = NULL;
-        free(cur);
+        mem_free(cur);
         cur = next;
     }
+    mem_free(f->buckets);
+    funcs_init(f);
 }
 
-void funcs_register(Functions* f, const char* name, char** params, int param_count, Stmt* body) {
-    FunctionDef* def = (FunctionDef*)malloc(sizeof(FunctionDef));
+FunctionDef* funcs_register(Functions* f, const char* name, char** params, int param_count, Stmt* body) {
+    FunctionDef* def = (FunctionDef*)mem_alloc(sizeof(FunctionDef));
     def->name = str_dup(name);
     def->params = params;
     def->param_count = param_count;
     def->body = body;
+    def->origin = NULL;
+    def->lazy_body = NULL;
+    def->lazy_line = 0;
+    def->lazy_column = 0;
+    def->owns_params = false;
+    def->owns_body = false;
+    def->memo = NULL;
     def->next = f->head;
     f->head = def;
+    if (f->count++ >= f->bucket_mask) funcs_grow(f);
+    else bucket_insert(f, def);
+    return def;
 }
 
 FunctionDef* funcs_lookup(Functions* f, const char* name) {
-    for (FunctionDef* d = f->head; d; d = d->next) if (strcmp(d->name, name) == 0) return d;
+    STAT_ADD(func_lookups, 1);
+    if (f->buckets) {
+        for (FunctionDef* d = f->buckets[name_hash(name) & f->bucket_mask]; d; d = d->next_in_bucket)
+            if (strcmp(d->name, name) == 0) return d;
+    }
+    STAT_ADD(func_misses, 1);
     return NULL;
 }
 
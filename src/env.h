@@ -29,17 +29,32 @@ typedef struct FunctionDef {
     char* name;
     char** params;
     int param_count;
-    Stmt* body;
-    struct FunctionDef* next;
+    Stmt* body;            // NULL until a lazily skipped body is parsed
+    const Stmt* origin;    // the prikol statement it was defined by, if any
+    const char* lazy_body; // see StmtFunc
+    int lazy_line;
+    int lazy_column;
+    bool owns_params;      // params are freed here rather than by the AST
+    bool owns_body;        // body was parsed on first call and is freed here
+    struct Memo* memo;     // --memo: see memo.h
+    struct FunctionDef* next;        // newest first
+    struct FunctionDef* next_in_bucket;
 } FunctionDef;
 
+// Definitions are listed newest first and indexed by a chained hash table
+// on the name, so lookups stay O(1) with thousands of functions
 typedef struct Functions {
     FunctionDef* head;
+    FunctionDef** buckets;
+    size_t bucket_mask; // bucket count - 1, a power of two minus one
+    size_t count;
 } Functions;
 
 void funcs_init(Functions* f);
 void funcs_free(Functions* f);
-void funcs_register(Functions* f, const char* name, char** params, int param_count, Stmt* body);
+// Registers a function; params and body stay with the caller unless the
+// owns_ flags of the returned definition are set
+FunctionDef* funcs_register(Functions* f, const char* name, char** params, int param_count, Stmt* body);
 FunctionDef* funcs_lookup(Functions* f, const char* name);
 
 #endif
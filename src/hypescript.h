@@ -0,0 +1,73 @@
+#ifndef HYPESCRIPT_H
+#define HYPESCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Embedding API (libhypescript). A program is compiled once into an
+// immutable HsProgram that any number of interpreters can run, each on its
+// own thread if needed: interpreters share nothing but the programs they
+// run and the modules those import with podklyuchit, which are parsed once
+// per process and shared by every run (paths are relative to the working
+// directory here). A single interpreter must not be
+// used by two threads at once. A program must outlive every interpreter
+// that has run it, since values can refer to its string literals.
+
+#define HYPESCRIPT_VERSION "0.1.0"
+
+typedef struct HsProgram HsProgram;
+typedef struct HsInterpreter HsInterpreter;
+typedef struct HsValue HsValue;
+
+typedef enum {
+    HS_NULL,
+    HS_BOOL,
+    HS_NUMBER,
+    HS_STRING,
+    HS_ARRAY,
+    HS_MAP,
+    HS_OBJECT // channel or thread handle; can only be passed back in
+} HsType;
+
+// Parses the whole program up front, prikol bodies included. NULL on a
+// syntax error; the parser's messages go to stderr.
+HsProgram* hs_compile(const char* source, size_t length);
+void hs_program_free(HsProgram* program);
+
+// pechat writes to output_fd, vhod reads from input_fd; -1 disables either
+HsInterpreter* hs_interpreter_new(int input_fd, int output_fd);
+void hs_interpreter_free(HsInterpreter* in);
+// Runs the program: prikol definitions, nachalo, main statements, konec.
+// Globals persist between runs, so inputs can be set before and results
+// read after. Output is flushed when the run ends. False, with nothing
+// run, when a podklyuchit fails; the message is on stderr.
+bool hs_run(HsInterpreter* in, const HsProgram* program);
+
+// Global variables. hs_set takes over the value; hs_get returns a new
+// handle, or NULL when the variable does not exist.
+void hs_set(HsInterpreter* in, const char* name, HsValue* value);
+HsValue* hs_get(HsInterpreter* in, const char* name);
+
+// Values are handles the caller frees with hs_value_free. Arrays and maps
+// are shared by reference with the interpreter, like in the language.
+HsValue* hs_null(void);
+HsValue* hs_bool(bool b);
+HsValue* hs_number(double n);
+HsValue* hs_string(const char* s, size_t length);
+HsValue* hs_array(void);
+HsValue* hs_map(void);
+void hs_value_free(HsValue* v);
+
+HsType hs_type(const HsValue* v);
+bool hs_as_bool(const HsValue* v);     // truthiness for non-bools
+double hs_as_number(const HsValue* v); // 0 for non-numbers
+// The characters, not NUL-terminated, valid while v lives; NULL if not a string
+const char* hs_as_string(const HsValue* v, size_t* length);
+size_t hs_length(const HsValue* v);    // of a string, array or map; else 0
+
+void hs_array_push(HsValue* array, HsValue* item);                // takes item
+HsValue* hs_array_get(const HsValue* array, size_t index);        // NULL if out of range
+bool hs_map_set(HsValue* map, const HsValue* key, HsValue* value); // takes value
+HsValue* hs_map_get(const HsValue* map, const HsValue* key);      // NULL if missing
+
+#endif
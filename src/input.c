@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "mem.h"
+
+static Input stdin_reader;
+static bool stdin_ready = false;
+
+Input* input_stdin(void) {
+    if (!stdin_ready) {
+        input_init(&stdin_reader, STDIN_FILENO, INPUT_DEFAULT_BLOCK);
+        stdin_ready = true;
+    }
+    return &stdin_reader;
+}
+
+void input_init(Input* in, int fd, size_t block_size) {
+    if (block_size < 512) block_size = 512;
+    in->fd = fd;
+    in->buf = (char*)mem_alloc(block_size);
+    in->start = 0;
+    in->end = 0;
+    in->capacity = block_size;
+    in->eof = false;
+    in->tie = NULL;
+}
+
+void input_free(Input* in) {
+    mem_free(in->buf);
+    in->buf = NULL;
+    in->start = in->end = in->capacity = 0;
+}
+
+bool input_fill(Input* in) {
+    if (in->eof) return false;
+    if (in->start > 0) {
+        memmove(in->buf, in->buf + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+    }
+    if (in->end == in->capacity) {
+        in->capacity *= 2;
+        in->buf = (char*)mem_realloc(in->buf, in->capacity);
+    }
+    // Prompts and earlier output must be visible before we wait for input
+    if (in->tie) output_flush(in->tie);
+    for (;;) {
+        ssize_t n = read(in->fd, in->buf + in->end, in->capacity - in->end);
+        if (n > 0) { in->end += (size_t)n; return true; }
+        if (n < 0 && errno == EINTR) continue;
+        in->eof = true;
+        return false;
+    }
+}
+
+String* input_read_line(Input* in) {
+    size_t scanned = 0; // bytes after start already known to hold no '\n'
+    for (;;) {
+        char* begin = in->buf + in->start;
+        size_t avail = in->end - in->start;
+        char* nl = (char*)memchr(begin + scanned, '\n', avail - scanned);
+        if (nl) {
+            size_t length = (size_t)(nl - begin);
+            in->start += length + 1;
+            return string_new(begin, length);
+        }
+        scanned = avail;
+        if (!input_fill(in)) {
+            if (avail == 0) return NULL;
+            in->start = in->end;
+            return string_new(in->buf + in->end - avail, avail);
+        }
+    }
+}
+
+bool input_has_line(const Input* in) {
+    return in->eof || memchr(in->buf + in->start, '\n', in->end - in->start) != NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef HYPESCRIPT_INPUT_H
+#define HYPESCRIPT_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "value.h"
+#include "output.h"
+
+// Line reader on top of read(2), used by vhod. Input is pulled in large
+// chunks and lines are found with memchr over the buffer, so each line
+// costs one copy: from the read buffer into its String. The buffer grows
+// only for lines longer than a chunk.
+#define INPUT_DEFAULT_BLOCK (256 * 1024)
+
+typedef struct {
+    int fd;
+    char* buf;
+    size_t start;    // first unconsumed byte
+    size_t end;      // end of the bytes read so far
+    size_t capacity;
+    bool eof;        // read(2) reported end of input or an error
+    Output* tie;     // flushed before each read(2) that may block, or NULL
+} Input;
+
+// Process-wide reader for stdin
+Input* input_stdin(void);
+
+void input_init(Input* in, int fd, size_t block_size);
+void input_free(Input* in);
+
+// Next line without its '\n' (a final line without one is returned as is).
+// NULL at end of input.
+String* input_read_line(Input* in);
+
+// For readers that wait for input themselves (see task.h): whether
+// input_read_line would return without reading, and one read(2) after
+// making room in the buffer, false at end of input
+bool input_has_line(const Input* in);
+bool input_fill(Input* in);
+
+#endif
@@ -1,95 +1,210 @@
 #define _POSIX_C_SOURCE 199309L
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "interp.h"
+#include "parser.h"
 #include "token.h"
+#include "array.h"
+#include "map.h"
+#include "builtins.h"
+#include "number.h"
+#include "thread.h"
+#include "object.h"
+#include "parallel.h"
+#include "task.h"
+#include "stats.h"
+#include "budget.h"
+#include "memo.h"
+#include "module.h"
+#include "mem.h"
 
 static Value eval_expr(Interpreter* in, Env* env, Expr* e);
 static void exec_stmt(Interpreter* in, Env* env, Stmt* s);
 
-static char* hs_strdup(const char* s) {
-    if (!s) return NULL;
-    size_t len = strlen(s);
-    char* out = (char*)malloc(len + 1);
-    if (!out) return NULL;
-    memcpy(out, s, len + 1);
-    return out;
+void interpreter_init(Interpreter* in) {
+    interpreter_init_io(in, output_stdout(), input_stdin());
 }
 
-void interpreter_init(Interpreter* in) {
+void interpreter_init_io(Interpreter* in, Output* out, Input* input) {
     in->globals = env_create(NULL);
     in->signaled_break = 0;
     in->signaled_continue = 0;
     funcs_init(&in->functions);
+    in->out = out;
+    in->input = input;
+    in->input->tie = in->out;
+    in->program = NULL;
+    in->threads = NULL;
+    in->worker = false;
+    in->scheduler = NULL;
+    in->frame = NULL;
+    in->dir = NULL;
+    in->imported = NULL;
+    in->imported_count = 0;
+    budget_init(in);
 }
 
 void interpreter_free(Interpreter* in) {
+    tasks_free(in);
+    threads_join(&in->threads);
+    output_flush(in->out);
     env_free(in->globals);
     funcs_free(&in->functions);
+    mem_free(in->imported);
+}
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} StrBuf;
+
+static void sb_append(StrBuf* b, const char* s, size_t n) {
+    if (b->length + n + 1 > b->capacity) {
+        size_t cap = b->capacity < 64 ? 64 : b->capacity;
+        while (b->length + n + 1 > cap) cap *= 2;
+        b->data = (char*)mem_realloc(b->data, cap);
+        b->capacity = cap;
+    }
+    memcpy(b->data + b->length, s, n);
+    b->length += n;
+    b->data[b->length] = '\0';
 }
 
-static Value builtin_pechat(int argc, Value* argv) {
+static void repr_within(StrBuf* b, const Value* v, int nested, const Enclosing* outer);
+
+// Text form used by pechat and string concatenation; strings nested inside
+// arrays and maps are quoted so that [1, "1"] stays readable, and an array
+// or map inside itself prints as [...] or {...}.
+static void repr_value(StrBuf* b, const Value* v, int nested) {
+    repr_within(b, v, nested, NULL);
+}
+
+static void repr_within(StrBuf* b, const Value* v, int nested, const Enclosing* outer) {
+    char tmp[NUMBER_FORMAT_MAX];
+    switch (v->type) {
+        case VAL_NULL: sb_append(b, "null", 4); break;
+        case VAL_BOOL: if (v->data.as_bool) sb_append(b, "true", 4); else sb_append(b, "false", 5); break;
+        case VAL_NUMBER: {
+            int n = number_format(v->data.as_number, tmp);
+            sb_append(b, tmp, (size_t)n);
+            break;
+        }
+        case VAL_STRING:
+            if (nested) sb_append(b, "\"", 1);
+            sb_append(b, v->data.as_string->chars, v->data.as_string->length);
+            if (nested) sb_append(b, "\"", 1);
+            break;
+        case VAL_ARRAY: {
+            const Array* a = v->data.as_array;
+            if (enclosing_has(outer, a, a)) { sb_append(b, "[...]", 5); break; }
+            Enclosing here = { a, a, outer };
+            sb_append(b, "[", 1);
+            for (size_t i = 0; i < a->length; i++) {
+                if (i) sb_append(b, ", ", 2);
+                Value item = array_peek(a, i);
+                repr_within(b, &item, 1, &here);
+            }
+            sb_append(b, "]", 1);
+            break;
+        }
+        case VAL_MAP: {
+            const Map* m = v->data.as_map;
+            if (enclosing_has(outer, m, m)) { sb_append(b, "{...}", 5); break; }
+            Enclosing here = { m, m, outer };
+            size_t cursor = 0;
+            Value key, item;
+            sb_append(b, "{", 1);
+            for (int first = 1; map_next(m, &cursor, &key, &item); first = 0) {
+                if (!first) sb_append(b, ", ", 2);
+                repr_within(b, &key, 1, &here);
+                sb_append(b, ": ", 2);
+                repr_within(b, &item, 1, &here);
+            }
+            sb_append(b, "}", 1);
+            break;
+        }
+        case VAL_OBJECT:
+            sb_append(b, "<", 1);
+            sb_append(b, v->data.as_object->type->name, strlen(v->data.as_object->type->name));
+            sb_append(b, ">", 1);
+            break;
+    }
+}
+
+static Value builtin_pechat(Interpreter* in, int argc, Value* argv) {
+    Output* out = in->out;
+    char tmp[NUMBER_FORMAT_MAX];
     for (int i = 0; i < argc; i++) {
-        if (i) printf(" ");
+        if (i) output_write(out, " ", 1);
         switch (argv[i].type) {
-            case VAL_NULL: printf("null"); break;
-            case VAL_BOOL: printf(argv[i].data.as_bool ? "true" : "false"); break;
-            case VAL_NUMBER: printf("%g", argv[i].data.as_number); break;
-            case VAL_STRING: printf("%s", argv[i].data.as_string ? argv[i].data.as_string : ""); break;
+            case VAL_NULL: output_write(out, "null", 4); break;
+            case VAL_BOOL: if (argv[i].data.as_bool) output_write(out, "true", 4); else output_write(out, "false", 5); break;
+            case VAL_NUMBER: {
+                int n = number_format(argv[i].data.as_number, tmp);
+                output_write(out, tmp, (size_t)n);
+                break;
+            }
+            case VAL_STRING: output_write(out, argv[i].data.as_string->chars, argv[i].data.as_string->length); break;
+            case VAL_ARRAY:
+            case VAL_MAP:
+            case VAL_OBJECT: {
+                StrBuf b = {0};
+                repr_value(&b, &argv[i], 0);
+                output_write(out, b.data, b.length);
+                mem_free(b.data);
+                break;
+            }
         }
     }
-    printf("\n");
+    output_end_line(out);
     return value_null();
 }
 
-static Value builtin_vhod(int argc, Value* argv) {
-    (void)argv; // unused
+static Value builtin_vhod(Interpreter* in, int argc, Value* argv) {
     if (argc > 0) {
         // optional prompt: print first arg without newline
-        if (argv[0].type == VAL_STRING && argv[0].data.as_string) {
-            fputs(argv[0].data.as_string, stdout);
-            fflush(stdout);
-        }
-    }
-    // Portable line reader
-    size_t capacity = 128;
-    size_t length = 0;
-    char* buffer = (char*)malloc(capacity);
-    if (!buffer) return value_null();
-    int ch;
-    while ((ch = fgetc(stdin)) != EOF) {
-        if (ch == '\n') break;
-        if (length + 1 >= capacity) {
-            capacity *= 2;
-            char* newbuf = (char*)realloc(buffer, capacity);
-            if (!newbuf) { free(buffer); return value_null(); }
-            buffer = newbuf;
+        if (argv[0].type == VAL_STRING) {
+            output_write(in->out, argv[0].data.as_string->chars, argv[0].data.as_string->length);
         }
-        buffer[length++] = (char)ch;
     }
-    if (length == 0 && ch == EOF) { free(buffer); return value_null(); }
-    buffer[length] = '\0';
-    Value v = value_string(buffer);
-    free(buffer);
-    return v;
+    String* line = task_read_line(in);
+    return line ? value_from_string(line) : value_null();
 }
 
-static Value builtin_son(int argc, Value* argv) {
+// vremya(): milliseconds on a monotonic clock, to the nanosecond; only
+// differences between two calls mean anything
+static Value builtin_vremya(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return value_number((double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0);
+}
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Leading blanks are skipped; text that is not a number converts to 0
+static double string_to_number(const char* s, size_t length) {
+    size_t i = 0;
+    while (i < length && is_blank(s[i])) i++;
+    double d = 0;
+    number_parse(s + i, length - i, &d);
+    return d;
+}
+
+static Value builtin_son(Interpreter* in, int argc, Value* argv) {
     // sleep in milliseconds if provided
-    long ms = 0;
+    double ms = 0;
     if (argc >= 1) {
-        if (argv[0].type == VAL_NUMBER) ms = (long)(argv[0].data.as_number);
-        else if (argv[0].type == VAL_STRING && argv[0].data.as_string) ms = strtol(argv[0].data.as_string, NULL, 10);
-    }
-    if (ms > 0) {
-        struct timespec ts;
-        ts.tv_sec = ms / 1000;
-        ts.tv_nsec = (long)(ms % 1000) * 1000000L;
-        nanosleep(&ts, NULL);
+        if (argv[0].type == VAL_NUMBER) ms = argv[0].data.as_number;
+        else if (argv[0].type == VAL_STRING) ms = string_to_number(argv[0].data.as_string->chars, argv[0].data.as_string->length);
     }
+    task_sleep(in, ms);
     return value_null();
 }
 
@@ -97,20 +212,32 @@ static Value to_number(const Value v) {
     switch (v.type) {
         case VAL_NUMBER: return value_number(v.data.as_number);
         case VAL_BOOL: return value_number(v.data.as_bool ? 1 : 0);
-        case VAL_STRING: return value_number(v.data.as_string ? strtod(v.data.as_string, NULL) : 0);
+        case VAL_STRING: return value_number(string_to_number(v.data.as_string->chars, v.data.as_string->length));
         case VAL_NULL: return value_number(0);
+        case VAL_ARRAY: return value_number((double)v.data.as_array->length);
+        case VAL_MAP: return value_number((double)v.data.as_map->count);
+        case VAL_OBJECT: return value_number(0);
     }
     return value_number(0);
 }
 
 static Value to_string(const Value v) {
     switch (v.type) {
-        case VAL_STRING: return value_string(v.data.as_string ? v.data.as_string : "");
+        case VAL_STRING: return value_clone(&v);
         case VAL_NUMBER: {
-            char buf[64]; snprintf(buf, sizeof(buf), "%g", v.data.as_number); return value_string(buf);
+            char buf[NUMBER_FORMAT_MAX]; int n = number_format(v.data.as_number, buf); return value_string_len(buf, (size_t)n);
         }
         case VAL_BOOL: return value_string(v.data.as_bool ? "istina" : "lozh");
         case VAL_NULL: return value_string("NICHTO");
+        case VAL_ARRAY:
+        case VAL_MAP:
+        case VAL_OBJECT: {
+            StrBuf b = {0};
+            repr_value(&b, &v, 0);
+            Value out = value_string_len(b.data, b.length);
+            mem_free(b.data);
+            return out;
+        }
     }
     return value_string("");
 }
@@ -119,18 +246,33 @@ static Value to_bool(const Value v) {
     return value_bool(value_is_truthy(&v));
 }
 
-static int is_equal(Value a, Value b) {
-    if (a.type != b.type) return 0;
-    switch (a.type) {
-        case VAL_NULL: return 1;
-        case VAL_BOOL: return a.data.as_bool == b.data.as_bool;
-        case VAL_NUMBER: return a.data.as_number == b.data.as_number;
+// Text of one concatenation operand. Numbers are formatted into `tmp`
+// (NUMBER_FORMAT_MAX bytes); *owned is set when the text had to be allocated.
+static const char* concat_operand(const Value* v, char* tmp, size_t* len, char** owned) {
+    *owned = NULL;
+    switch (v->type) {
         case VAL_STRING:
-            if (a.data.as_string == NULL && b.data.as_string == NULL) return 1;
-            if (!a.data.as_string || !b.data.as_string) return 0;
-            return strcmp(a.data.as_string, b.data.as_string) == 0;
+            *len = v->data.as_string->length;
+            return v->data.as_string->chars;
+        case VAL_NUMBER:
+            *len = (size_t)number_format(v->data.as_number, tmp);
+            return tmp;
+        case VAL_BOOL:
+            *len = v->data.as_bool ? 4 : 5;
+            return v->data.as_bool ? "true" : "false";
+        case VAL_ARRAY:
+        case VAL_MAP:
+        case VAL_OBJECT: {
+            StrBuf b = {0};
+            repr_value(&b, v, 0);
+            *owned = b.data;
+            *len = b.length;
+            return b.data;
+        }
+        case VAL_NULL: break;
     }
-    return 0;
+    *len = 4;
+    return "null";
 }
 
 static Value eval_binary(int op, Value l, Value r) {
@@ -138,33 +280,15 @@ static Value eval_binary(int op, Value l, Value r) {
         case TOK_PLUS:
             if (l.type == VAL_STRING || r.type == VAL_STRING) {
                 // Convert both sides to strings and concatenate
-                char tmp[64];
-                char *ls, *rs;
-                if (l.type == VAL_STRING) {
-                    ls = l.data.as_string ? hs_strdup(l.data.as_string) : hs_strdup("");
-                } else if (l.type == VAL_NUMBER) {
-                    int n = snprintf(tmp, sizeof(tmp), "%g", l.data.as_number);
-                    ls = (char*)malloc((size_t)n + 1); snprintf(ls, (size_t)n + 1, "%g", l.data.as_number);
-                } else if (l.type == VAL_BOOL) {
-                    ls = hs_strdup(l.data.as_bool ? "true" : "false");
-                } else {
-                    ls = hs_strdup("null");
-                }
-                if (r.type == VAL_STRING) {
-                    rs = r.data.as_string ? hs_strdup(r.data.as_string) : hs_strdup("");
-                } else if (r.type == VAL_NUMBER) {
-                    int n = snprintf(tmp, sizeof(tmp), "%g", r.data.as_number);
-                    rs = (char*)malloc((size_t)n + 1); snprintf(rs, (size_t)n + 1, "%g", r.data.as_number);
-                } else if (r.type == VAL_BOOL) {
-                    rs = hs_strdup(r.data.as_bool ? "true" : "false");
-                } else {
-                    rs = hs_strdup("null");
-                }
-                size_t llen = strlen(ls), rlen = strlen(rs);
-                char* out = (char*)malloc(llen + rlen + 1);
-                memcpy(out, ls, llen); memcpy(out + llen, rs, rlen); out[llen + rlen] = '\0';
-                free(ls); free(rs);
-                Value vv = value_string(out); free(out); return vv;
+                char ltmp[NUMBER_FORMAT_MAX], rtmp[NUMBER_FORMAT_MAX];
+                size_t llen, rlen;
+                char *lown, *rown;
+                const char* ls = concat_operand(&l, ltmp, &llen, &lown);
+                const char* rs = concat_operand(&r, rtmp, &rlen, &rown);
+                String* out = string_alloc(llen + rlen);
+                memcpy(out->chars, ls, llen); memcpy(out->chars + llen, rs, rlen);
+                mem_free(lown); mem_free(rown);
+                return value_from_string(out);
             } else {
                 double v = (l.type == VAL_NUMBER ? l.data.as_number : 0) + (r.type == VAL_NUMBER ? r.data.as_number : 0);
                 return value_number(v);
@@ -177,8 +301,8 @@ static Value eval_binary(int op, Value l, Value r) {
         case TOK_GREATER_EQUAL: return value_bool((l.type==VAL_NUMBER?l.data.as_number:0) >= (r.type==VAL_NUMBER?r.data.as_number:0));
         case TOK_LESS: return value_bool((l.type==VAL_NUMBER?l.data.as_number:0) < (r.type==VAL_NUMBER?r.data.as_number:0));
         case TOK_LESS_EQUAL: return value_bool((l.type==VAL_NUMBER?l.data.as_number:0) <= (r.type==VAL_NUMBER?r.data.as_number:0));
-        case TOK_EQUAL_EQUAL: return value_bool(is_equal(l, r));
-        case TOK_BANG_EQUAL: return value_bool(!is_equal(l, r));
+        case TOK_EQUAL_EQUAL: return value_bool(value_equals(&l, &r));
+        case TOK_BANG_EQUAL: return value_bool(!value_equals(&l, &r));
         case TOK_AND_AND: return value_bool(value_is_truthy(&l) && value_is_truthy(&r));
         case TOK_OR_OR: return value_bool(value_is_truthy(&l) || value_is_truthy(&r));
     }
@@ -193,70 +317,481 @@ static Value eval_unary(int op, Value v) {
     return value_null();
 }
 
+// Array/string index from a number; 0 when the value cannot be an index
+static int to_index(const Value* v, size_t* out) {
+    if (v->type != VAL_NUMBER) return 0;
+    double d = v->data.as_number;
+    if (!(d >= 0 && d < 9007199254740992.0)) return 0;
+    *out = (size_t)d;
+    return 1;
+}
+
+static Array* arg_array(int argc, Value* argv, int i) {
+    return (i < argc && argv[i].type == VAL_ARRAY) ? argv[i].data.as_array : NULL;
+}
+
+static double arg_number(int argc, Value* argv, int i, double fallback) {
+    return (i < argc && argv[i].type == VAL_NUMBER) ? argv[i].data.as_number : fallback;
+}
+
+static Value builtin_massiv(Interpreter* in, int argc, Value* argv) {
+    size_t n = 0;
+    char what[128];
+    if (argc > 0 && argv[0].type == VAL_NUMBER && (!to_index(&argv[0], &n) || n > ARRAY_MAX_LENGTH)) {
+        snprintf(what, sizeof(what), "massiv(%g): the length must be a whole number from 0 to %zu",
+                 argv[0].data.as_number, ARRAY_MAX_LENGTH);
+        budget_halt(in, NULL, what);
+        return value_null();
+    }
+    Array* a = array_try_new(n);
+    if (!a) {
+        snprintf(what, sizeof(what), "massiv(%zu): out of memory", n);
+        budget_halt(in, NULL, what);
+        return value_null();
+    }
+    if (n) {
+        Value fill = argc > 1 ? argv[1] : value_number(0);
+        a->length = n;
+        array_fill(a, &fill);
+    }
+    return value_array(a);
+}
+
+static Value builtin_dlina(int argc, Value* argv) {
+    if (argc < 1) return value_number(0);
+    if (argv[0].type == VAL_ARRAY) return value_number((double)argv[0].data.as_array->length);
+    if (argv[0].type == VAL_MAP) return value_number((double)argv[0].data.as_map->count);
+    if (argv[0].type == VAL_STRING) return value_number((double)argv[0].data.as_string->length);
+    return value_number(0);
+}
+
+static Value builtin_dobavit(int argc, Value* argv) {
+    Array* a = arg_array(argc, argv, 0);
+    if (!a) return value_null();
+    for (int i = 1; i < argc; i++) array_push(a, value_clone(&argv[i]));
+    return value_number((double)a->length);
+}
+
+static Value builtin_extreme(int argc, Value* argv, int want_max) {
+    Array* a = arg_array(argc, argv, 0);
+    double m;
+    if (!a || !(want_max ? array_max(a, &m) : array_min(a, &m))) return value_null();
+    return value_number(m);
+}
+
+static Value builtin_srez(int argc, Value* argv) {
+    if (argc < 1) return value_null();
+    size_t from = 0, to = (size_t)-1;
+    if (argc > 1 && !to_index(&argv[1], &from)) from = 0;
+    if (argc > 2 && !to_index(&argv[2], &to)) to = 0;
+    if (argv[0].type == VAL_ARRAY) return value_array(array_slice(argv[0].data.as_array, from, to));
+    if (argv[0].type == VAL_STRING) {
+        String* str = argv[0].data.as_string;
+        if (to > str->length) to = str->length;
+        if (from > to) from = to;
+        return value_from_string(string_slice(str, from, to - from));
+    }
+    return value_null();
+}
+
+// Splits a line (minus a trailing newline) into fields in place. The
+// separator " " means runs of blanks, as in awk; any other character
+// separates single fields, so "a,,b" has an empty middle field.
+typedef struct {
+    const char* p;
+    const char* end;
+    char sep;
+    bool done;
+} FieldScan;
+
+static void fields_begin(FieldScan* f, int argc, Value* argv, char default_sep) {
+    const String* line = argv[0].data.as_string;
+    f->p = line->chars;
+    f->end = f->p + line->length;
+    while (f->end > f->p && (f->end[-1] == '\n' || f->end[-1] == '\r')) f->end--;
+    f->sep = default_sep;
+    if (argc > 1 && argv[1].type == VAL_STRING && argv[1].data.as_string->length) f->sep = argv[1].data.as_string->chars[0];
+    f->done = f->sep != ' ' && f->p == f->end;
+}
+
+static bool fields_next(FieldScan* f, const char** start, size_t* length) {
+    if (f->done) return false;
+    if (f->sep == ' ') {
+        while (f->p < f->end && is_blank(*f->p)) f->p++;
+        if (f->p == f->end) { f->done = true; return false; }
+        *start = f->p;
+        while (f->p < f->end && !is_blank(*f->p)) f->p++;
+        *length = (size_t)(f->p - *start);
+        return true;
+    }
+    const char* stop = (const char*)memchr(f->p, f->sep, (size_t)(f->end - f->p));
+    if (!stop) { stop = f->end; f->done = true; }
+    *start = f->p;
+    *length = (size_t)(stop - f->p);
+    f->p = stop + (stop < f->end);
+    return true;
+}
+
+// chisla(line, sep?): every field of a delimited line as a number, parsed in
+// place from the string; the separator defaults to ','. Fields that are not
+// numbers become 0, like chislo.
+static Value builtin_chisla(int argc, Value* argv) {
+    Array* out = array_new(0);
+    if (argc < 1 || argv[0].type != VAL_STRING) return value_array(out);
+    FieldScan f;
+    const char* field;
+    size_t length;
+    fields_begin(&f, argc, argv, ',');
+    while (fields_next(&f, &field, &length)) array_push(out, value_number(string_to_number(field, length)));
+    return value_array(out);
+}
+
+// polya(line, sep?): fields of a line as strings; blank-separated by default.
+// Fields of file text are views, not copies.
+static Value builtin_polya(int argc, Value* argv) {
+    Array* out = array_new(0);
+    if (argc < 1 || argv[0].type != VAL_STRING) return value_array(out);
+    FieldScan f;
+    const char* field;
+    size_t length;
+    fields_begin(&f, argc, argv, ' ');
+    String* line = argv[0].data.as_string;
+    while (fields_next(&f, &field, &length))
+        array_push(out, value_from_string(string_slice(line, (size_t)(field - line->chars), length)));
+    return value_array(out);
+}
+
+// fajl(path): the whole file as a string, mapped read-only rather than read
+static Value builtin_fajl(int argc, Value* argv) {
+    if (argc < 1 || argv[0].type != VAL_STRING) return value_null();
+    const String* path = argv[0].data.as_string;
+    char* cpath = (char*)mem_alloc(path->length + 1);
+    memcpy(cpath, path->chars, path->length);
+    cpath[path->length] = '\0';
+    String* text = string_map_file(cpath);
+    mem_free(cpath);
+    return text ? value_from_string(text) : value_null();
+}
+
+// stroki(text): lines without their '\n'; views when text is a file
+static Value builtin_stroki(int argc, Value* argv) {
+    Array* out = array_new(0);
+    if (argc < 1 || argv[0].type != VAL_STRING) return value_array(out);
+    String* text = argv[0].data.as_string;
+    const char* p = text->chars;
+    const char* end = p + text->length;
+    while (p < end) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        const char* stop = nl ? nl : end;
+        array_push(out, value_from_string(string_slice(text, (size_t)(p - text->chars), (size_t)(stop - p))));
+        p = stop + 1;
+    }
+    return value_array(out);
+}
+
+// nayti(text, what, from?): index of the first occurrence of `what` at or
+// after `from`, or -1
+static Value builtin_nayti(int argc, Value* argv) {
+    if (argc < 2 || argv[0].type != VAL_STRING || argv[1].type != VAL_STRING) return value_number(-1);
+    const String* text = argv[0].data.as_string;
+    const String* what = argv[1].data.as_string;
+    size_t from = 0;
+    if (argc > 2 && !to_index(&argv[2], &from)) from = 0;
+    if (from > text->length || what->length > text->length - from) return value_number(-1);
+    if (what->length == 0) return value_number((double)from);
+    const char* p = text->chars + from;
+    const char* last = text->chars + text->length - what->length;
+    while (p <= last) {
+        p = (const char*)memchr(p, what->chars[0], (size_t)(last - p) + 1);
+        if (!p) break;
+        if (memcmp(p, what->chars, what->length) == 0) return value_number((double)(p - text->chars));
+        p++;
+    }
+    return value_number(-1);
+}
+
+static Map* arg_map(int argc, Value* argv, int i) {
+    return (i < argc && argv[i].type == VAL_MAP) ? argv[i].data.as_map : NULL;
+}
+
+// klyuchi/znacheniya: keys or values of a map in insertion order
+static Value map_column(Map* m, int want_values) {
+    Array* out = array_new(m->count);
+    size_t cursor = 0;
+    Value key, item;
+    while (map_next(m, &cursor, &key, &item)) array_push(out, value_clone(want_values ? &item : &key));
+    return value_array(out);
+}
+
+static Value eval_index(Value object, Value index) {
+    if (object.type == VAL_MAP) {
+        Value out;
+        return map_get(object.data.as_map, &index, &out) ? value_clone(&out) : value_null();
+    }
+    size_t i;
+    if (!to_index(&index, &i)) return value_null();
+    if (object.type == VAL_ARRAY) {
+        const Array* a = object.data.as_array;
+        if (i >= a->length) return value_null();
+        Value item = array_peek(a, i);
+        return value_clone(&item);
+    }
+    if (object.type == VAL_STRING) {
+        if (i >= object.data.as_string->length) return value_null();
+        return value_string_len(object.data.as_string->chars + i, 1);
+    }
+    return value_null();
+}
+
+// Pointers are the "&name" strings made by ukazatel, which always own their
+// (NUL-terminated) characters
+static bool is_pointer(const Value* v) {
+    if (v->type != VAL_STRING) return false;
+    const String* s = v->data.as_string;
+    return !string_is_external(s) && s->length > 1 && s->chars[0] == '&';
+}
+
+// Parses a body skipped by the lazy pre-parse on its first call. A body
+// with syntax errors is reported once and then runs as an empty block.
+Stmt* interpret_function_body(FunctionDef* def) {
+    if (!def->body) {
+        int had_error = 0;
+        Stmt* body = parse_function_body(def->lazy_body, def->lazy_line, def->lazy_column, &had_error);
+        if (had_error) {
+            fprintf(stderr, "prikol %s: syntax errors in its body, not run\n", def->name);
+            stmt_free(body);
+            body = stmt_block(NULL);
+        }
+        def->body = body;
+        def->owns_body = true;
+    }
+    return def->body;
+}
+
+// Arguments move into the callee's scope; the caller frees what is left
+static Value call_function(Interpreter* in, FunctionDef* def, int argc, Value* argv) {
+    if (--in->steps_left <= 0 && budget_check(in, def->origin)) return value_null();
+    if (--in->depth_left < 0) {
+        budget_too_deep(in, def->origin);
+        in->depth_left++;
+        return value_null();
+    }
+    MemoCall memo = { NULL, NULL };
+    if (memo_capacity && memo_begin(in, def, argc, argv, &memo)) { in->depth_left++; return value_null(); }
+    Env* local = env_create(in->globals);
+    int n = argc < def->param_count ? argc : def->param_count;
+    for (int i = 0; i < n; i++) { env_set(local, def->params[i], argv[i]); argv[i] = value_null(); }
+    Frame* caller = in->frame;
+    Frame frame = { def->name, 0, caller };
+    if (caller) {
+        // Complete before a profiling signal can find it
+        atomic_signal_fence(memory_order_release);
+        in->frame = &frame;
+    }
+    exec_stmt(in, local, interpret_function_body(def));
+    in->frame = caller;
+    in->depth_left++;
+    env_free(local);
+    if (memo.memo) memo_end(in, &memo);
+    return value_null();
+}
+
+// pamyat(): {"zanyato": bytes on the heap now, "pik": the most so far}
+static Value builtin_pamyat(void) {
+    Map* m = map_new();
+    Value key = value_string("zanyato");
+    map_set(m, &key, value_number((double)mem_in_use()));
+    value_free(&key);
+    key = value_string("pik");
+    map_set(m, &key, value_number((double)mem_peak()));
+    value_free(&key);
+    return value_map(m);
+}
+
+static Value call_builtin(Interpreter* in, Env* env, int id, int argc, Value* argv) {
+    STAT_ADD(builtins[id], 1);
+    switch (id) {
+        case BI_PECHAT: return builtin_pechat(in, argc, argv);
+        case BI_VHOD: return builtin_vhod(in, argc, argv);
+        case BI_SBROS: output_flush(in->out); return value_null();
+        case BI_SON: return builtin_son(in, argc, argv);
+        case BI_VREMYA: return builtin_vremya();
+        case BI_CHISLO: return argc>0 ? to_number(argv[0]) : value_number(0);
+        case BI_STROKA: return argc>0 ? to_string(argv[0]) : value_string("");
+        case BI_LOGIKA: return argc>0 ? to_bool(argv[0]) : value_bool(false);
+        case BI_UKAZATEL:
+            if (argc>0 && argv[0].type==VAL_STRING) {
+                // Pointer as a tagged string: "&name"
+                const String* name = argv[0].data.as_string;
+                String* p = string_alloc(name->length + 1);
+                p->chars[0] = '&'; memcpy(p->chars + 1, name->chars, name->length);
+                return value_from_string(p);
+            }
+            break;
+        case BI_ZNACH:
+            if (argc>0 && is_pointer(&argv[0])) {
+                const char* name = argv[0].data.as_string->chars + 1;
+                Value out; if (env_get(env, name, &out)) return value_clone(&out);
+            }
+            break;
+        case BI_PRISVOIT:
+            if (argc>1 && is_pointer(&argv[0])) {
+                const char* name = argv[0].data.as_string->chars + 1;
+                Value stored = value_clone(&argv[1]);
+                if (!env_assign(env, name, stored)) env_set(env, name, stored);
+                return value_clone(&argv[1]);
+            }
+            break;
+        case BI_MASSIV: return builtin_massiv(in, argc, argv);
+        case BI_DLINA: return builtin_dlina(argc, argv);
+        case BI_DOBAVIT: return builtin_dobavit(argc, argv);
+        case BI_SUMMA: {
+            Array* a = arg_array(argc, argv, 0);
+            return value_number(a ? array_sum(a) : 0);
+        }
+        case BI_MINIMUM: return builtin_extreme(argc, argv, 0);
+        case BI_MAKSIMUM: return builtin_extreme(argc, argv, 1);
+        case BI_UMNOZHIT: {
+            Array* a = arg_array(argc, argv, 0);
+            if (!a) return value_null();
+            array_scale(a, arg_number(argc, argv, 1, 1));
+            return value_null();
+        }
+        case BI_SKALYAR: {
+            Array* a = arg_array(argc, argv, 0);
+            Array* b = arg_array(argc, argv, 1);
+            if (!a || !b) return value_number(0);
+            if (a->length != b->length) {
+                char what[128];
+                snprintf(what, sizeof(what), "skalyar of arrays of different lengths, %zu and %zu", a->length, b->length);
+                budget_halt(in, NULL, what);
+                return value_null();
+            }
+            return value_number(array_dot(a, b));
+        }
+        case BI_ZAPOLNIT: {
+            Array* a = arg_array(argc, argv, 0);
+            if (!a) return value_null();
+            Value fill = argc > 1 ? argv[1] : value_null();
+            array_fill(a, &fill);
+            return value_null();
+        }
+        case BI_SREZ: return builtin_srez(argc, argv);
+        case BI_CHISLA: return builtin_chisla(argc, argv);
+        case BI_POLYA: return builtin_polya(argc, argv);
+        case BI_FAJL: return builtin_fajl(argc, argv);
+        case BI_STROKI: return builtin_stroki(argc, argv);
+        case BI_NAYTI: return builtin_nayti(argc, argv);
+        case BI_SLOVAR: return value_map(map_new());
+        case BI_KLYUCHI:
+        case BI_ZNACHENIYA: {
+            Map* m = arg_map(argc, argv, 0);
+            return m ? map_column(m, id == BI_ZNACHENIYA) : value_null();
+        }
+        case BI_EST: {
+            Map* m = arg_map(argc, argv, 0);
+            return value_bool(m && argc > 1 && map_get(m, &argv[1], NULL));
+        }
+        case BI_UDALIT: {
+            Map* m = arg_map(argc, argv, 0);
+            return value_bool(m && argc > 1 && map_remove(m, &argv[1]));
+        }
+        case BI_POTOK: return builtin_potok(in, argc, argv);
+        case BI_ZHDAT:
+            if (argc > 0 && task_join(in, &argv[0])) return value_null();
+            return builtin_zhdat(argc, argv);
+        case BI_KANAL: return builtin_kanal(argc, argv);
+        case BI_OTPRAVIT: return builtin_otpravit(argc, argv);
+        case BI_POLUCHIT: return builtin_poluchit(argc, argv);
+        case BI_ZAKRYT: return builtin_zakryt(argc, argv);
+        case BI_ZADACHA: return builtin_zadacha(in, argc, argv);
+        case BI_PAMYAT: return builtin_pamyat();
+    }
+    return value_null();
+}
+
+// Every Value returned by eval_expr is owned by the caller, which must
+// value_free it (or hand it on to an owner such as an Env or an Array).
 static Value eval_expr(Interpreter* in, Env* env, Expr* e) {
+    STAT_ADD(exprs[e->type], 1);
     switch (e->type) {
         case EXPR_LITERAL:
             return value_clone(&e->as.literal.value);
         case EXPR_VARIABLE: {
-            Value out; if (!env_get(env, e->as.variable.name, &out)) return value_null(); return out; }
+            Value out; if (!env_get(env, e->as.variable.name, &out)) return value_null(); return value_clone(&out); }
         case EXPR_ASSIGN: {
             Value v = eval_expr(in, env, e->as.assign.value);
-            if (!env_assign(env, e->as.assign.name, v)) {
-                env_set(env, e->as.assign.name, v);
+            Value stored = value_clone(&v);
+            if (!env_assign(env, e->as.assign.name, stored)) {
+                env_set(env, e->as.assign.name, stored);
             }
             return v;
         }
         case EXPR_BINARY: {
             Value l = eval_expr(in, env, e->as.binary.left);
             Value r = eval_expr(in, env, e->as.binary.right);
-            return eval_binary(e->as.binary.op, l, r);
+            Value result = eval_binary(e->as.binary.op, l, r);
+            value_free(&l); value_free(&r);
+            return result;
         }
         case EXPR_UNARY: {
             Value v = eval_expr(in, env, e->as.unary.expr);
-            return eval_unary(e->as.unary.op, v);
+            Value result = eval_unary(e->as.unary.op, v);
+            value_free(&v);
+            return result;
+        }
+        case EXPR_ARRAY: {
+            Array* a = array_new((size_t)e->as.array.count);
+            for (int i = 0; i < e->as.array.count; i++) array_push(a, eval_expr(in, env, e->as.array.items[i]));
+            return value_array(a);
+        }
+        case EXPR_MAP: {
+            Map* m = map_new();
+            for (int i = 0; i < e->as.map.count; i++) {
+                Value key = eval_expr(in, env, e->as.map.keys[i]);
+                map_set(m, &key, eval_expr(in, env, e->as.map.values[i]));
+                value_free(&key);
+            }
+            return value_map(m);
+        }
+        case EXPR_INDEX: {
+            Value object = eval_expr(in, env, e->as.index.object);
+            Value index = eval_expr(in, env, e->as.index.index);
+            Value result = eval_index(object, index);
+            value_free(&object); value_free(&index);
+            return result;
+        }
+        case EXPR_INDEX_ASSIGN: {
+            // Arrays and maps are shared by reference, so storing through the
+            // evaluated object updates every variable that holds the same one.
+            Value object = eval_expr(in, env, e->as.index_assign.object);
+            Value index = eval_expr(in, env, e->as.index_assign.index);
+            Value v = eval_expr(in, env, e->as.index_assign.value);
+            size_t i;
+            if (object.type == VAL_MAP) map_set(object.data.as_map, &index, value_clone(&v));
+            else if (object.type == VAL_ARRAY && to_index(&index, &i) && !array_set(object.data.as_array, i, value_clone(&v))) {
+                char what[128];
+                snprintf(what, sizeof(what), "array index %zu is too far past the end of an array of length %zu",
+                         i, object.data.as_array->length);
+                budget_halt(in, NULL, what);
+            }
+            value_free(&object); value_free(&index);
+            return v;
         }
         case EXPR_CALL: {
             int argc = e->as.call.arg_count;
-            Value* argv = (Value*)malloc(sizeof(Value) * argc);
+            Value* argv = (Value*)mem_alloc(sizeof(Value) * argc);
             for (int i = 0; i < argc; i++) argv[i] = eval_expr(in, env, e->as.call.args[i]);
             Value result = value_null();
-            if (strcmp(e->as.call.callee, "pechat") == 0) result = builtin_pechat(argc, argv);
-            else if (strcmp(e->as.call.callee, "vhod") == 0) result = builtin_vhod(argc, argv);
-            else if (strcmp(e->as.call.callee, "son") == 0) result = builtin_son(argc, argv);
-            else if (strcmp(e->as.call.callee, "chislo") == 0) result = argc>0 ? to_number(argv[0]) : value_number(0);
-            else if (strcmp(e->as.call.callee, "stroka") == 0) result = argc>0 ? to_string(argv[0]) : value_string("");
-            else if (strcmp(e->as.call.callee, "logika") == 0) result = argc>0 ? to_bool(argv[0]) : value_bool(false);
-            else if (strcmp(e->as.call.callee, "ukazatel") == 0) {
-                if (argc>0 && argv[0].type==VAL_STRING && argv[0].data.as_string) {
-                    // Pointer as a tagged string: "&name"
-                    size_t len = strlen(argv[0].data.as_string);
-                    char* p = (char*)malloc(len + 2);
-                    p[0] = '&'; memcpy(p+1, argv[0].data.as_string, len+1);
-                    result = value_string(p); free(p);
-                }
-            } else if (strcmp(e->as.call.callee, "znach") == 0) {
-                if (argc>0 && argv[0].type==VAL_STRING && argv[0].data.as_string && argv[0].data.as_string[0]=='&') {
-                    const char* name = argv[0].data.as_string + 1;
-                    Value out; if (env_get(env, name, &out)) result = out; else result = value_null();
-                }
-            } else if (strcmp(e->as.call.callee, "prisvoit") == 0) {
-                if (argc>1 && argv[0].type==VAL_STRING && argv[0].data.as_string && argv[0].data.as_string[0]=='&') {
-                    const char* name = argv[0].data.as_string + 1;
-                    if (!env_assign(env, name, argv[1])) env_set(env, name, argv[1]);
-                    result = argv[1];
-                }
-            } else {
+            // Nothing more is called once an argument has halted the program
+            if (!in->halted && e->as.call.builtin != BI_NONE) {
+                result = call_builtin(in, env, e->as.call.builtin, argc, argv);
+            } else if (!in->halted) {
                 FunctionDef* def = funcs_lookup(&in->functions, e->as.call.callee);
-                if (def) {
-                    Env* local = env_create(in->globals);
-                    int n = argc < def->param_count ? argc : def->param_count;
-                    for (int i = 0; i < n; i++) env_set(local, def->params[i], argv[i]);
-                    exec_stmt(in, local, def->body);
-                    env_free(local);
-                    result = value_null();
-                }
+                if (def) result = call_function(in, def, argc, argv);
             }
-            free(argv);
+            for (int i = 0; i < argc; i++) value_free(&argv[i]);
+            mem_free(argv);
             return result;
         }
     }
@@ -266,15 +801,21 @@ static Value eval_expr(Interpreter* in, Env* env, Expr* e) {
 static void exec_stmt_list(Interpreter* in, Env* env, StmtList* list) {
     for (StmtList* it = list; it; it = it->next) {
         exec_stmt(in, env, it->stmt);
-        if (in->signaled_break || in->signaled_continue) return;
+        if (in->signaled_break || in->signaled_continue || in->halted) return;
     }
 }
 
 static void exec_stmt(Interpreter* in, Env* env, Stmt* s) {
+    // While profiling, the frame shows which statement runs (see profile.h)
+    Frame* frame = in->frame;
+    int outer = 0;
+    if (frame) { outer = frame->line; frame->line = s->line; }
+    STAT_ADD(stmts[s->type], 1);
     switch (s->type) {
         case STMT_EXPR: {
-            Value v = eval_expr(in, env, s->as.expr.expr); (void)v; break; }
+            Value v = eval_expr(in, env, s->as.expr.expr); value_free(&v); break; }
         case STMT_BLOCK: {
+            STAT_ADD(block_envs, 1);
             Env* local = env_create(env);
             exec_stmt_list(in, local, s->as.block.statements);
             env_free(local);
@@ -282,50 +823,202 @@ static void exec_stmt(Interpreter* in, Env* env, Stmt* s) {
         }
         case STMT_IF: {
             Value cond = eval_expr(in, env, s->as.ifstmt.condition);
-            if (value_is_truthy(&cond)) exec_stmt(in, env, s->as.ifstmt.then_branch);
+            int truthy = value_is_truthy(&cond);
+            value_free(&cond);
+            if (truthy) exec_stmt(in, env, s->as.ifstmt.then_branch);
             else if (s->as.ifstmt.else_branch) exec_stmt(in, env, s->as.ifstmt.else_branch);
             break;
         }
         case STMT_WHILE: {
             while (1) {
                 Value cond = eval_expr(in, env, s->as.whilestmt.condition);
-                if (!value_is_truthy(&cond)) break;
+                int truthy = value_is_truthy(&cond);
+                value_free(&cond);
+                if (!truthy) break;
                 in->signaled_continue = 0;
                 exec_stmt(in, env, s->as.whilestmt.body);
                 if (in->signaled_break) { in->signaled_break = 0; break; }
+                if (--in->steps_left <= 0 && budget_check(in, s)) break;
             }
             break;
         }
         case STMT_FOR: {
+            if (s->as.forstmt.parallel) { parallel_for(in, env, &s->as.forstmt); break; }
+            STAT_ADD(loop_envs, 1);
             Env* local = env_create(env);
             if (s->as.forstmt.init) exec_stmt(in, local, s->as.forstmt.init);
             while (1) {
                 if (s->as.forstmt.condition) {
                     Value c = eval_expr(in, local, s->as.forstmt.condition);
-                    if (!value_is_truthy(&c)) break;
+                    int truthy = value_is_truthy(&c);
+                    value_free(&c);
+                    if (!truthy) break;
                 }
                 in->signaled_continue = 0;
                 exec_stmt(in, local, s->as.forstmt.body);
                 if (in->signaled_break) { in->signaled_break = 0; break; }
-                if (s->as.forstmt.increment) { Value inc = eval_expr(in, local, s->as.forstmt.increment); (void)inc; }
+                if (--in->steps_left <= 0 && budget_check(in, s)) break;
+                if (s->as.forstmt.increment) { Value inc = eval_expr(in, local, s->as.forstmt.increment); value_free(&inc); }
             }
             env_free(local);
             break;
         }
         case STMT_FUNC: {
-            funcs_register(&in->functions, s->as.func.name, s->as.func.params, s->as.func.param_count, s->as.func.body);
-            s->as.func.params = NULL; s->as.func.param_count = 0; s->as.func.body = NULL;
+            // The definition borrows from the AST, which stays untouched so
+            // the program can run again, or in other interpreters at once.
+            // Running the same prikol statement again changes nothing.
+            FunctionDef* def = funcs_lookup(&in->functions, s->as.func.name);
+            if (def && def->origin == s) break;
+            def = funcs_register(&in->functions, s->as.func.name, s->as.func.params, s->as.func.param_count, s->as.func.body);
+            def->origin = s;
+            def->lazy_body = s->as.func.lazy_body;
+            def->lazy_line = s->as.func.lazy_line;
+            def->lazy_column = s->as.func.lazy_column;
             break;
         }
         case STMT_BREAK:
             in->signaled_break = 1; break;
         case STMT_CONTINUE:
             in->signaled_continue = 1; break;
+        case STMT_SECTION:
+        case STMT_IMPORT:
+            break; // top level only, run by interpret()
+    }
+    if (frame) frame->line = outer;
+}
+
+static void set_global(Interpreter* in, const char* name, Value v) {
+    if (!env_assign(in->globals, name, v)) env_set(in->globals, name, v);
+}
+
+static bool define_list(Interpreter* in, StmtList* list, const char* dir);
+
+// Registers the prikols of a module, once per interpreter however many
+// times it is imported; a file changed since is a new module. False when
+// it cannot be read or does not parse.
+static bool import_module(Interpreter* in, const char* dir, const char* path) {
+    const Module* m = module_load(dir, path);
+    if (!m) return false;
+    for (int i = 0; i < in->imported_count; i++)
+        if (in->imported[i] == m) return true;
+    in->imported = (const Module**)mem_realloc(in->imported, sizeof(Module*) * (size_t)(in->imported_count + 1));
+    in->imported[in->imported_count++] = m;
+    return define_list(in, module_program(m), module_dir(m));
+}
+
+// In order, so a later definition of a name wins, imported or not
+static bool define_list(Interpreter* in, StmtList* list, const char* dir) {
+    for (StmtList* it = list; it; it = it->next) {
+        if (it->stmt->type == STMT_FUNC) exec_stmt(in, in->globals, it->stmt);
+        else if (it->stmt->type == STMT_IMPORT && !import_module(in, dir, it->stmt->as.import.path)) return false;
+    }
+    return true;
+}
+
+// Top-level prikol definitions, the program's own and those of the
+// modules it imports, are registered before anything runs, so sections
+// and records can call functions defined anywhere
+static bool define_functions(Interpreter* in, StmtList* program) {
+    in->program = program;
+    return define_list(in, program, in->dir);
+}
+
+// Section bodies run directly in the global scope so that nachalo can set
+// up the variables the main statements and konec use
+static void run_sections(Interpreter* in, StmtList* program, SectionKind kind) {
+    for (StmtList* it = program; it; it = it->next) {
+        Stmt* s = it->stmt;
+        if (in->halted) return;
+        if (s->type != STMT_SECTION || s->as.section.kind != kind) continue;
+        exec_stmt_list(in, in->globals, s->as.section.body->as.block.statements);
+        in->signaled_break = in->signaled_continue = 0;
+    }
+}
+
+// Main statements; false when a top-level slomat/prodolzhit cut them short
+static bool run_main(Interpreter* in, StmtList* program) {
+    for (StmtList* it = program; it; it = it->next) {
+        StmtType type = it->stmt->type;
+        if (type == STMT_FUNC || type == STMT_SECTION || type == STMT_IMPORT) continue;
+        exec_stmt(in, in->globals, it->stmt);
+        if (in->signaled_break || in->signaled_continue || in->halted) return false;
     }
+    return true;
+}
+
+// Tasks share the globals, so konec runs once they are done. Threads
+// share nothing and are waited for last, before a forked server child or
+// an embedding program goes on.
+static void finish_program(Interpreter* in, StmtList* program) {
+    tasks_finish(in);
+    run_sections(in, program, SECTION_END);
+    tasks_finish(in);
+    threads_join(&in->threads);
+}
+
+bool interpret_define(Interpreter* in, StmtList* program) {
+    return define_functions(in, program);
 }
 
-void interpret(Interpreter* in, StmtList* program) {
-    exec_stmt_list(in, in->globals, program);
+bool interpret_start(Interpreter* in, StmtList* program) {
+    if (!define_functions(in, program)) return false;
+    run_sections(in, program, SECTION_BEGIN);
+    return true;
 }
 
+void interpret_finish(Interpreter* in, StmtList* program) {
+    in->program = program;
+    run_main(in, program);
+    in->signaled_break = in->signaled_continue = 0;
+    finish_program(in, program);
+}
+
+void interpret_records_finish(Interpreter* in, StmtList* program, bool print_record) {
+    in->program = program;
+    double number = 0;
+    String* line;
+    while ((line = input_read_line(in->input))) {
+        set_global(in, "zapis", value_from_string(line));
+        set_global(in, "nomer", value_number(++number));
+        bool done = run_main(in, program);
+        if (in->signaled_break || in->halted) break;
+        in->signaled_continue = 0;
+        if (done && print_record) {
+            Value record;
+            if (env_get(in->globals, "zapis", &record)) builtin_pechat(in, 1, &record);
+        }
+    }
+    in->signaled_break = in->signaled_continue = 0;
+    finish_program(in, program);
+}
 
+bool interpret(Interpreter* in, StmtList* program) {
+    if (!interpret_start(in, program)) return false;
+    interpret_finish(in, program);
+    return true;
+}
+
+bool interpret_records(Interpreter* in, StmtList* program, bool print_record) {
+    if (!interpret_start(in, program)) return false;
+    interpret_records_finish(in, program, print_record);
+    return true;
+}
+
+Value interpret_eval(Interpreter* in, Env* env, Expr* e) {
+    return eval_expr(in, env, e);
+}
+
+void interpret_exec(Interpreter* in, Env* env, Stmt* s) {
+    exec_stmt(in, env, s);
+}
+
+bool interpret_call(Interpreter* in, const char* name, int argc, Value* argv) {
+    FunctionDef* def = funcs_lookup(&in->functions, name);
+    if (def) {
+        Value result = call_function(in, def, argc, argv);
+        value_free(&result);
+        in->signaled_break = in->signaled_continue = 0;
+    }
+    for (int i = 0; i < argc; i++) value_free(&argv[i]);
+    return def != NULL;
+}
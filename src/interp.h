@@ -1,20 +1,82 @@
 #ifndef HYPESCRIPT_INTERP_H
 #define HYPESCRIPT_INTERP_H
 
+#include <stdint.h>
+
 #include "ast.h"
 #include "env.h"
+#include "output.h"
+#include "input.h"
+
+// A prikol call in progress, linked through the C stack from the
+// innermost call outwards. Kept only while profiling; Interpreter.frame is
+// NULL otherwise.
+typedef struct Frame {
+    const char* name;
+    volatile int line; // of the statement it is running
+    struct Frame* parent;
+} Frame;
 
 typedef struct {
     Env* globals;
     int signaled_break;
     int signaled_continue;
     Functions functions;
+    Output* out; // where pechat writes; output_stdout() by default
+    Input* input; // where vhod reads; input_stdin() by default
+    StmtList* program; // the program being run, for potok to start threads on
+    struct Thread* threads; // started by potok, joined by interpreter_free
+    bool worker; // runs iterations of dlya parallelno, so nested ones run here
+    struct Scheduler* scheduler; // zadacha tasks, created with the first one
+    Frame* volatile frame; // innermost call, for the profiler (profile.h)
+    const char* dir; // podklyuchit paths are relative to it; NULL: the working directory
+    const struct Module** imported; // modules whose prikols are registered here
+    int imported_count;
+    // Limits (budget.h)
+    int64_t steps_left; // loop iterations and calls until budget_check
+    int64_t step_chunk; // what steps_left was last set to
+    uint64_t steps;     // taken before that
+    int depth_left;     // how much deeper calls may still nest
+    bool halted;        // a limit was hit: loops and calls unwind
 } Interpreter;
 
-void interpreter_init(Interpreter* in);
+void interpreter_init(Interpreter* in); // on the process-wide stdin/stdout
+// Interpreters with their own input and output share no mutable state, so
+// several can run one program on different threads
+void interpreter_init_io(Interpreter* in, Output* out, Input* input);
 void interpreter_free(Interpreter* in);
 
-void interpret(Interpreter* in, StmtList* program);
+// Runs a program: top-level prikol definitions first, then nachalo
+// sections, the main statements and konec sections. False, with nothing
+// run, when a podklyuchit fails (the message is on stderr).
+bool interpret(Interpreter* in, StmtList* program);
+// Same, but the main statements run once per line of in->input with the
+// line in `zapis` and its 1-based number in `nomer`. A top-level prodolzhit
+// skips to the next record, slomat stops reading. With print_record the
+// (possibly modified) zapis is printed after each record.
+bool interpret_records(Interpreter* in, StmtList* program, bool print_record);
+
+// The two halves of the above, so the state between them can be saved and
+// restored (see snapshot.h): start registers the functions and runs the
+// nachalo sections, finish runs everything after that. start is false when
+// a podklyuchit fails, before any section runs.
+bool interpret_start(Interpreter* in, StmtList* program);
+// Only the first step of interpret_start: registers the top-level prikol
+// definitions. interpret() on the same interpreter then skips them.
+bool interpret_define(Interpreter* in, StmtList* program);
+void interpret_finish(Interpreter* in, StmtList* program);
+void interpret_records_finish(Interpreter* in, StmtList* program, bool print_record);
+
+// One expression or statement in env; the building blocks of parallel.c
+Value interpret_eval(Interpreter* in, Env* env, Expr* e);
+void interpret_exec(Interpreter* in, Env* env, Stmt* s);
+
+// The body of def, parsing it first if the lazy pre-parse skipped it
+Stmt* interpret_function_body(FunctionDef* def);
+
+// Calls the prikol `name` with argv, whose values it takes over; false
+// when no such function is defined
+bool interpret_call(Interpreter* in, const char* name, int argc, Value* argv);
 
 #endif
 
@@ -3,6 +3,8 @@
 #include <ctype.h>
 
 #include "lexer.h"
+#include "number.h"
+#include "mem.h"
 
 static Token make_token(Lexer* l, TokenType type, const char* start, size_t length) {
     Token t;
@@ -11,8 +13,9 @@ static Token make_token(Lexer* l, TokenType type, const char* start, size_t leng
     t.number = 0.0;
     t.line = l->line;
     t.column = l->column;
+    t.start = start;
     if (type == TOK_IDENTIFIER || type == TOK_STRING) {
-        t.lexeme = (char*)malloc(length + 1);
+        t.lexeme = (char*)mem_alloc(length + 1);
         memcpy(t.lexeme, start, length);
         t.lexeme[length] = '\0';
     }
@@ -72,10 +75,14 @@ static TokenType identifier_type(const char* start, size_t length) {
 }
 
 void lexer_init(Lexer* lexer, const char* source) {
+    lexer_init_at(lexer, source, 1, 1);
+}
+
+void lexer_init_at(Lexer* lexer, const char* source, int line, int column) {
     lexer->source = source;
     lexer->current = source;
-    lexer->line = 1;
-    lexer->column = 1;
+    lexer->line = line;
+    lexer->column = column;
 }
 
 static Token string(Lexer* l) {
@@ -103,8 +110,19 @@ static Token number(Lexer* l) {
         l->current++; l->column++;
         while (isdigit(*l->current)) { l->current++; l->column++; }
     }
+    // Exponent: 1e21, 2.5e-3
+    const char* e = l->current;
+    if (*e == 'e' || *e == 'E') {
+        e++;
+        if (*e == '+' || *e == '-') e++;
+        if (isdigit(*e)) {
+            while (isdigit(*e)) e++;
+            l->column += (int)(e - l->current);
+            l->current = e;
+        }
+    }
     Token t = make_token(l, TOK_NUMBER, start, (size_t)(l->current - start));
-    t.number = strtod(start, NULL);
+    number_parse(start, (size_t)(l->current - start), &t.number);
     t.column = col;
     return t;
 }
@@ -120,54 +138,69 @@ static Token identifier_or_hype(Lexer* l) {
     return t;
 }
 
-static Token symbol(Lexer* l) {
+static Token symbol_token(Lexer* l) {
     char c = *l->current++;
     l->column++;
     switch (c) {
-        case '(': return make_token(l, TOK_LPAREN, &c, 1);
-        case ')': return make_token(l, TOK_RPAREN, &c, 1);
-        case '{': return make_token(l, TOK_LBRACE, &c, 1);
-        case '}': return make_token(l, TOK_RBRACE, &c, 1);
-        case ',': return make_token(l, TOK_COMMA, &c, 1);
-        case '.': return make_token(l, TOK_DOT, &c, 1);
-        case ';': return make_token(l, TOK_SEMICOLON, &c, 1);
-        case '+': return make_token(l, TOK_PLUS, &c, 1);
-        case '-': return make_token(l, TOK_MINUS, &c, 1);
-        case '*': return make_token(l, TOK_STAR, &c, 1);
-        case '%': return make_token(l, TOK_PERCENT, &c, 1);
+        case '(': return make_token(l, TOK_LPAREN, l->current - 1, 1);
+        case ')': return make_token(l, TOK_RPAREN, l->current - 1, 1);
+        case '{': return make_token(l, TOK_LBRACE, l->current - 1, 1);
+        case '}': return make_token(l, TOK_RBRACE, l->current - 1, 1);
+        case '[': return make_token(l, TOK_LBRACKET, l->current - 1, 1);
+        case ']': return make_token(l, TOK_RBRACKET, l->current - 1, 1);
+        case ',': return make_token(l, TOK_COMMA, l->current - 1, 1);
+        case ':': return make_token(l, TOK_COLON, l->current - 1, 1);
+        case '.': return make_token(l, TOK_DOT, l->current - 1, 1);
+        case ';': return make_token(l, TOK_SEMICOLON, l->current - 1, 1);
+        case '+': return make_token(l, TOK_PLUS, l->current - 1, 1);
+        case '-': return make_token(l, TOK_MINUS, l->current - 1, 1);
+        case '*': return make_token(l, TOK_STAR, l->current - 1, 1);
+        case '%': return make_token(l, TOK_PERCENT, l->current - 1, 1);
         case '!':
-            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_BANG_EQUAL, "!=", 2);} 
-            return make_token(l, TOK_BANG, &c, 1);
+            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_BANG_EQUAL, l->current - 2, 2);} 
+            return make_token(l, TOK_BANG, l->current - 1, 1);
         case '=':
-            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_EQUAL_EQUAL, "==", 2);} 
-            return make_token(l, TOK_EQUAL, &c, 1);
+            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_EQUAL_EQUAL, l->current - 2, 2);} 
+            return make_token(l, TOK_EQUAL, l->current - 1, 1);
         case '>':
-            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_GREATER_EQUAL, ">=", 2);} 
-            return make_token(l, TOK_GREATER, &c, 1);
+            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_GREATER_EQUAL, l->current - 2, 2);} 
+            return make_token(l, TOK_GREATER, l->current - 1, 1);
         case '<':
-            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_LESS_EQUAL, "<=", 2);} 
-            return make_token(l, TOK_LESS, &c, 1);
+            if (*l->current == '=') { l->current++; l->column++; return make_token(l, TOK_LESS_EQUAL, l->current - 2, 2);} 
+            return make_token(l, TOK_LESS, l->current - 1, 1);
         case '&':
-            if (*l->current == '&') { l->current++; l->column++; return make_token(l, TOK_AND_AND, "&&", 2);} 
+            if (*l->current == '&') { l->current++; l->column++; return make_token(l, TOK_AND_AND, l->current - 2, 2);} 
             break;
         case '|':
-            if (*l->current == '|') { l->current++; l->column++; return make_token(l, TOK_OR_OR, "||", 2);} 
+            if (*l->current == '|') { l->current++; l->column++; return make_token(l, TOK_OR_OR, l->current - 2, 2);} 
             break;
         case '"':
             // current points to the char after '"' right now, but our string()
             // expects to start at the first character inside quotes.
             // We already advanced past '"' above, so just parse.
             return string(l);
-        case '/': return make_token(l, TOK_SLASH, &c, 1);
+        case '/': return make_token(l, TOK_SLASH, l->current - 1, 1);
     }
-    Token t = make_token(l, TOK_ERROR, &c, 1);
+    Token t = make_token(l, TOK_ERROR, l->current - 1, 1);
+    return t;
+}
+
+// A token starts where its first character is, quote included, so that
+// lexing can resume at any token (see lexer_init_at)
+static Token symbol(Lexer* l) {
+    const char* start = l->current;
+    int line = l->line, col = l->column;
+    Token t = symbol_token(l);
+    t.start = start;
+    t.line = line;
+    t.column = col;
     return t;
 }
 
 Token lexer_next(Lexer* l) {
     skip_whitespace_and_comments(l);
     if (!*l->current) {
-        Token t; t.type = TOK_EOF; t.lexeme = NULL; t.number = 0; t.line = l->line; t.column = l->column; return t;
+        Token t; t.type = TOK_EOF; t.lexeme = NULL; t.number = 0; t.line = l->line; t.column = l->column; t.start = l->current; return t;
     }
 
     // Special !HYPE! marker
@@ -185,7 +218,7 @@ Token lexer_next(Lexer* l) {
 
 void token_free(Token* token) {
     if (!token) return;
-    if (token->lexeme) { free(token->lexeme); token->lexeme = NULL; }
+    if (token->lexeme) { mem_free(token->lexeme); token->lexeme = NULL; }
 }
 
 
@@ -11,6 +11,8 @@ typedef struct {
 } Lexer;
 
 void lexer_init(Lexer* lexer, const char* source);
+// Starts at `source` as if it were at line:column of a larger text
+void lexer_init_at(Lexer* lexer, const char* source, int line, int column);
 Token lexer_next(Lexer* lexer);
 void token_free(Token* token);
 
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hypescript.h"
+#include "parser.h"
+#include "interp.h"
+#include "array.h"
+#include "map.h"
+#include "mem.h"
+
+struct HsProgram {
+    StmtList* statements;
+};
+
+struct HsInterpreter {
+    Interpreter interp;
+    Output out;
+    Input input;
+};
+
+struct HsValue {
+    Value value;
+};
+
+static HsValue* wrap(Value v) {
+    HsValue* out = (HsValue*)mem_alloc(sizeof(HsValue));
+    out->value = v;
+    return out;
+}
+
+HsProgram* hs_compile(const char* source, size_t length) {
+    // The lexer works on a NUL-terminated copy; with every body parsed now
+    // the AST keeps no pointers into it
+    char* text = (char*)mem_alloc(length + 1);
+    memcpy(text, source, length);
+    text[length] = '\0';
+    Parser p; parser_init(&p, text);
+    p.lazy = false;
+    StmtList* statements = parse_program(&p);
+    mem_free(text);
+    if (p.had_error) { stmt_list_free(statements); return NULL; }
+    HsProgram* program = (HsProgram*)mem_alloc(sizeof(HsProgram));
+    program->statements = statements;
+    return program;
+}
+
+void hs_program_free(HsProgram* program) {
+    if (!program) return;
+    stmt_list_free(program->statements);
+    mem_free(program);
+}
+
+HsInterpreter* hs_interpreter_new(int input_fd, int output_fd) {
+    HsInterpreter* in = (HsInterpreter*)mem_alloc(sizeof(HsInterpreter));
+    output_init(&in->out, output_fd, OUTPUT_BLOCK, OUTPUT_DEFAULT_BLOCK);
+    if (output_fd < 0) in->out.failed = true;
+    input_init(&in->input, input_fd, INPUT_DEFAULT_BLOCK);
+    if (input_fd < 0) in->input.eof = true;
+    interpreter_init_io(&in->interp, &in->out, &in->input);
+    return in;
+}
+
+void hs_interpreter_free(HsInterpreter* in) {
+    if (!in) return;
+    interpreter_free(&in->interp);
+    output_free(&in->out);
+    input_free(&in->input);
+    mem_free(in);
+}
+
+bool hs_run(HsInterpreter* in, const HsProgram* program) {
+    bool ran = interpret(&in->interp, program->statements);
+    output_flush(&in->out);
+    return ran;
+}
+
+void hs_set(HsInterpreter* in, const char* name, HsValue* value) {
+    Env* globals = in->interp.globals;
+    if (!env_assign(globals, name, value->value)) env_set(globals, name, value->value);
+    mem_free(value);
+}
+
+HsValue* hs_get(HsInterpreter* in, const char* name) {
+    Value v;
+    if (!env_get(in->interp.globals, name, &v)) return NULL;
+    return wrap(value_clone(&v));
+}
+
+HsValue* hs_null(void) { return wrap(value_null()); }
+HsValue* hs_bool(bool b) { return wrap(value_bool(b)); }
+HsValue* hs_number(double n) { return wrap(value_number(n)); }
+HsValue* hs_string(const char* s, size_t length) { return wrap(value_string_len(s, length)); }
+HsValue* hs_array(void) { return wrap(value_array(array_new(0))); }
+HsValue* hs_map(void) { return wrap(value_map(map_new())); }
+
+void hs_value_free(HsValue* v) {
+    if (!v) return;
+    value_free(&v->value);
+    mem_free(v);
+}
+
+HsType hs_type(const HsValue* v) {
+    switch (v->value.type) {
+        case VAL_BOOL: return HS_BOOL;
+        case VAL_NUMBER: return HS_NUMBER;
+        case VAL_STRING: return HS_STRING;
+        case VAL_ARRAY: return HS_ARRAY;
+        case VAL_MAP: return HS_MAP;
+        case VAL_OBJECT: return HS_OBJECT;
+        default: return HS_NULL;
+    }
+}
+
+bool hs_as_bool(const HsValue* v) { return value_is_truthy(&v->value); }
+
+double hs_as_number(const HsValue* v) {
+    return v->value.type == VAL_NUMBER ? v->value.data.as_number : 0;
+}
+
+const char* hs_as_string(const HsValue* v, size_t* length) {
+    if (v->value.type != VAL_STRING) return NULL;
+    if (length) *length = v->value.data.as_string->length;
+    return v->value.data.as_string->chars;
+}
+
+size_t hs_length(const HsValue* v) {
+    switch (v->value.type) {
+        case VAL_STRING: return v->value.data.as_string->length;
+        case VAL_ARRAY: return v->value.data.as_array->length;
+        case VAL_MAP: return v->value.data.as_map->count;
+        default: return 0;
+    }
+}
+
+void hs_array_push(HsValue* array, HsValue* item) {
+    if (array->value.type == VAL_ARRAY) array_push(array->value.data.as_array, item->value);
+    else value_free(&item->value);
+    mem_free(item);
+}
+
+HsValue* hs_array_get(const HsValue* array, size_t index) {
+    if (array->value.type != VAL_ARRAY || index >= array->value.data.as_array->length) return NULL;
+    Value item = array_peek(array->value.data.as_array, index);
+    return wrap(value_clone(&item));
+}
+
+bool hs_map_set(HsValue* map, const HsValue* key, HsValue* value) {
+    Value v = value->value;
+    mem_free(value);
+    if (map->value.type != VAL_MAP || !map_key_ok(&key->value)) { value_free(&v); return false; }
+    return map_set(map->value.data.as_map, &key->value, v);
+}
+
+HsValue* hs_map_get(const HsValue* map, const HsValue* key) {
+    Value v;
+    if (map->value.type != VAL_MAP || !map_get(map->value.data.as_map, &key->value, &v)) return NULL;
+    return wrap(value_clone(&v));
+}
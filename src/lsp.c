@@ -0,0 +1,409 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsp.h"
+#include "document.h"
+#include "mem.h"
+
+// An open file, by the URI the client names it with
+typedef struct Open {
+    char* uri;
+    Document* doc;
+    struct Open* next;
+} Open;
+
+typedef struct {
+    char* data;
+    size_t length, capacity;
+} Buffer;
+
+static void put(Buffer* b, const char* s, size_t n) {
+    if (b->length + n > b->capacity) {
+        b->capacity = (b->length + n) * 2;
+        b->data = (char*)mem_realloc(b->data, b->capacity);
+    }
+    memcpy(b->data + b->length, s, n);
+    b->length += n;
+}
+
+static void put_str(Buffer* b, const char* s) {
+    put(b, s, strlen(s));
+}
+
+static void put_int(Buffer* b, long n) {
+    char digits[32];
+    put(b, digits, (size_t)snprintf(digits, sizeof(digits), "%ld", n));
+}
+
+static void put_json_string(Buffer* b, const char* s) {
+    put(b, "\"", 1);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { put(b, "\\", 1); put(b, s, 1); }
+        else if (c == '\n') put_str(b, "\\n");
+        else if (c < 0x20) { char esc[8]; put(b, esc, (size_t)snprintf(esc, sizeof(esc), "\\u%04x", c)); }
+        else put(b, s, 1);
+    }
+    put(b, "\"", 1);
+}
+
+static void send(Buffer* b) {
+    printf("Content-Length: %zu\r\n\r\n", b->length);
+    fwrite(b->data, 1, b->length, stdout);
+    fflush(stdout);
+    b->length = 0;
+}
+
+// Messages are scanned in place: a value is a pointer to its first
+// character, found by key and skipped over without building a tree
+
+static const char* skip_space(const char* s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+    return s;
+}
+
+// Past the closing quote of the string at s, NULL if unterminated
+static const char* skip_string(const char* s) {
+    for (s++; *s != '"'; s++) {
+        if (!*s) return NULL;
+        if (*s == '\\' && !*++s) return NULL;
+    }
+    return s + 1;
+}
+
+static const char* skip_value(const char* s) {
+    s = skip_space(s);
+    if (*s == '"') return skip_string(s);
+    if (*s == '{' || *s == '[') {
+        int depth = 0;
+        do {
+            if (*s == '"') {
+                if (!(s = skip_string(s))) return NULL;
+                continue;
+            }
+            if (*s == '{' || *s == '[') depth++;
+            else if (*s == '}' || *s == ']') depth--;
+            else if (!*s) return NULL;
+            s++;
+        } while (depth > 0);
+        return s;
+    }
+    const char* start = s;
+    while (*s && !strchr(",}] \t\r\n", *s)) s++;
+    return s == start ? NULL : s;
+}
+
+// The value of key in the object at s, NULL if it has none
+static const char* member(const char* s, const char* key) {
+    if (!s) return NULL;
+    s = skip_space(s);
+    if (*s != '{') return NULL;
+    s = skip_space(s + 1);
+    size_t n = strlen(key);
+    while (*s == '"') {
+        const char* end = skip_string(s);
+        if (!end) return NULL;
+        bool found = (size_t)(end - s) == n + 2 && memcmp(s + 1, key, n) == 0;
+        s = skip_space(end);
+        if (*s != ':') return NULL;
+        s = skip_space(s + 1);
+        if (found) return s;
+        if (!(s = skip_value(s))) return NULL;
+        s = skip_space(s);
+        if (*s == ',') s = skip_space(s + 1);
+    }
+    return NULL;
+}
+
+// Elements of the array at s: the first, then each one's next; NULL after the last
+static const char* first_item(const char* s) {
+    if (!s) return NULL;
+    s = skip_space(s);
+    if (*s != '[') return NULL;
+    s = skip_space(s + 1);
+    return *s == ']' ? NULL : s;
+}
+
+static const char* next_item(const char* item) {
+    const char* s = skip_value(item);
+    if (!s) return NULL;
+    s = skip_space(s);
+    return *s == ',' ? skip_space(s + 1) : NULL;
+}
+
+static bool int_value(const char* s, int* out) {
+    if (!s) return false;
+    char* end;
+    long n = strtol(s, &end, 10);
+    if (end == s) return false;
+    *out = (int)n;
+    return true;
+}
+
+static size_t put_utf8(char* out, unsigned long c) {
+    if (c < 0x80) { out[0] = (char)c; return 1; }
+    if (c < 0x800) { out[0] = (char)(0xC0 | (c >> 6)); out[1] = (char)(0x80 | (c & 0x3F)); return 2; }
+    if (c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12)); out[1] = (char)(0x80 | ((c >> 6) & 0x3F)); out[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (c >> 18)); out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3F)); out[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+static unsigned long hex4(const char* s) {
+    unsigned long c = 0;
+    for (int i = 0; i < 4; i++) {
+        char h = s[i];
+        if (h >= '0' && h <= '9') c = c * 16 + (unsigned long)(h - '0');
+        else if (h >= 'a' && h <= 'f') c = c * 16 + (unsigned long)(h - 'a' + 10);
+        else if (h >= 'A' && h <= 'F') c = c * 16 + (unsigned long)(h - 'A' + 10);
+        else return 0xFFFD;
+    }
+    return c;
+}
+
+// The string at s with its escapes decoded, NULL if s is not a string
+static char* string_value(const char* s, size_t* length) {
+    if (!s || *s != '"') return NULL;
+    const char* end = skip_string(s);
+    if (!end) return NULL;
+    char* out = (char*)mem_alloc((size_t)(end - s));
+    size_t n = 0;
+    for (s++; s < end - 1; s++) {
+        if (*s != '\\') { out[n++] = *s; continue; }
+        switch (*++s) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'u': {
+                if (end - 1 - s < 5) { s = end - 2; break; }
+                unsigned long c = hex4(s + 1);
+                s += 4;
+                if (c >= 0xD800 && c < 0xDC00 && end - 1 - s >= 7 && s[1] == '\\' && s[2] == 'u') {
+                    unsigned long low = hex4(s + 3);
+                    if (low >= 0xDC00 && low < 0xE000) { c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00); s += 6; }
+                }
+                n += put_utf8(out + n, c);
+                break;
+            }
+            default: out[n++] = *s; break; // " \ /
+        }
+    }
+    out[n] = '\0';
+    if (length) *length = n;
+    return out;
+}
+
+// Larger messages are a protocol error; a whole 10 MB script is far below
+#define LSP_MAX_MESSAGE (64L << 20)
+
+// One message body, NUL-terminated; NULL at the end of input or, after a
+// message on stderr, on a message that cannot be read
+static char* read_message(void) {
+    char line[256];
+    long length = -1;
+    for (;;) {
+        if (!fgets(line, sizeof(line), stdin)) return NULL;
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+            if (length >= 0) break;
+            continue;
+        }
+        if (strncmp(line, "Content-Length:", 15) == 0) {
+            char* end;
+            length = strtol(line + 15, &end, 10);
+            if (end == line + 15 || length < 0 || length > LSP_MAX_MESSAGE) {
+                int shown = (int)strcspn(line + 15, "\r\n");
+                fprintf(stderr, "hypescript: --lsp: bad Content-Length:%.*s\n", shown, line + 15);
+                return NULL;
+            }
+        }
+    }
+    char* body = (char*)mem_alloc((size_t)length + 1);
+    if (!body) {
+        fprintf(stderr, "hypescript: --lsp: out of memory for a message of %ld bytes\n", length);
+        return NULL;
+    }
+    if (fread(body, 1, (size_t)length, stdin) != (size_t)length) {
+        mem_free(body);
+        return NULL;
+    }
+    body[length] = '\0';
+    return body;
+}
+
+// {"jsonrpc":"2.0","id":ID, with the id of the request as it came
+static void put_reply_head(Buffer* out, const char* id) {
+    const char* end = skip_value(id);
+    put_str(out, "{\"jsonrpc\":\"2.0\",\"id\":");
+    if (end) put(out, id, (size_t)(end - id));
+    else put_str(out, "null");
+}
+
+static void respond(Buffer* out, const char* id, const char* result) {
+    put_reply_head(out, id);
+    put_str(out, ",\"result\":");
+    put_str(out, result);
+    put_str(out, "}");
+    send(out);
+}
+
+typedef struct {
+    Buffer* out;
+    const Document* doc;
+    bool first;
+} Publishing;
+
+static void put_diagnostic(void* ctx, const Diagnostic* diagnostic) {
+    Publishing* pub = (Publishing*)ctx;
+    int line = diagnostic->line - 1;
+    int character = document_character(pub->doc, diagnostic->line, diagnostic->column);
+    put_str(pub->out, pub->first ? "{\"range\":{\"start\":{\"line\":" : ",{\"range\":{\"start\":{\"line\":");
+    pub->first = false;
+    put_int(pub->out, line);
+    put_str(pub->out, ",\"character\":");
+    put_int(pub->out, character);
+    put_str(pub->out, "},\"end\":{\"line\":");
+    put_int(pub->out, line);
+    put_str(pub->out, ",\"character\":");
+    put_int(pub->out, character + 1);
+    put_str(pub->out, "}},\"severity\":1,\"source\":\"hypescript\",\"message\":");
+    put_json_string(pub->out, diagnostic->message);
+    put_str(pub->out, "}");
+}
+
+// Sends the syntax errors of doc, none if it is NULL
+static void publish(Buffer* out, const char* uri, const Document* doc) {
+    put_str(out, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    put_json_string(out, uri);
+    put_str(out, ",\"diagnostics\":[");
+    if (doc) {
+        Publishing pub = { out, doc, true };
+        document_diagnostics(doc, put_diagnostic, &pub);
+    }
+    put_str(out, "]}}");
+    send(out);
+}
+
+static Open** find(Open** list, const char* uri) {
+    while (*list && strcmp((*list)->uri, uri) != 0) list = &(*list)->next;
+    return list;
+}
+
+static void did_open(Buffer* out, Open** list, const char* params) {
+    const char* item = member(params, "textDocument");
+    size_t length;
+    char* uri = string_value(member(item, "uri"), NULL);
+    char* text = string_value(member(item, "text"), &length);
+    if (uri && text) {
+        Open** at = find(list, uri);
+        if (*at) {
+            document_free((*at)->doc);
+            (*at)->doc = document_new(text, length);
+            mem_free(uri);
+        } else {
+            Open* o = (Open*)mem_alloc(sizeof(Open));
+            o->uri = uri;
+            o->doc = document_new(text, length);
+            o->next = NULL;
+            *at = o;
+        }
+        publish(out, (*at)->uri, (*at)->doc);
+    } else {
+        mem_free(uri);
+    }
+    mem_free(text);
+}
+
+static void did_change(Buffer* out, Open** list, const char* params) {
+    char* uri = string_value(member(member(params, "textDocument"), "uri"), NULL);
+    Open* o = uri ? *find(list, uri) : NULL;
+    mem_free(uri);
+    if (!o) return;
+    for (const char* change = first_item(member(params, "contentChanges")); change; change = next_item(change)) {
+        size_t length;
+        char* text = string_value(member(change, "text"), &length);
+        if (!text) continue;
+        const char* range = member(change, "range");
+        const char* start = member(range, "start");
+        const char* end = member(range, "end");
+        int start_line, start_character, end_line, end_character;
+        if (int_value(member(start, "line"), &start_line) && int_value(member(start, "character"), &start_character)
+            && int_value(member(end, "line"), &end_line) && int_value(member(end, "character"), &end_character)) {
+            document_edit(o->doc, start_line, start_character, end_line, end_character, text, length);
+        } else {
+            // The whole text
+            document_free(o->doc);
+            o->doc = document_new(text, length);
+        }
+        mem_free(text);
+    }
+    publish(out, o->uri, o->doc);
+}
+
+static void did_close(Buffer* out, Open** list, const char* params) {
+    char* uri = string_value(member(member(params, "textDocument"), "uri"), NULL);
+    Open** at = uri ? find(list, uri) : NULL;
+    if (at && *at) {
+        Open* o = *at;
+        *at = o->next;
+        publish(out, o->uri, NULL);
+        document_free(o->doc);
+        mem_free(o->uri);
+        mem_free(o);
+    }
+    mem_free(uri);
+}
+
+int lsp_run(void) {
+    Buffer out = { NULL, 0, 0 };
+    Open* open = NULL;
+    bool shut_down = false;
+    int status = 1;
+    char* message;
+    while ((message = read_message()) != NULL) {
+        char* method = string_value(member(message, "method"), NULL);
+        const char* id = member(message, "id");
+        const char* params = member(message, "params");
+        bool exiting = false;
+        if (!method) {
+            // A response to a request of ours; none are sent
+        } else if (strcmp(method, "initialize") == 0 && id) {
+            respond(&out, id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2}},"
+                              "\"serverInfo\":{\"name\":\"hypescript\"}}");
+        } else if (strcmp(method, "shutdown") == 0 && id) {
+            shut_down = true;
+            respond(&out, id, "null");
+        } else if (strcmp(method, "exit") == 0) {
+            status = shut_down ? 0 : 1;
+            exiting = true;
+        } else if (strcmp(method, "textDocument/didOpen") == 0) {
+            did_open(&out, &open, params);
+        } else if (strcmp(method, "textDocument/didChange") == 0) {
+            did_change(&out, &open, params);
+        } else if (strcmp(method, "textDocument/didClose") == 0) {
+            did_close(&out, &open, params);
+        } else if (id) {
+            put_reply_head(&out, id);
+            put_str(&out, ",\"error\":{\"code\":-32601,\"message\":\"method not found\"}}");
+            send(&out);
+        }
+        mem_free(method);
+        mem_free(message);
+        if (exiting) break;
+    }
+    while (open) {
+        Open* next = open->next;
+        document_free(open->doc);
+        mem_free(open->uri);
+        mem_free(open);
+        open = next;
+    }
+    mem_free(out.data);
+    return status;
+}
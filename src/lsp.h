@@ -0,0 +1,14 @@
+#ifndef HYPESCRIPT_LSP_H
+#define HYPESCRIPT_LSP_H
+
+// Language server: `hypescript --lsp` speaks the Language Server Protocol
+// (JSON-RPC with Content-Length headers) on stdin and stdout, for the
+// VS Code extension or any other editor client. Open files are kept as
+// Documents and synced by incremental edits; after each change the syntax
+// errors of the file are published as diagnostics, found by re-parsing
+// only the statements the edit touched.
+
+// Serves until the client sends exit; the exit status, 0 after shutdown
+int lsp_run(void);
+
+#endif
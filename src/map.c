@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+#define MEM_KIND MEM_MAP
+#include "mem.h"
+
+#define MAP_MIN_SLOTS 8
+
+static uint32_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    uint32_t out = (uint32_t)h;
+    return out ? out : 1;
+}
+
+// Never 0 for a valid key, so that 0 can mark removed entries
+static uint32_t key_hash(const Value* key) {
+    switch (key->type) {
+        case VAL_STRING: return string_hash(key->data.as_string);
+        case VAL_NUMBER: {
+            double d = key->data.as_number;
+            if (d == 0) d = 0; // -0 and 0 are the same key
+            uint64_t bits; memcpy(&bits, &d, sizeof(bits));
+            return mix64(bits);
+        }
+        case VAL_BOOL: return key->data.as_bool ? 0x2u : 0x3u;
+        case VAL_NULL: return 0x1u;
+        default: return 0;
+    }
+}
+
+static size_t probe_distance(uint64_t slot, size_t pos, size_t mask) {
+    return (pos - ((size_t)(slot >> 32) & mask)) & mask;
+}
+
+static size_t slot_entry(uint64_t slot) {
+    return (size_t)(slot & 0xFFFFFFFFu) - 1;
+}
+
+static void slots_insert(Map* m, uint32_t hash, size_t index) {
+    size_t mask = m->slot_mask;
+    size_t pos = hash & mask, dist = 0;
+    uint64_t cur = ((uint64_t)hash << 32) | (uint64_t)(index + 1);
+    for (;;) {
+        uint64_t slot = m->slots[pos];
+        if (slot == 0) { m->slots[pos] = cur; return; }
+        size_t d = probe_distance(slot, pos, mask);
+        if (d < dist) { m->slots[pos] = cur; cur = slot; dist = d; }
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+}
+
+// Slot position holding the key, or (size_t)-1
+static size_t slots_find(const Map* m, const Value* key, uint32_t hash) {
+    if (!m->slots) return (size_t)-1;
+    size_t mask = m->slot_mask;
+    size_t pos = hash & mask, dist = 0;
+    for (;;) {
+        uint64_t slot = m->slots[pos];
+        if (slot == 0 || probe_distance(slot, pos, mask) < dist) return (size_t)-1;
+        if ((uint32_t)(slot >> 32) == hash && value_equals(&m->entries[slot_entry(slot)].key, key)) return pos;
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+}
+
+// Compacts removed entries away and rebuilds the slot table
+static void map_rebuild(Map* m, size_t slot_count) {
+    size_t live = 0;
+    for (size_t i = 0; i < m->used; i++) {
+        if (m->entries[i].hash == 0) continue;
+        if (live != i) m->entries[live] = m->entries[i];
+        live++;
+    }
+    m->used = live;
+    mem_free(m->slots);
+    m->slots = (uint64_t*)mem_calloc(slot_count, sizeof(uint64_t));
+    m->slot_mask = slot_count - 1;
+    for (size_t i = 0; i < m->used; i++) slots_insert(m, m->entries[i].hash, i);
+}
+
+Map* map_new(void) {
+    Map* m = (Map*)mem_alloc(sizeof(Map));
+    m->refcount = 1;
+    m->count = 0;
+    m->used = 0;
+    m->capacity = 0;
+    m->entries = NULL;
+    m->slots = NULL;
+    m->slot_mask = 0;
+    return m;
+}
+
+Map* map_retain(Map* m) {
+    if (m) m->refcount++;
+    return m;
+}
+
+void map_release(Map* m) {
+    if (!m || --m->refcount > 0) return;
+    for (size_t i = 0; i < m->used; i++) {
+        if (m->entries[i].hash == 0) continue;
+        value_free(&m->entries[i].key);
+        value_free(&m->entries[i].value);
+    }
+    mem_free(m->entries);
+    mem_free(m->slots);
+    mem_free(m);
+}
+
+bool map_key_ok(const Value* key) {
+    return key->type != VAL_ARRAY && key->type != VAL_MAP && key->type != VAL_OBJECT;
+}
+
+bool map_get(const Map* m, const Value* key, Value* out) {
+    if (!map_key_ok(key)) return false;
+    size_t pos = slots_find(m, key, key_hash(key));
+    if (pos == (size_t)-1) return false;
+    if (out) *out = m->entries[slot_entry(m->slots[pos])].value;
+    return true;
+}
+
+bool map_set(Map* m, const Value* key, Value value) {
+    if (!map_key_ok(key)) { value_free(&value); return false; }
+    uint32_t hash = key_hash(key);
+    size_t pos = slots_find(m, key, hash);
+    if (pos != (size_t)-1) {
+        MapEntry* e = &m->entries[slot_entry(m->slots[pos])];
+        value_free(&e->value);
+        e->value = value;
+        return true;
+    }
+    // Keep the slot table at most 7/8 full
+    size_t slot_count = m->slots ? m->slot_mask + 1 : 0;
+    if ((m->count + 1) * 8 > slot_count * 7) {
+        map_rebuild(m, slot_count ? slot_count * 2 : MAP_MIN_SLOTS);
+    }
+    if (m->used == m->capacity) {
+        if (m->used - m->count > m->used / 2) {
+            map_rebuild(m, m->slot_mask + 1); // mostly removed entries: compact instead of growing
+        } else {
+            m->capacity = m->capacity ? m->capacity * 2 : MAP_MIN_SLOTS;
+            m->entries = (MapEntry*)mem_realloc(m->entries, sizeof(MapEntry) * m->capacity);
+        }
+    }
+    MapEntry* e = &m->entries[m->used];
+    e->key = value_clone(key);
+    e->value = value;
+    e->hash = hash;
+    slots_insert(m, hash, m->used);
+    m->used++;
+    m->count++;
+    return true;
+}
+
+bool map_remove(Map* m, const Value* key) {
+    if (!map_key_ok(key)) return false;
+    size_t pos = slots_find(m, key, key_hash(key));
+    if (pos == (size_t)-1) return false;
+    MapEntry* e = &m->entries[slot_entry(m->slots[pos])];
+    value_free(&e->key);
+    value_free(&e->value);
+    e->hash = 0;
+    m->count--;
+    // Backward-shift deletion keeps probe sequences tombstone-free
+    size_t mask = m->slot_mask;
+    size_t next = (pos + 1) & mask;
+    while (m->slots[next] != 0 && probe_distance(m->slots[next], next, mask) > 0) {
+        m->slots[pos] = m->slots[next];
+        pos = next;
+        next = (next + 1) & mask;
+    }
+    m->slots[pos] = 0;
+    return true;
+}
+
+bool map_equals(const Map* a, const Map* b, const Enclosing* outer) {
+    if (a == b || enclosing_has(outer, a, b)) return true;
+    if (a->count != b->count) return false;
+    Enclosing here = { a, b, outer };
+    for (size_t i = 0; i < a->used; i++) {
+        const MapEntry* e = &a->entries[i];
+        if (e->hash == 0) continue;
+        Value other;
+        if (!map_get(b, &e->key, &other) || !value_equals_within(&e->value, &other, &here)) return false;
+    }
+    return true;
+}
+
+bool map_next(const Map* m, size_t* cursor, Value* key, Value* value) {
+    while (*cursor < m->used) {
+        const MapEntry* e = &m->entries[(*cursor)++];
+        if (e->hash == 0) continue;
+        if (key) *key = e->key;
+        if (value) *value = e->value;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef HYPESCRIPT_MAP_H
+#define HYPESCRIPT_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+// Reference-counted hash map with any scalar key (string, number, bool,
+// NICHTO). Entries live in a dense array in insertion order; the index is
+// an open-addressing table of 8-byte slots, each packing the key hash and
+// the entry position, probed Robin Hood style. Probes therefore touch one
+// cache line of slots and compare full keys only when the hashes match.
+typedef struct {
+    Value key;
+    Value value;
+    uint32_t hash; // 0 marks a removed entry
+} MapEntry;
+
+struct Map {
+    int refcount;
+    size_t count;     // live entries
+    size_t used;      // entries in use, including removed ones
+    size_t capacity;  // allocated entries
+    MapEntry* entries;
+    uint64_t* slots;  // (hash << 32) | (entry index + 1); 0 = empty
+    size_t slot_mask; // slot count - 1, a power of two minus one
+};
+
+Map* map_new(void);
+Map* map_retain(Map* m);
+void map_release(Map* m);
+
+bool map_key_ok(const Value* key); // arrays, maps and objects cannot be keys
+bool map_get(const Map* m, const Value* key, Value* out);  // borrowed
+bool map_set(Map* m, const Value* key, Value value);       // takes value
+bool map_remove(Map* m, const Value* key);
+bool map_equals(const Map* a, const Map* b, const Enclosing* outer); // see value_equals_within
+
+// Insertion-order iteration; *cursor starts at 0. Key/value are borrowed.
+bool map_next(const Map* m, size_t* cursor, Value* key, Value* value);
+
+#endif
+
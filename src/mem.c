@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+#define MAX_SITES 4096 // a power of two
+
+typedef struct {
+    _Alignas(max_align_t) size_t size; // of the whole block, header included
+    uint32_t site;                     // index + 1 in sites, 0 if not traced
+    uint32_t kind;
+} Header;
+
+typedef struct {
+    const char* file;
+    int line;
+    MemKind kind;
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t live_blocks;
+    uint64_t live_bytes;
+} Site;
+
+static atomic_size_t in_use;
+static atomic_size_t peak;
+static size_t limit;
+
+static atomic_bool tracing;
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+static Site* sites; // hashed by file and line
+static uint32_t sites_used;
+
+static const char* const kind_names[MEM_KINDS] = {
+    [MEM_OTHER] = "other",
+    [MEM_STRING] = "string",
+    [MEM_ARRAY] = "array",
+    [MEM_MAP] = "map",
+    [MEM_ENV] = "env",
+    [MEM_AST] = "ast",
+    [MEM_MEMO] = "memo",
+};
+
+static void exhausted(size_t size, const char* file, int line) {
+    fprintf(stderr, "hypescript: heap limit of %zu bytes reached (%s:%d asked for %zu more)\n", limit, file, line, size);
+    exit(1);
+}
+
+// Counts size more bytes in use, unless that goes over the limit
+static void charge(size_t size, const char* file, int line) {
+    size_t now = atomic_fetch_add_explicit(&in_use, size, memory_order_relaxed) + size;
+    if (limit && now > limit) {
+        atomic_fetch_sub_explicit(&in_use, size, memory_order_relaxed);
+        exhausted(size, file, line);
+    }
+    size_t high = atomic_load_explicit(&peak, memory_order_relaxed);
+    while (now > high && !atomic_compare_exchange_weak_explicit(&peak, &high, now, memory_order_relaxed, memory_order_relaxed)) {}
+}
+
+static uint32_t site_index(MemKind kind, const char* file, int line) {
+    uint32_t h = (uint32_t)((uintptr_t)file >> 4) * 2654435761u ^ (uint32_t)line * 40503u;
+    for (uint32_t i = 0; i < MAX_SITES; i++) {
+        uint32_t k = (h + i) & (MAX_SITES - 1);
+        Site* s = &sites[k];
+        if (!s->file) {
+            s->file = file;
+            s->line = line;
+            s->kind = kind;
+            sites_used++;
+        }
+        if (s->file == file && s->line == line) return k + 1;
+    }
+    return 0; // full: not traced
+}
+
+static void trace_alloc(Header* h, MemKind kind, const char* file, int line) {
+    h->site = 0;
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed)) return;
+    pthread_mutex_lock(&sites_lock);
+    h->site = site_index(kind, file, line);
+    if (h->site) {
+        Site* s = &sites[h->site - 1];
+        s->allocs++;
+        s->bytes += h->size;
+        s->live_blocks++;
+        s->live_bytes += h->size;
+    }
+    pthread_mutex_unlock(&sites_lock);
+}
+
+static void trace_free(const Header* h) {
+    if (!h->site) return;
+    pthread_mutex_lock(&sites_lock);
+    Site* s = &sites[h->site - 1];
+    s->live_blocks--;
+    s->live_bytes -= h->size;
+    pthread_mutex_unlock(&sites_lock);
+}
+
+void* mem_alloc_at(size_t size, MemKind kind, const char* file, int line) {
+    if (size > SIZE_MAX - sizeof(Header)) return NULL;
+    size_t total = sizeof(Header) + size;
+    charge(total, file, line);
+    Header* h = (Header*)malloc(total);
+    if (!h) { atomic_fetch_sub_explicit(&in_use, total, memory_order_relaxed); return NULL; }
+    h->size = total;
+    h->kind = kind;
+    trace_alloc(h, kind, file, line);
+    return h + 1;
+}
+
+void* mem_calloc_at(size_t count, size_t size, MemKind kind, const char* file, int line) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* p = mem_alloc_at(count * size, kind, file, line);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+void* mem_realloc_at(void* p, size_t size, MemKind kind, const char* file, int line) {
+    if (!p) return mem_alloc_at(size, kind, file, line);
+    if (size > SIZE_MAX - sizeof(Header)) return NULL;
+    Header* old = (Header*)p - 1;
+    size_t old_total = old->size;
+    size_t total = sizeof(Header) + size;
+    if (total > old_total) charge(total - old_total, file, line);
+    trace_free(old);
+    Header* h = (Header*)realloc(old, total);
+    if (!h) {
+        if (total > old_total) atomic_fetch_sub_explicit(&in_use, total - old_total, memory_order_relaxed);
+        trace_alloc(old, (MemKind)old->kind, file, line);
+        return NULL;
+    }
+    if (total < old_total) atomic_fetch_sub_explicit(&in_use, old_total - total, memory_order_relaxed);
+    h->size = total;
+    h->kind = kind;
+    trace_alloc(h, kind, file, line); // the block now belongs to the line that resized it
+    return h + 1;
+}
+
+void mem_free(void* p) {
+    if (!p) return;
+    Header* h = (Header*)p - 1;
+    atomic_fetch_sub_explicit(&in_use, h->size, memory_order_relaxed);
+    trace_free(h);
+    free(h);
+}
+
+size_t mem_in_use(void) {
+    return atomic_load_explicit(&in_use, memory_order_relaxed);
+}
+
+size_t mem_peak(void) {
+    return atomic_load_explicit(&peak, memory_order_relaxed);
+}
+
+void mem_set_limit(size_t bytes) {
+    limit = bytes;
+}
+
+bool mem_parse_size(const char* spec, size_t* bytes) {
+    char* end;
+    unsigned long long n = strtoull(spec, &end, 10);
+    if (end == spec) return false;
+    int shift = 0;
+    if (*end == 'k' || *end == 'K') shift = 10;
+    else if (*end == 'm' || *end == 'M') shift = 20;
+    else if (*end == 'g' || *end == 'G') shift = 30;
+    if (shift) end++;
+    if (*end != '\0' || n == 0 || n > (SIZE_MAX >> shift)) return false;
+    *bytes = (size_t)n << shift;
+    return true;
+}
+
+static int by_bytes(const void* a, const void* b) {
+    const Site* x = (const Site*)a;
+    const Site* y = (const Site*)b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static void report(void) {
+    pthread_mutex_lock(&sites_lock);
+    Site* used = (Site*)malloc(sizeof(Site) * (sites_used ? sites_used : 1));
+    size_t n = 0;
+    Site kinds[MEM_KINDS];
+    memset(kinds, 0, sizeof(kinds));
+    for (size_t i = 0; i < MAX_SITES; i++) {
+        const Site* s = &sites[i];
+        if (!s->file) continue;
+        used[n++] = *s;
+        Site* k = &kinds[s->kind];
+        k->allocs += s->allocs;
+        k->bytes += s->bytes;
+        k->live_blocks += s->live_blocks;
+        k->live_bytes += s->live_bytes;
+    }
+    pthread_mutex_unlock(&sites_lock);
+    qsort(used, n, sizeof(Site), by_bytes);
+    fprintf(stderr, "heap: peak %zu bytes, %zu still in use\n", mem_peak(), mem_in_use());
+    fprintf(stderr, "%-24s %-7s %12s %14s %10s %12s\n", "by kind", "", "allocations", "bytes", "live", "live bytes");
+    for (int i = 0; i < MEM_KINDS; i++) {
+        if (!kinds[i].allocs) continue;
+        fprintf(stderr, "  %-22s %-7s %12llu %14llu %10llu %12llu\n", kind_names[i], "", (unsigned long long)kinds[i].allocs,
+                (unsigned long long)kinds[i].bytes, (unsigned long long)kinds[i].live_blocks,
+                (unsigned long long)kinds[i].live_bytes);
+    }
+    fprintf(stderr, "%-24s %-7s\n", "by line", "kind");
+    for (size_t i = 0; i < n && i < 20; i++) {
+        char where[64];
+        snprintf(where, sizeof(where), "%s:%d", used[i].file, used[i].line);
+        fprintf(stderr, "  %-22s %-7s %12llu %14llu %10llu %12llu\n", where, kind_names[used[i].kind],
+                (unsigned long long)used[i].allocs, (unsigned long long)used[i].bytes,
+                (unsigned long long)used[i].live_blocks, (unsigned long long)used[i].live_bytes);
+    }
+    free(used);
+}
+
+void mem_trace(void) {
+    if (atomic_load(&tracing)) return;
+    sites = (Site*)calloc(MAX_SITES, sizeof(Site));
+    if (!sites) return;
+    atomic_store(&tracing, true);
+    atexit(report);
+}
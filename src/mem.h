@@ -0,0 +1,53 @@
+#ifndef HYPESCRIPT_MEM_H
+#define HYPESCRIPT_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Accounted heap.
+//
+// Every allocation of the interpreter goes through mem_alloc, mem_calloc,
+// mem_realloc and mem_free, which keep a small header in front of the
+// block with its size, its kind and the source line that asked for it.
+// That gives the current and peak heap size (pamyat()), a report by kind
+// and by line (--trace-alloc) and a hard limit (--max-heap): an allocation
+// that would go over the limit ends the program with a message instead of
+// leaving it to the OOM killer.
+//
+// A file sets its kind by defining MEM_KIND before including this header.
+
+typedef enum {
+    MEM_OTHER,
+    MEM_STRING,
+    MEM_ARRAY,
+    MEM_MAP,
+    MEM_ENV,     // scopes, variables and prikol definitions
+    MEM_AST,
+    MEM_MEMO,    // --memo caches
+    MEM_KINDS
+} MemKind;
+
+#ifndef MEM_KIND
+#define MEM_KIND MEM_OTHER
+#endif
+
+#define mem_alloc(size) mem_alloc_at((size), MEM_KIND, __FILE__, __LINE__)
+#define mem_calloc(count, size) mem_calloc_at((count), (size), MEM_KIND, __FILE__, __LINE__)
+#define mem_realloc(p, size) mem_realloc_at((p), (size), MEM_KIND, __FILE__, __LINE__)
+
+void* mem_alloc_at(size_t size, MemKind kind, const char* file, int line);
+void* mem_calloc_at(size_t count, size_t size, MemKind kind, const char* file, int line);
+void* mem_realloc_at(void* p, size_t size, MemKind kind, const char* file, int line);
+void mem_free(void* p);
+
+size_t mem_in_use(void); // bytes, headers included
+size_t mem_peak(void);
+
+// 0 for no limit
+void mem_set_limit(size_t bytes);
+// "1048576", "64k", "512m" or "2g"; false unless it is a positive size
+bool mem_parse_size(const char* spec, size_t* bytes);
+// Counts allocations by line from now on and reports them to stderr at exit
+void mem_trace(void);
+
+#endif
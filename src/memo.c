@@ -0,0 +1,528 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "memo.h"
+#include "builtins.h"
+#include "stats.h"
+#define MEM_KIND MEM_MEMO
+#include "mem.h"
+
+#define MAX_NAMES 64 // globals a memoized prikol may touch, one bit each
+#define MAX_ARGS 16
+
+size_t memo_capacity = 0;
+
+struct MemoEntry {
+    uint64_t hash;
+    uint64_t present;    // which of the names were globals
+    MemoEntry* next_in_bucket;
+    MemoEntry* newer;    // LRU order
+    MemoEntry* older;
+    int key_count;       // arguments, then the present inputs
+    int out_count;       // the present outputs
+    Value values[];      // key_count + out_count
+};
+
+struct Memo {
+    size_t generation;   // Functions.count it was worked out for
+    bool cached;         // false: calls always run
+    int name_count;
+    const char** names;  // globals it reads or writes, borrowed from the bodies
+    uint64_t inputs;     // bit i: the value of names[i] is part of the key
+    uint64_t outputs;    // bit i: names[i] is recorded after the call
+    MemoEntry** buckets; // capacity rounded up to a power of two
+    size_t mask;
+    size_t count;
+    MemoEntry* newest;
+    MemoEntry* oldest;
+};
+
+// Builtins that see nothing but their arguments and touch nothing but
+// the values they are given
+static const bool pure_builtins[BI_COUNT] = {
+    [BI_CHISLO] = true, [BI_STROKA] = true, [BI_LOGIKA] = true, [BI_UKAZATEL] = true,
+    [BI_MASSIV] = true, [BI_DLINA] = true, [BI_DOBAVIT] = true, [BI_SUMMA] = true,
+    [BI_MINIMUM] = true, [BI_MAKSIMUM] = true, [BI_UMNOZHIT] = true, [BI_SKALYAR] = true,
+    [BI_ZAPOLNIT] = true, [BI_SREZ] = true, [BI_CHISLA] = true, [BI_POLYA] = true,
+    [BI_STROKI] = true, [BI_NAYTI] = true, [BI_SLOVAR] = true, [BI_KLYUCHI] = true,
+    [BI_ZNACHENIYA] = true, [BI_EST] = true, [BI_UDALIT] = true,
+};
+
+// Analysis. Every name below is a global: a prikol's parameters are its
+// own, and anything else it assigns is a global if one of that name
+// exists when it is called (and a local otherwise, invisible outside).
+// Arrays and maps cannot come in from outside, as calls with them in the
+// arguments or inputs are not cached, so changing them is not an effect.
+
+typedef struct {
+    const char** names;
+    int count;
+    int capacity;
+} NameSet;
+
+static bool set_has(const NameSet* s, const char* name) {
+    for (int i = 0; i < s->count; i++)
+        if (s->names[i] == name || strcmp(s->names[i], name) == 0) return true;
+    return false;
+}
+
+static void set_add(NameSet* s, const char* name) {
+    if (set_has(s, name)) return;
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 8;
+        s->names = (const char**)mem_realloc(s->names, sizeof(char*) * (size_t)s->capacity);
+    }
+    s->names[s->count++] = name;
+}
+
+static void set_copy(NameSet* to, const NameSet* from) {
+    to->count = 0;
+    for (int i = 0; i < from->count; i++) set_add(to, from->names[i]);
+}
+
+// Keeps the names of s that are also in other
+static void set_intersect(NameSet* s, const NameSet* other) {
+    int n = 0;
+    for (int i = 0; i < s->count; i++)
+        if (set_has(other, s->names[i])) s->names[n++] = s->names[i];
+    s->count = n;
+}
+
+// A set of globals written on every path; `all` before the first pass
+// over a prikol, as if it wrote everything
+typedef struct {
+    NameSet names;
+    bool all;
+} MustSet;
+
+static void must_copy(MustSet* to, const MustSet* from) {
+    to->all = from->all;
+    set_copy(&to->names, &from->names);
+}
+
+static bool must_has(const MustSet* m, const char* name) {
+    return m->all || set_has(&m->names, name);
+}
+
+// Paths that join: only what both wrote is written for sure
+static void must_join(MustSet* m, const MustSet* other) {
+    if (other->all) return;
+    if (m->all) { must_copy(m, other); return; }
+    set_intersect(&m->names, &other->names);
+}
+
+typedef struct {
+    FunctionDef* def;
+    Stmt* body;
+    bool pure;
+    NameSet reads;  // may read
+    NameSet writes; // may write
+    NameSet inputs; // may read before writing, or may leave as it was
+    MustSet must;   // writes on every path
+} Summary;
+
+typedef struct {
+    Summary* items;
+    int count;
+    int capacity;
+    Functions* functions;
+    bool grew;
+} Graph;
+
+// One pass over a body, building a new summary of its prikol
+typedef struct {
+    Graph* graph;
+    const FunctionDef* def;
+    Summary* out;
+    MustSet must; // written so far on the current path
+    int loops;
+} Walk;
+
+static void summary_free(Summary* s) {
+    mem_free(s->reads.names);
+    mem_free(s->writes.names);
+    mem_free(s->inputs.names);
+    mem_free(s->must.names.names);
+}
+
+static int graph_add(Graph* g, FunctionDef* def) {
+    if (g->count == g->capacity) {
+        g->capacity = g->capacity ? g->capacity * 2 : 8;
+        g->items = (Summary*)mem_realloc(g->items, sizeof(Summary) * (size_t)g->capacity);
+    }
+    Summary* s = &g->items[g->count];
+    memset(s, 0, sizeof(*s));
+    s->def = def;
+    s->body = interpret_function_body(def);
+    s->pure = true;
+    s->must.all = true;
+    g->grew = true;
+    return g->count++;
+}
+
+static bool is_param(const FunctionDef* def, const char* name) {
+    for (int i = 0; i < def->param_count; i++)
+        if (strcmp(def->params[i], name) == 0) return true;
+    return false;
+}
+
+static void walk_read(Walk* w, const char* name) {
+    if (is_param(w->def, name)) return;
+    set_add(&w->out->reads, name);
+    if (!must_has(&w->must, name)) set_add(&w->out->inputs, name);
+}
+
+static void walk_write(Walk* w, const char* name) {
+    if (is_param(w->def, name)) return;
+    set_add(&w->out->writes, name);
+    if (!w->must.all) set_add(&w->must.names, name);
+}
+
+// A call of another prikol: its effect, in terms of globals
+static void walk_call(Walk* w, const char* name, int argc) {
+    FunctionDef* callee = funcs_lookup(w->graph->functions, name);
+    if (!callee || argc != callee->param_count) { w->out->pure = false; return; }
+    int index = -1;
+    for (int i = 0; i < w->graph->count; i++)
+        if (w->graph->items[i].def == callee) { index = i; break; }
+    // May move the items: only indexes are kept across it
+    if (index < 0) index = graph_add(w->graph, callee);
+    const Summary* s = &w->graph->items[index];
+    if (!s->pure) { w->out->pure = false; return; }
+    for (int i = 0; i < s->reads.count; i++) set_add(&w->out->reads, s->reads.names[i]);
+    for (int i = 0; i < s->inputs.count; i++)
+        if (!must_has(&w->must, s->inputs.names[i])) set_add(&w->out->inputs, s->inputs.names[i]);
+    for (int i = 0; i < s->writes.count; i++) set_add(&w->out->writes, s->writes.names[i]);
+    if (s->must.all) w->must.all = true;
+    else if (!w->must.all) for (int i = 0; i < s->must.names.count; i++) set_add(&w->must.names, s->must.names.names[i]);
+}
+
+static void walk_expr(Walk* w, const Expr* e);
+
+static void walk_exprs(Walk* w, Expr* const* list, int count) {
+    for (int i = 0; i < count; i++) walk_expr(w, list[i]);
+}
+
+// In evaluation order: operands left to right, an assigned value before
+// the assignment, arguments before the call
+static void walk_expr(Walk* w, const Expr* e) {
+    switch (e->type) {
+        case EXPR_LITERAL: break;
+        case EXPR_VARIABLE: walk_read(w, e->as.variable.name); break;
+        case EXPR_ASSIGN: walk_expr(w, e->as.assign.value); walk_write(w, e->as.assign.name); break;
+        case EXPR_BINARY: walk_expr(w, e->as.binary.left); walk_expr(w, e->as.binary.right); break;
+        case EXPR_UNARY: walk_expr(w, e->as.unary.expr); break;
+        case EXPR_CALL:
+            walk_exprs(w, e->as.call.args, e->as.call.arg_count);
+            if (e->as.call.builtin == BI_NONE) walk_call(w, e->as.call.callee, e->as.call.arg_count);
+            else if (!pure_builtins[e->as.call.builtin]) w->out->pure = false;
+            break;
+        case EXPR_ARRAY: walk_exprs(w, e->as.array.items, e->as.array.count); break;
+        case EXPR_MAP:
+            for (int i = 0; i < e->as.map.count; i++) { walk_expr(w, e->as.map.keys[i]); walk_expr(w, e->as.map.values[i]); }
+            break;
+        case EXPR_INDEX: walk_expr(w, e->as.index.object); walk_expr(w, e->as.index.index); break;
+        case EXPR_INDEX_ASSIGN:
+            walk_expr(w, e->as.index_assign.object);
+            walk_expr(w, e->as.index_assign.index);
+            walk_expr(w, e->as.index_assign.value);
+            break;
+    }
+}
+
+static void walk_stmt(Walk* w, const Stmt* s);
+
+// A loop body may not run at all, so it writes nothing for sure; what it
+// reads is first read with what was written before the loop
+static void walk_loop_body(Walk* w, const Stmt* body, const Expr* increment) {
+    MustSet before = { { NULL, 0, 0 }, false };
+    must_copy(&before, &w->must);
+    w->loops++;
+    walk_stmt(w, body);
+    if (increment) walk_expr(w, increment);
+    w->loops--;
+    must_copy(&w->must, &before);
+    mem_free(before.names.names);
+}
+
+static void walk_stmt(Walk* w, const Stmt* s) {
+    if (!s) return;
+    switch (s->type) {
+        case STMT_EXPR: walk_expr(w, s->as.expr.expr); break;
+        case STMT_BLOCK:
+            for (const StmtList* it = s->as.block.statements; it; it = it->next) walk_stmt(w, it->stmt);
+            break;
+        case STMT_IF: {
+            walk_expr(w, s->as.ifstmt.condition);
+            MustSet before = { { NULL, 0, 0 }, false };
+            must_copy(&before, &w->must);
+            walk_stmt(w, s->as.ifstmt.then_branch);
+            MustSet other = w->must;
+            w->must = before;
+            walk_stmt(w, s->as.ifstmt.else_branch);
+            must_join(&w->must, &other);
+            mem_free(other.names.names);
+            break;
+        }
+        case STMT_WHILE:
+            walk_expr(w, s->as.whilestmt.condition);
+            walk_loop_body(w, s->as.whilestmt.body, NULL);
+            break;
+        case STMT_FOR:
+            if (s->as.forstmt.parallel) { w->out->pure = false; break; }
+            walk_stmt(w, s->as.forstmt.init);
+            if (s->as.forstmt.condition) walk_expr(w, s->as.forstmt.condition);
+            walk_loop_body(w, s->as.forstmt.body, s->as.forstmt.increment);
+            break;
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+            // Outside a loop it leaks out of the call into the caller's loop
+            if (!w->loops) w->out->pure = false;
+            break;
+        case STMT_FUNC:
+        case STMT_SECTION:
+        case STMT_IMPORT:
+            w->out->pure = false;
+            break;
+    }
+}
+
+// Recomputes the summary at index i from the current ones of its callees;
+// true if it changed
+static bool summarise(Graph* g, int i) {
+    Summary next;
+    memset(&next, 0, sizeof(next));
+    next.pure = true;
+    Walk w = { g, g->items[i].def, &next, { { NULL, 0, 0 }, false }, 0 };
+    walk_stmt(&w, g->items[i].body);
+    next.must = w.must;
+    // A global it may leave unwritten keeps the value it came in with
+    for (int k = 0; k < next.writes.count; k++)
+        if (!must_has(&next.must, next.writes.names[k])) set_add(&next.inputs, next.writes.names[k]);
+    Summary* old = &g->items[i];
+    next.def = old->def;
+    next.body = old->body;
+    // Reads, writes and inputs only grow and must only shrinks between
+    // passes, so the sizes tell whether anything moved
+    bool changed = next.pure != old->pure || next.reads.count != old->reads.count || next.writes.count != old->writes.count
+        || next.inputs.count != old->inputs.count || next.must.all != old->must.all
+        || next.must.names.count != old->must.names.count;
+    summary_free(old);
+    *old = next;
+    return changed;
+}
+
+static Memo* memo_new(const Summary* s, size_t generation) {
+    Memo* m = (Memo*)mem_calloc(1, sizeof(Memo));
+    m->generation = generation;
+    NameSet names = { NULL, 0, 0 };
+    set_copy(&names, &s->reads);
+    for (int i = 0; i < s->writes.count; i++) set_add(&names, s->writes.names[i]);
+    m->cached = s->pure && s->def->param_count <= MAX_ARGS && names.count <= MAX_NAMES;
+    if (!m->cached) { mem_free(names.names); return m; }
+    m->names = names.names;
+    m->name_count = names.count;
+    for (int i = 0; i < names.count; i++) {
+        if (set_has(&s->inputs, names.names[i])) m->inputs |= (uint64_t)1 << i;
+        if (set_has(&s->writes, names.names[i])) m->outputs |= (uint64_t)1 << i;
+    }
+    return m;
+}
+
+// Summarises def and everything it calls, iterating to a fixed point (a
+// recursive prikol starts out assumed to write everything and read
+// nothing), and gives each of them a Memo
+static Memo* analyse(Interpreter* in, FunctionDef* def) {
+    Graph g = { NULL, 0, 0, &in->functions, false };
+    graph_add(&g, def);
+    do {
+        g.grew = false;
+        bool changed = false;
+        for (int i = 0; i < g.count; i++) changed |= summarise(&g, i);
+        if (changed) g.grew = true;
+    } while (g.grew);
+    for (int i = 0; i < g.count; i++) {
+        FunctionDef* d = g.items[i].def;
+        if (!d->memo || d->memo->generation != in->functions.count) {
+            memo_free(d->memo);
+            d->memo = memo_new(&g.items[i], in->functions.count);
+        }
+        summary_free(&g.items[i]);
+    }
+    mem_free(g.items);
+    return def->memo;
+}
+
+// Cache
+
+static bool is_scalar(const Value* v) {
+    return v->type == VAL_NULL || v->type == VAL_BOOL || v->type == VAL_NUMBER || v->type == VAL_STRING;
+}
+
+static uint64_t mix(uint64_t h, uint64_t x) {
+    return (h ^ x) * 0x100000001b3ull;
+}
+
+static uint64_t hash_value(uint64_t h, const Value* v) {
+    h = mix(h, (uint64_t)v->type);
+    switch (v->type) {
+        case VAL_BOOL: return mix(h, v->data.as_bool);
+        case VAL_NUMBER: {
+            uint64_t bits;
+            memcpy(&bits, &v->data.as_number, sizeof(bits));
+            return mix(h, bits);
+        }
+        case VAL_STRING: return mix(h, string_hash(v->data.as_string));
+        default: return h;
+    }
+}
+
+// Same value, bit for bit for numbers so that 0 and -0 stay apart
+static bool same_value(const Value* a, const Value* b) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case VAL_BOOL: return a->data.as_bool == b->data.as_bool;
+        case VAL_NUMBER: return memcmp(&a->data.as_number, &b->data.as_number, sizeof(double)) == 0;
+        case VAL_STRING: {
+            const String* x = a->data.as_string;
+            const String* y = b->data.as_string;
+            return x == y || (x->length == y->length && memcmp(x->chars, y->chars, x->length) == 0);
+        }
+        default: return true;
+    }
+}
+
+static MemoEntry* find(Memo* m, uint64_t hash, uint64_t present, const Value* key, int key_count) {
+    if (!m->buckets) return NULL;
+    for (MemoEntry* e = m->buckets[hash & m->mask]; e; e = e->next_in_bucket) {
+        if (e->hash != hash || e->present != present || e->key_count != key_count) continue;
+        int i = 0;
+        while (i < key_count && same_value(&e->values[i], &key[i])) i++;
+        if (i == key_count) return e;
+    }
+    return NULL;
+}
+
+static void entry_free(MemoEntry* e) {
+    for (int i = 0; i < e->key_count + e->out_count; i++) value_free(&e->values[i]);
+    mem_free(e);
+}
+
+static void lru_unlink(Memo* m, MemoEntry* e) {
+    if (e->newer) e->newer->older = e->older; else m->newest = e->older;
+    if (e->older) e->older->newer = e->newer; else m->oldest = e->newer;
+}
+
+static void lru_push(Memo* m, MemoEntry* e) {
+    e->newer = NULL;
+    e->older = m->newest;
+    if (m->newest) m->newest->newer = e; else m->oldest = e;
+    m->newest = e;
+}
+
+static void evict_oldest(Memo* m) {
+    MemoEntry* e = m->oldest;
+    lru_unlink(m, e);
+    MemoEntry** link = &m->buckets[e->hash & m->mask];
+    while (*link != e) link = &(*link)->next_in_bucket;
+    *link = e->next_in_bucket;
+    m->count--;
+    STAT_ADD(memo_evictions, 1);
+    entry_free(e);
+}
+
+bool memo_begin(Interpreter* in, FunctionDef* def, int argc, const Value* argv, MemoCall* call) {
+    call->memo = NULL;
+    Memo* m = def->memo;
+    if (!m || m->generation != in->functions.count) m = analyse(in, def);
+    if (!m->cached || argc != def->param_count) return false;
+    Value key[MAX_ARGS + MAX_NAMES];
+    int n = 0;
+    for (int i = 0; i < argc; i++) {
+        if (!is_scalar(&argv[i])) { STAT_ADD(memo_uncached, 1); return false; }
+        key[n++] = argv[i];
+    }
+    uint64_t present = 0;
+    int outputs = 0;
+    for (int i = 0; i < m->name_count; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        Value v;
+        if (!env_get(in->globals, m->names[i], &v)) continue;
+        present |= bit;
+        if (m->outputs & bit) outputs++;
+        if (!(m->inputs & bit)) continue;
+        if (!is_scalar(&v)) { STAT_ADD(memo_uncached, 1); return false; }
+        key[n++] = v;
+    }
+    uint64_t hash = mix(0xcbf29ce484222325ull, present);
+    for (int i = 0; i < n; i++) hash = hash_value(hash, &key[i]);
+
+    MemoEntry* e = find(m, hash, present, key, n);
+    if (e) {
+        STAT_ADD(memo_hits, 1);
+        lru_unlink(m, e);
+        lru_push(m, e);
+        const Value* out = &e->values[e->key_count];
+        for (int i = 0; i < m->name_count; i++)
+            if (m->outputs & present & ((uint64_t)1 << i)) env_assign(in->globals, m->names[i], value_clone(out++));
+        return true;
+    }
+    STAT_ADD(memo_misses, 1);
+    // The arguments are about to move into the callee's scope: the key
+    // keeps references of its own
+    e = (MemoEntry*)mem_alloc(sizeof(MemoEntry) + sizeof(Value) * (size_t)(n + outputs));
+    e->hash = hash;
+    e->present = present;
+    e->key_count = n;
+    e->out_count = outputs;
+    for (int i = 0; i < n; i++) e->values[i] = value_clone(&key[i]);
+    for (int i = n; i < n + outputs; i++) e->values[i] = value_null();
+    call->memo = m;
+    call->entry = e;
+    return false;
+}
+
+void memo_end(Interpreter* in, MemoCall* call) {
+    Memo* m = call->memo;
+    MemoEntry* e = call->entry;
+    call->memo = NULL;
+    if (in->halted) { entry_free(e); return; }
+    Value* out = &e->values[e->key_count];
+    for (int i = 0; i < m->name_count; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        if (!(m->outputs & e->present & bit)) continue;
+        Value v;
+        if (!env_get(in->globals, m->names[i], &v) || !is_scalar(&v)) {
+            STAT_ADD(memo_uncached, 1);
+            entry_free(e);
+            return;
+        }
+        *out++ = value_clone(&v);
+    }
+    // The same call may have been recorded meanwhile by a nested one
+    if (find(m, e->hash, e->present, e->values, e->key_count)) { entry_free(e); return; }
+    if (!m->buckets) {
+        size_t size = 16;
+        while (size < memo_capacity) size *= 2;
+        m->buckets = (MemoEntry**)mem_calloc(size, sizeof(MemoEntry*));
+        m->mask = size - 1;
+    }
+    if (m->count >= memo_capacity) evict_oldest(m);
+    MemoEntry** bucket = &m->buckets[e->hash & m->mask];
+    e->next_in_bucket = *bucket;
+    *bucket = e;
+    lru_push(m, e);
+    m->count++;
+}
+
+void memo_free(Memo* m) {
+    if (!m) return;
+    for (MemoEntry* e = m->oldest; e;) {
+        MemoEntry* newer = e->newer;
+        entry_free(e);
+        e = newer;
+    }
+    mem_free(m->buckets);
+    mem_free(m->names);
+    mem_free(m);
+}
@@ -0,0 +1,45 @@
+#ifndef HYPESCRIPT_MEMO_H
+#define HYPESCRIPT_MEMO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "interp.h"
+
+// Memoized prikol calls, behind --memo.
+//
+// A prikol returns nothing: it hands results back in global variables.
+// When its body can only depend on its arguments and the globals it reads,
+// and can only change globals - no pechat, vhod, son, vremya, fajl,
+// znach/prisvoit, threads, tasks or nested prikol definitions, in it or in
+// anything it calls - a call is determined by its arguments and those
+// globals, and its whole effect is the values it leaves in the globals it
+// writes. Such calls go through a per-prikol cache with LRU eviction: a hit
+// assigns the recorded values instead of running the body, which turns
+// naive recursion like fib into one call per distinct argument.
+//
+// Which globals a prikol reads before writing them and which it always
+// writes is worked out on its first call, over everything it calls, and
+// again after a new prikol is defined. Only calls whose arguments and
+// input globals are numbers, strings, logika values or NICHTO are cached,
+// and only if the globals they leave behind are too.
+
+typedef struct Memo Memo;
+typedef struct MemoEntry MemoEntry;
+
+extern size_t memo_capacity; // cached calls per prikol; 0: memoization off
+
+// A call that missed the cache, recorded by memo_end
+typedef struct {
+    Memo* memo;
+    MemoEntry* entry;
+} MemoCall;
+
+// Before def runs with argv: true when a cached call was replayed on the
+// globals of in. Otherwise call->memo is set if the call is to be recorded.
+bool memo_begin(Interpreter* in, FunctionDef* def, int argc, const Value* argv, MemoCall* call);
+// After it ran: records what it left in the globals, unless in halted
+void memo_end(Interpreter* in, MemoCall* call);
+void memo_free(Memo* memo);
+
+#endif
@@ -0,0 +1,120 @@
+#define _XOPEN_SOURCE 700
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "module.h"
+#include "parser.h"
+#include "stats.h"
+#define MEM_KIND MEM_AST
+#include "mem.h"
+
+struct Module {
+    char* path;   // canonical
+    char* dir;
+    struct timespec mtime;
+    off_t size;
+    StmtList* program;
+    Module* next;
+};
+
+static pthread_mutex_t modules_lock = PTHREAD_MUTEX_INITIALIZER;
+static Module* modules; // newest first
+
+static char* read_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    size_t capacity = 4096, n = 0;
+    char* buf = (char*)mem_alloc(capacity);
+    size_t got;
+    while ((got = fread(buf + n, 1, capacity - n - 1, f)) > 0) {
+        n += got;
+        if (n + 1 == capacity) { capacity *= 2; buf = (char*)mem_realloc(buf, capacity); }
+    }
+    bool failed = ferror(f);
+    fclose(f);
+    if (failed) { mem_free(buf); return NULL; }
+    buf[n] = '\0';
+    return buf;
+}
+
+// Parses the file; NULL after reporting syntax errors or statements that
+// do not belong in a module
+static StmtList* parse_module(const char* path, const char* shown) {
+    char* src = read_file(path);
+    if (!src) {
+        fprintf(stderr, "podklyuchit: cannot read %s\n", shown);
+        return NULL;
+    }
+    // With every body parsed now the AST keeps no pointers into src
+    Parser p; parser_init(&p, src);
+    p.lazy = false;
+    StmtList* program = parse_program(&p);
+    mem_free(src);
+    bool ok = !p.had_error;
+    for (StmtList* it = program; it && ok; it = it->next) {
+        if (it->stmt->type == STMT_FUNC || it->stmt->type == STMT_IMPORT) continue;
+        fprintf(stderr, "podklyuchit: %s line %d: only prikol and podklyuchit belong in a module\n", shown, it->stmt->line);
+        ok = false;
+    }
+    if (!ok) {
+        if (p.had_error) fprintf(stderr, "podklyuchit: %s has syntax errors\n", shown);
+        stmt_list_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+static char* copy(const char* s, size_t n) {
+    char* out = (char*)mem_alloc(n + 1);
+    memcpy(out, s, n);
+    out[n] = '\0';
+    return out;
+}
+
+const Module* module_load(const char* dir, const char* path) {
+    char joined[PATH_MAX];
+    if (path[0] != '/' && dir) snprintf(joined, sizeof(joined), "%s/%s", dir, path);
+    else snprintf(joined, sizeof(joined), "%s", path);
+    char canonical[PATH_MAX];
+    struct stat st;
+    if (!realpath(joined, canonical) || stat(canonical, &st) != 0) {
+        fprintf(stderr, "podklyuchit: cannot open %s\n", path);
+        return NULL;
+    }
+    // Held while parsing, so that threads importing the same file at once
+    // still parse it once
+    pthread_mutex_lock(&modules_lock);
+    Module* m = modules;
+    while (m && !(strcmp(m->path, canonical) == 0 && m->size == st.st_size && m->mtime.tv_sec == st.st_mtim.tv_sec
+                  && m->mtime.tv_nsec == st.st_mtim.tv_nsec))
+        m = m->next;
+    if (m) STAT_ADD(modules_reused, 1);
+    else {
+        StmtList* program = parse_module(canonical, path);
+        if (program) {
+            STAT_ADD(modules_parsed, 1);
+            m = (Module*)mem_alloc(sizeof(Module));
+            m->path = copy(canonical, strlen(canonical));
+            m->dir = copy(canonical, (size_t)(strrchr(canonical, '/') - canonical));
+            m->mtime = st.st_mtim;
+            m->size = st.st_size;
+            m->program = program;
+            m->next = modules;
+            modules = m;
+        }
+    }
+    pthread_mutex_unlock(&modules_lock);
+    return m;
+}
+
+StmtList* module_program(const Module* m) {
+    return m->program;
+}
+
+const char* module_dir(const Module* m) {
+    return m->dir;
+}
@@ -0,0 +1,28 @@
+#ifndef HYPESCRIPT_MODULE_H
+#define HYPESCRIPT_MODULE_H
+
+#include "ast.h"
+
+// Modules: podklyuchit "lib.hype"; at the top level of a program makes the
+// prikol definitions of lib.hype available to it.
+//
+// A module file is read and parsed - every body up front - once per
+// process and kept until it exits, in a cache keyed by its canonical path
+// and shared by every interpreter and thread. Importers register its
+// definitions borrowing that AST, so a library used by many scripts of a
+// --serve server or of an embedding program is parsed once. A file changed
+// on disk is parsed again on its next import; the old AST stays, as
+// definitions made from it may still run. A module holds only prikol
+// definitions and podklyuchit of other modules.
+
+typedef struct Module Module;
+
+// The module at path, relative to dir (NULL: the working directory) unless
+// absolute; NULL, after a message on stderr, if it cannot be read or does
+// not parse
+const Module* module_load(const char* dir, const char* path);
+StmtList* module_program(const Module* m);
+// Where its own podklyuchit paths are relative to
+const char* module_dir(const Module* m);
+
+#endif
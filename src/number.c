@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "mem.h"
+
+// Shortest round-trip double formatting with Grisu2 (Loitsch, "Printing
+// Floating-Point Numbers Quickly and Accurately with Integers", 2010).
+// The digits it produces always parse back to the same double; in rare
+// cases they are one digit longer than the absolute shortest.
+
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFull
+#define DP_HIDDEN_BIT       0x0010000000000000ull
+#define DP_EXPONENT_BIAS    1075 // 0x3FF + 52
+
+// Normalized 64-bit significands and binary exponents of 10^k for
+// k = -348, -340, ..., 340.
+static const uint64_t cached_powers_f[87] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull, 0xcf42894a5dce35eaull,
+    0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull, 0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full,
+    0xbe5691ef416bd60cull, 0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull, 0xc21094364dfb5637ull,
+    0x9096ea6f3848984full, 0xd77485cb25823ac7ull, 0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull,
+    0xb23867fb2a35b28eull, 0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull, 0xb5b5ada8aaff80b8ull,
+    0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull, 0x964e858c91ba2655ull, 0xdff9772470297ebdull,
+    0xa6dfbd9fb8e5b88full, 0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull, 0xaa242499697392d3ull,
+    0xfd87b5f28300ca0eull, 0xbce5086492111aebull, 0x8cbccc096f5088ccull, 0xd1b71758e219652cull,
+    0x9c40000000000000ull, 0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull, 0x9f4f2726179a2245ull,
+    0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull, 0x83c7088e1aab65dbull, 0xc45d1df942711d9aull,
+    0x924d692ca61be758ull, 0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull, 0x952ab45cfa97a0b3ull,
+    0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull, 0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull,
+    0x88fcf317f22241e2ull, 0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull, 0x8bab8eefb6409c1aull,
+    0xd01fef10a657842cull, 0x9b10a4e5e9913129ull, 0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull,
+    0x80444b5e7aa7cf85ull, 0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+};
+
+static const int16_t cached_powers_e[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10_u64[20] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+};
+
+static DiyFp diy_from_double(double d) {
+    uint64_t bits; memcpy(&bits, &d, sizeof(bits));
+    int biased_e = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    DiyFp r;
+    if (biased_e != 0) { r.f = significand + DP_HIDDEN_BIT; r.e = biased_e - DP_EXPONENT_BIAS; }
+    else { r.f = significand; r.e = 1 - DP_EXPONENT_BIAS; }
+    return r;
+}
+
+static DiyFp diy_normalize(DiyFp x) {
+    int s = __builtin_clzll(x.f);
+    x.f <<= s; x.e -= s;
+    return x;
+}
+
+// Upper 64 bits of the 128-bit product, rounded
+static DiyFp diy_mul(DiyFp x, DiyFp y) {
+    const uint64_t M32 = 0xFFFFFFFFu;
+    uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1u << 31;
+    DiyFp r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+    return r;
+}
+
+// Boundaries m- and m+ halfway to the neighbouring doubles, sharing m+'s exponent
+static void diy_boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+    DiyFp pl = { (v.f << 1) + 1, v.e - 1 };
+    pl = diy_normalize(pl);
+    DiyFp mi;
+    if (v.f == DP_HIDDEN_BIT) { mi.f = (v.f << 2) - 1; mi.e = v.e - 2; }
+    else { mi.f = (v.f << 1) - 1; mi.e = v.e - 1; }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *minus = mi;
+    *plus = pl;
+}
+
+// Cached power c = 10^-K such that the product with a normalized value of
+// binary exponent e lands in the exponent window Grisu needs
+static DiyFp cached_power(int e, int* K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0) k++;
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    DiyFp r = { cached_powers_f[index], cached_powers_e[index] };
+    return r;
+}
+
+static int count_digits32(uint32_t n) {
+    int d = 1;
+    while (d < 10 && n >= (uint32_t)pow10_u64[d]) d++;
+    return d;
+}
+
+static void grisu_round(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void digit_gen(DiyFp W, DiyFp Mp, uint64_t delta, char* buf, int* len, int* K) {
+    DiyFp one = { 1ull << -Mp.e, Mp.e };
+    uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+    uint64_t p2 = Mp.f & (one.f - 1);
+    int kappa = count_digits32(p1);
+    *len = 0;
+
+    while (kappa > 0) {
+        uint32_t div = (uint32_t)pow10_u64[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if (d || *len) buf[(*len)++] = (char)('0' + d);
+        kappa--;
+        uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+        if (tmp <= delta) {
+            *K += kappa;
+            grisu_round(buf, *len, delta, tmp, pow10_u64[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *len) buf[(*len)++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            int index = -kappa;
+            grisu_round(buf, *len, delta, p2, one.f, wp_w * (index < 20 ? pow10_u64[index] : 0));
+            return;
+        }
+    }
+}
+
+// Digits of a positive, finite value: value = digits * 10^K
+static int grisu2(double value, char* digits, int* K) {
+    DiyFp v = diy_from_double(value);
+    DiyFp w_m, w_p;
+    diy_boundaries(v, &w_m, &w_p);
+    DiyFp c_mk = cached_power(w_p.e, K);
+    DiyFp W = diy_mul(diy_normalize(v), c_mk);
+    DiyFp Wp = diy_mul(w_p, c_mk);
+    DiyFp Wm = diy_mul(w_m, c_mk);
+    Wm.f++;
+    Wp.f--;
+    int len;
+    digit_gen(W, Wp, Wp.f - Wm.f, digits, &len, K);
+    return len;
+}
+
+static int write_uint(uint64_t n, char* out) {
+    char tmp[20];
+    int len = 0;
+    do { tmp[len++] = (char)('0' + n % 10); n /= 10; } while (n);
+    for (int i = 0; i < len; i++) out[i] = tmp[len - 1 - i];
+    return len;
+}
+
+static int write_exponent(int e, char* out) {
+    int len = 0;
+    out[len++] = 'e';
+    if (e < 0) { out[len++] = '-'; e = -e; }
+    else out[len++] = '+';
+    return len + write_uint((uint64_t)e, out + len);
+}
+
+// Lay out digits * 10^K: plain notation for decimal exponents in [-6, 21),
+// scientific notation outside of it
+static int prettify(const char* digits, int len, int K, char* out) {
+    int kk = len + K; // position of the decimal point relative to the digits
+    int n = 0;
+    if (K >= 0 && kk <= 21) {
+        memcpy(out, digits, (size_t)len); n = len;
+        for (int i = 0; i < K; i++) out[n++] = '0';
+    } else if (kk > 0 && kk <= 21) {
+        memcpy(out, digits, (size_t)kk); n = kk;
+        out[n++] = '.';
+        memcpy(out + n, digits + kk, (size_t)(len - kk)); n += len - kk;
+    } else if (kk > -6 && kk <= 0) {
+        out[n++] = '0'; out[n++] = '.';
+        for (int i = 0; i < -kk; i++) out[n++] = '0';
+        memcpy(out + n, digits, (size_t)len); n += len;
+    } else {
+        out[n++] = digits[0];
+        if (len > 1) {
+            out[n++] = '.';
+            memcpy(out + n, digits + 1, (size_t)(len - 1)); n += len - 1;
+        }
+        n += write_exponent(kk - 1, out + n);
+    }
+    return n;
+}
+
+int number_format(double value, char* out) {
+    int n = 0;
+    if (value != value) { memcpy(out, "nan", 4); return 3; }
+    if (signbit(value)) { out[n++] = '-'; value = -value; }
+    if (isinf(value)) { memcpy(out + n, "inf", 4); return n + 3; }
+    // Integer fast path: exact below 2^53, no digit generation needed
+    if (value < 9007199254740992.0 && value == (double)(uint64_t)value) {
+        n += write_uint((uint64_t)value, out + n);
+        out[n] = '\0';
+        return n;
+    }
+    char digits[20];
+    int K = 0;
+    int len = grisu2(value, digits, &K);
+    n += prettify(digits, len, K, out + n);
+    out[n] = '\0';
+    return n;
+}
+
+static const double exact_pow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_MANTISSA 9007199254740992ull // 2^53
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool match_word(const char* s, size_t length, const char* word) {
+    size_t n = strlen(word);
+    if (length < n) return false;
+    for (size_t i = 0; i < n; i++) if ((s[i] | 0x20) != word[i]) return false;
+    return true;
+}
+
+// Correctly rounded conversion for the inputs the fast path cannot do
+// exactly, pinned to the C locale so '.' is always the decimal point
+static double parse_slow(const char* s, size_t length) {
+    // Created once; a thread that loses the race frees its copy
+    static _Atomic(locale_t) shared_locale = (locale_t)0;
+    locale_t c_locale = atomic_load_explicit(&shared_locale, memory_order_acquire);
+    if (!c_locale) {
+        locale_t fresh = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+        c_locale = (locale_t)0;
+        if (atomic_compare_exchange_strong(&shared_locale, &c_locale, fresh)) c_locale = fresh;
+        else freelocale(fresh);
+    }
+    char small[128];
+    char* buf = length < sizeof(small) ? small : (char*)mem_alloc(length + 1);
+    memcpy(buf, s, length);
+    buf[length] = '\0';
+    locale_t previous = uselocale(c_locale);
+    double d = strtod(buf, NULL);
+    uselocale(previous);
+    if (buf != small) mem_free(buf);
+    return d;
+}
+
+size_t number_parse(const char* s, size_t length, double* out) {
+    const char* p = s;
+    const char* end = s + length;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) { negative = *p == '-'; p++; }
+
+    if (p < end && !is_digit(*p) && *p != '.') {
+        size_t rest = (size_t)(end - p);
+        if (match_word(p, rest, "nan")) { *out = negative ? -NAN : NAN; return (size_t)(p - s) + 3; }
+        if (match_word(p, rest, "infinity")) { *out = negative ? -INFINITY : INFINITY; return (size_t)(p - s) + 8; }
+        if (match_word(p, rest, "inf")) { *out = negative ? -INFINITY : INFINITY; return (size_t)(p - s) + 3; }
+        return 0;
+    }
+
+    // Up to 19 significant digits fit a uint64_t; later ones only shift the
+    // exponent, and a non-zero one among them sends us to the slow path
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exp10 = 0;
+    bool any_digit = false, truncated = false;
+    for (; p < end && is_digit(*p); p++) {
+        any_digit = true;
+        int d = *p - '0';
+        if (significant < 19) { if (mantissa || d) { mantissa = mantissa * 10 + (uint64_t)d; significant++; } }
+        else { exp10++; truncated |= d != 0; }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && is_digit(*p); p++) {
+            any_digit = true;
+            int d = *p - '0';
+            if (significant < 19) {
+                if (mantissa || d) { mantissa = mantissa * 10 + (uint64_t)d; significant++; }
+                exp10--;
+            } else {
+                truncated |= d != 0;
+            }
+        }
+    }
+    if (!any_digit) return 0;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool exp_negative = false;
+        if (q < end && (*q == '+' || *q == '-')) { exp_negative = *q == '-'; q++; }
+        if (q < end && is_digit(*q)) {
+            int e = 0;
+            for (; q < end && is_digit(*q); q++) if (e < 100000) e = e * 10 + (*q - '0');
+            exp10 += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+    size_t consumed = (size_t)(p - s);
+
+    // Clinger's fast path: an exact mantissa times or divided by an exact
+    // power of ten is a single correctly rounded operation
+    if (!truncated && mantissa <= MAX_EXACT_MANTISSA) {
+        double m = (double)mantissa;
+        double d;
+        bool exact = true;
+        if (mantissa == 0) d = 0;
+        else if (exp10 == 0) d = m;
+        else if (exp10 > 0 && exp10 <= 22) d = m * exact_pow10[exp10];
+        else if (exp10 < 0 && exp10 >= -22) d = m / exact_pow10[-exp10];
+        else if (exp10 > 22 && exp10 <= 22 + 15) {
+            // Move the surplus power onto the mantissa while it stays exact
+            uint64_t scaled = mantissa;
+            for (int i = 22; i < exp10 && scaled <= MAX_EXACT_MANTISSA; i++) scaled *= 10;
+            exact = scaled <= MAX_EXACT_MANTISSA;
+            d = (double)scaled * 1e22;
+        } else {
+            exact = false;
+            d = 0;
+        }
+        if (exact) { *out = negative ? -d : d; return consumed; }
+    }
+    *out = parse_slow(s, consumed);
+    return consumed;
+}
@@ -0,0 +1,22 @@
+#ifndef HYPESCRIPT_NUMBER_H
+#define HYPESCRIPT_NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest text number_format can produce, including the terminating NUL
+#define NUMBER_FORMAT_MAX 32
+
+// Writes the shortest decimal text that reads back as exactly `value`
+// (integers without a fraction, nan/inf/-inf for the special values) and
+// returns its length.
+int number_format(double value, char* out);
+
+// Parses a number at the start of s[0..length): optional sign, digits with
+// an optional fraction and exponent, or inf/infinity/nan. Independent of
+// the current locale. Returns the characters consumed, 0 if there is no
+// number (*out is then left untouched).
+size_t number_parse(const char* s, size_t length, double* out);
+
+#endif
+
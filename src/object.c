@@ -0,0 +1,16 @@
+#include "object.h"
+
+void object_init(Object* o, const ObjectType* type) {
+    atomic_init(&o->refcount, 1);
+    o->type = type;
+}
+
+Object* object_retain(Object* o) {
+    if (o) atomic_fetch_add_explicit(&o->refcount, 1, memory_order_relaxed);
+    return o;
+}
+
+void object_release(Object* o) {
+    if (!o || atomic_fetch_sub_explicit(&o->refcount, 1, memory_order_acq_rel) != 1) return;
+    o->type->destroy(o);
+}
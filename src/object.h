@@ -0,0 +1,25 @@
+#ifndef HYPESCRIPT_OBJECT_H
+#define HYPESCRIPT_OBJECT_H
+
+#include <stdatomic.h>
+#include "value.h"
+
+// Native handle such as a channel or a thread (see thread.h). Unlike
+// strings, arrays and maps, an object can be reachable from several
+// interpreter threads at once, so its reference count is atomic. Objects
+// compare by identity, print as <name> and cannot be map keys.
+typedef struct ObjectType {
+    const char* name;
+    void (*destroy)(Object* o); // frees the object itself too
+} ObjectType;
+
+struct Object {
+    atomic_int refcount;
+    const ObjectType* type;
+};
+
+void object_init(Object* o, const ObjectType* type); // refcount 1
+Object* object_retain(Object* o);
+void object_release(Object* o);
+
+#endif
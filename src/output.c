@@ -0,0 +1,100 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "mem.h"
+
+static Output stdout_writer;
+static bool stdout_ready = false;
+
+static void flush_stdout_at_exit(void) {
+    output_flush(&stdout_writer);
+}
+
+Output* output_stdout(void) {
+    if (!stdout_ready) {
+        output_init(&stdout_writer, STDOUT_FILENO, isatty(STDOUT_FILENO) ? OUTPUT_LINE : OUTPUT_BLOCK, OUTPUT_DEFAULT_BLOCK);
+        atexit(flush_stdout_at_exit);
+        stdout_ready = true;
+    }
+    return &stdout_writer;
+}
+
+void output_init(Output* o, int fd, OutputMode mode, size_t block_size) {
+    o->fd = fd;
+    o->buf = NULL;
+    o->length = 0;
+    o->capacity = 0;
+    o->failed = false;
+    output_configure(o, mode, block_size);
+}
+
+void output_free(Output* o) {
+    output_flush(o);
+    mem_free(o->buf);
+    o->buf = NULL;
+    o->capacity = 0;
+}
+
+void output_configure(Output* o, OutputMode mode, size_t block_size) {
+    output_flush(o);
+    if (block_size < 512) block_size = 512;
+    if (block_size != o->capacity) {
+        mem_free(o->buf);
+        o->buf = (char*)mem_alloc(block_size);
+        o->capacity = block_size;
+    }
+    o->mode = mode;
+}
+
+bool output_parse_mode(const char* spec, OutputMode* mode, size_t* block_size) {
+    if (strcmp(spec, "none") == 0) { *mode = OUTPUT_UNBUFFERED; return true; }
+    if (strcmp(spec, "line") == 0) { *mode = OUTPUT_LINE; return true; }
+    if (strcmp(spec, "block") == 0) { *mode = OUTPUT_BLOCK; return true; }
+    char* end;
+    unsigned long long n = strtoull(spec, &end, 10);
+    if (end == spec) return false;
+    if (*end == 'k' || *end == 'K') { n *= 1024; end++; }
+    else if (*end == 'm' || *end == 'M') { n *= 1024 * 1024; end++; }
+    if (*end != '\0' || n == 0) return false;
+    *mode = OUTPUT_BLOCK;
+    *block_size = (size_t)n;
+    return true;
+}
+
+static void write_fully(Output* o, const char* s, size_t n) {
+    while (n > 0 && !o->failed) {
+        ssize_t w = write(o->fd, s, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            o->failed = true;
+            break;
+        }
+        s += w;
+        n -= (size_t)w;
+    }
+}
+
+void output_flush(Output* o) {
+    if (o->length) write_fully(o, o->buf, o->length);
+    o->length = 0;
+}
+
+void output_write(Output* o, const char* s, size_t n) {
+    if (o->failed) return;
+    if (o->length + n > o->capacity) {
+        output_flush(o);
+        if (n >= o->capacity) { write_fully(o, s, n); return; }
+    }
+    memcpy(o->buf + o->length, s, n);
+    o->length += n;
+    if (o->mode == OUTPUT_UNBUFFERED) output_flush(o);
+}
+
+void output_end_line(Output* o) {
+    output_write(o, "\n", 1);
+    if (o->mode == OUTPUT_LINE) output_flush(o);
+}
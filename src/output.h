@@ -0,0 +1,48 @@
+#ifndef HYPESCRIPT_OUTPUT_H
+#define HYPESCRIPT_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Buffered writer on top of write(2), used for everything pechat prints.
+// Flush policies:
+//   OUTPUT_UNBUFFERED - every write goes straight to the descriptor
+//   OUTPUT_LINE       - flushed at the end of each printed line
+//   OUTPUT_BLOCK      - flushed only when the block is full
+// Independent of the policy, the buffer is flushed by sbros(), before vhod
+// has to wait for more input (see Input.tie), and at exit.
+typedef enum {
+    OUTPUT_UNBUFFERED,
+    OUTPUT_LINE,
+    OUTPUT_BLOCK
+} OutputMode;
+
+#define OUTPUT_DEFAULT_BLOCK (64 * 1024)
+
+typedef struct {
+    int fd;
+    OutputMode mode;
+    char* buf;
+    size_t length;
+    size_t capacity;
+    bool failed; // a write failed (e.g. closed pipe); later output is dropped
+} Output;
+
+// Process-wide writer for stdout, flushed automatically at exit. Its mode
+// defaults to line buffering on a terminal and block buffering otherwise.
+Output* output_stdout(void);
+
+// A writer for any descriptor; output_free flushes it and frees the buffer
+void output_init(Output* o, int fd, OutputMode mode, size_t block_size);
+void output_free(Output* o);
+
+void output_configure(Output* o, OutputMode mode, size_t block_size);
+// Parses "none", "line", "block" or a block size such as "256k" / "1m"
+bool output_parse_mode(const char* spec, OutputMode* mode, size_t* block_size);
+
+void output_write(Output* o, const char* s, size_t n);
+void output_end_line(Output* o);
+void output_flush(Output* o);
+
+#endif
+
@@ -0,0 +1,280 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "budget.h"
+#include "stats.h"
+#include "thread.h"
+#include "token.h"
+#include "mem.h"
+
+#define MAX_WORKERS 256
+#define CHUNKS_PER_WORKER 16 // a share is taken in about this many pieces
+
+typedef struct Loop Loop;
+
+typedef struct {
+    // Iterations [next, end) of this worker's share; the owner takes from
+    // the front, thieves from the back, both under the lock
+    _Alignas(64) pthread_mutex_t lock;
+    uint64_t next;
+    uint64_t end;
+    int index;
+    Loop* loop;
+    pthread_t id;
+    Interpreter in;
+    Output out;
+    Input input;
+    double* results; // the reduction variables at the end
+    bool* has_result;
+} Worker;
+
+struct Loop {
+    const StmtFor* s;
+    const char* var;
+    double start;
+    double step;
+    uint64_t grain;
+    Worker* workers;
+    int count;
+    atomic_bool stop; // set by slomat
+};
+
+static bool in_range(int op, double x, double limit) {
+    switch (op) {
+        case TOK_LESS: return x < limit;
+        case TOK_LESS_EQUAL: return x <= limit;
+        case TOK_GREATER: return x > limit;
+        default: return x >= limit;
+    }
+}
+
+// Number of iterations of the header, or false if it would never end
+static bool iteration_count(int op, double start, double limit, double step, uint64_t* count) {
+    *count = 0;
+    if (!in_range(op, start, limit)) return true;
+    bool up = op == TOK_LESS || op == TOK_LESS_EQUAL;
+    if (step == 0 || (step > 0) != up) return false;
+    double n = floor((limit - start) / step);
+    if (!(n < 9007199254740992.0)) return false; // 2^53, or NaN
+    uint64_t c = (uint64_t)n + 1;
+    // Division rounds; settle the exact count on the values the loop sees
+    while (c > 0 && !in_range(op, start + (double)(c - 1) * step, limit)) c--;
+    while (in_range(op, start + (double)c * step, limit)) c++;
+    *count = c;
+    return true;
+}
+
+static int worker_count(const Interpreter* in, uint64_t iterations) {
+    if (in->worker) return 1;
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* env = getenv("HYPESCRIPT_THREADS");
+    if (env && atoi(env) > 0) n = atoi(env);
+    if (n < 1) n = 1;
+    if (n > MAX_WORKERS) n = MAX_WORKERS;
+    if ((uint64_t)n > iterations) n = (long)iterations;
+    return (int)n;
+}
+
+// The worker sees the same prikol definitions as `from`, borrowing their
+// parameters and bodies; bodies still unparsed are parsed by the worker
+static void copy_functions(Functions* to, const Functions* from) {
+    FunctionDef** defs = (FunctionDef**)mem_alloc(sizeof(FunctionDef*) * (from->count ? from->count : 1));
+    size_t n = 0;
+    for (FunctionDef* d = from->head; d; d = d->next) defs[n++] = d;
+    while (n > 0) {
+        const FunctionDef* d = defs[--n];
+        FunctionDef* def = funcs_register(to, d->name, d->params, d->param_count, d->body);
+        def->origin = d->origin;
+        def->lazy_body = d->lazy_body;
+        def->lazy_line = d->lazy_line;
+        def->lazy_column = d->lazy_column;
+    }
+    mem_free(defs);
+}
+
+static double reduce_identity(ReduceOp op) {
+    return op == REDUCE_SUM ? 0 : op == REDUCE_MIN ? INFINITY : -INFINITY;
+}
+
+static double reduce(ReduceOp op, double a, double b) {
+    switch (op) {
+        case REDUCE_SUM: return a + b;
+        case REDUCE_MIN: return b < a ? b : a;
+        default: return b > a ? b : a;
+    }
+}
+
+static void worker_init(Worker* w, Loop* loop, Interpreter* parent, Env* env) {
+    pthread_mutex_init(&w->lock, NULL);
+    w->loop = loop;
+    output_init(&w->out, parent->out->fd, parent->out->mode == OUTPUT_UNBUFFERED ? OUTPUT_UNBUFFERED : OUTPUT_LINE,
+                OUTPUT_DEFAULT_BLOCK);
+    input_init(&w->input, -1, 512);
+    w->input.eof = true;
+    interpreter_init_io(&w->in, &w->out, &w->input);
+    env_free(w->in.globals);
+    w->in.globals = env_transfer(env);
+    w->in.program = parent->program;
+    w->in.worker = true;
+    copy_functions(&w->in.functions, &parent->functions);
+    const StmtFor* s = loop->s;
+    for (int r = 0; r < s->reduction_count; r++) {
+        Value start = value_number(reduce_identity(s->reductions[r].op));
+        if (!env_assign(w->in.globals, s->reductions[r].name, start)) env_set(w->in.globals, s->reductions[r].name, start);
+    }
+    w->results = (double*)mem_alloc(sizeof(double) * (size_t)(s->reduction_count ? s->reduction_count : 1));
+    w->has_result = (bool*)mem_calloc((size_t)(s->reduction_count ? s->reduction_count : 1), sizeof(bool));
+}
+
+static void worker_free(Worker* w) {
+    interpreter_free(&w->in);
+    output_free(&w->out);
+    input_free(&w->input);
+    pthread_mutex_destroy(&w->lock);
+    mem_free(w->results);
+    mem_free(w->has_result);
+}
+
+// Next chunk of the worker's own share
+static bool take(Worker* w, uint64_t* lo, uint64_t* hi) {
+    pthread_mutex_lock(&w->lock);
+    bool got = w->next < w->end;
+    if (got) {
+        *lo = w->next;
+        *hi = w->end - w->next > w->loop->grain ? w->next + w->loop->grain : w->end;
+        w->next = *hi;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return got;
+}
+
+// Moves the back half of some other worker's share into w's, which is
+// empty; false when there is nothing left anywhere
+static bool steal(Worker* w) {
+    Loop* loop = w->loop;
+    for (int k = 1; k < loop->count; k++) {
+        Worker* victim = &loop->workers[(w->index + k) % loop->count];
+        uint64_t lo = 0, hi = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            lo = victim->next + (victim->end - victim->next) / 2;
+            hi = victim->end;
+            victim->end = lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (lo < hi) {
+            pthread_mutex_lock(&w->lock);
+            w->next = lo;
+            w->end = hi;
+            pthread_mutex_unlock(&w->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    Loop* loop = w->loop;
+    Interpreter* in = &w->in;
+    Env* local = env_create(in->globals);
+    env_set(local, loop->var, value_null());
+    uint64_t lo, hi;
+    while (!atomic_load_explicit(&loop->stop, memory_order_relaxed)) {
+        if (!take(w, &lo, &hi)) {
+            if (!steal(w)) break;
+            continue;
+        }
+        for (uint64_t i = lo; i < hi; i++) {
+            env_assign(local, loop->var, value_number(loop->start + (double)i * loop->step));
+            in->signaled_continue = 0;
+            interpret_exec(in, local, loop->s->body);
+            if (in->signaled_break || in->halted || (--in->steps_left <= 0 && budget_check(in, loop->s->body))) {
+                in->signaled_break = 0;
+                atomic_store_explicit(&loop->stop, true, memory_order_relaxed);
+                break;
+            }
+        }
+    }
+    in->signaled_continue = 0;
+    env_free(local);
+    for (int r = 0; r < loop->s->reduction_count; r++) {
+        Value v;
+        w->has_result[r] = env_get(in->globals, loop->s->reductions[r].name, &v) && v.type == VAL_NUMBER;
+        if (w->has_result[r]) w->results[r] = v.data.as_number;
+    }
+    output_flush(&w->out);
+    if (w->index > 0) stats_merge(); // the first worker is the calling thread
+    return NULL;
+}
+
+void parallel_for(Interpreter* in, Env* env, StmtFor* s) {
+    Expr* init = s->init->as.expr.expr;
+    Loop loop;
+    loop.s = s;
+    loop.var = init->as.assign.name;
+    // The bounds and the step may refer to the loop variable's start value
+    Env* header = env_create(env);
+    Value a = interpret_eval(in, env, init->as.assign.value);
+    env_set(header, loop.var, value_clone(&a));
+    Value b = interpret_eval(in, header, s->condition->as.binary.right);
+    Value k = interpret_eval(in, header, s->increment->as.assign.value->as.binary.right);
+    env_free(header);
+    bool numeric = a.type == VAL_NUMBER && b.type == VAL_NUMBER && k.type == VAL_NUMBER;
+    uint64_t iterations = 0;
+    bool finite = true;
+    if (numeric) {
+        loop.start = a.data.as_number;
+        loop.step = s->increment->as.assign.value->as.binary.op == TOK_MINUS ? -k.data.as_number : k.data.as_number;
+        finite = iteration_count(s->condition->as.binary.op, loop.start, b.data.as_number, loop.step, &iterations);
+    }
+    value_free(&a); value_free(&b); value_free(&k);
+    if (!numeric) { fprintf(stderr, "dlya parallelno: the start, end and step must be numbers\n"); return; }
+    if (!finite) { fprintf(stderr, "dlya parallelno: the loop would never end\n"); return; }
+    if (iterations == 0) return;
+
+    loop.count = worker_count(in, iterations);
+    loop.grain = iterations / ((uint64_t)loop.count * CHUNKS_PER_WORKER);
+    if (loop.grain == 0) loop.grain = 1;
+    atomic_init(&loop.stop, false);
+    Worker* workers = NULL;
+    if (posix_memalign((void**)&workers, 64, sizeof(Worker) * (size_t)loop.count) != 0) return;
+    loop.workers = workers;
+    for (int i = 0; i < loop.count; i++) {
+        Worker* w = &workers[i];
+        w->index = i;
+        w->next = iterations * (uint64_t)i / (uint64_t)loop.count;
+        w->end = iterations * (uint64_t)(i + 1) / (uint64_t)loop.count;
+        worker_init(w, &loop, in, env);
+    }
+    // What was printed so far comes before anything the workers print
+    output_flush(in->out);
+    // The first share is worked on this thread, which waits anyway. Shares
+    // of workers that could not be started are stolen by the others.
+    int started = 1;
+    for (; started < loop.count; started++)
+        if (pthread_create(&workers[started].id, NULL, worker_main, &workers[started]) != 0) break;
+    worker_main(&workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(workers[i].id, NULL);
+
+    for (int i = 0; i < loop.count; i++)
+        if (workers[i].in.halted) { in->halted = true; in->steps_left = 0; }
+    for (int r = 0; r < s->reduction_count; r++) {
+        const Reduction* red = &s->reductions[r];
+        Value current;
+        double result = env_get(env, red->name, &current) && current.type == VAL_NUMBER
+            ? current.data.as_number : reduce_identity(red->op);
+        for (int i = 0; i < loop.count; i++)
+            if (workers[i].has_result[r]) result = reduce(red->op, result, workers[i].results[r]);
+        if (!env_assign(env, red->name, value_number(result))) env_set(env, red->name, value_number(result));
+    }
+    for (int i = 0; i < loop.count; i++) worker_free(&workers[i]);
+    free(workers); // from posix_memalign, outside the accounted heap
+}
@@ -0,0 +1,26 @@
+#ifndef HYPESCRIPT_PARALLEL_H
+#define HYPESCRIPT_PARALLEL_H
+
+#include "interp.h"
+
+// dlya parallelno (i = a; i < b; i = i + k; summa s, maksimum m) body
+//
+// a, b and k are evaluated once, before the loop, and the iterations are
+// shared out among worker threads: one per CPU, or $HYPESCRIPT_THREADS.
+// Each worker takes small chunks from the front of its own share and,
+// when that is empty, steals the back half of another's, so uneven
+// iterations still keep every worker busy.
+//
+// A worker runs the body in an interpreter of its own, on a private deep
+// copy of every variable visible at the loop, so iterations never race:
+// assignments to outer variables are lost when the loop ends, except for
+// the reduction variables. Each worker's copy of those starts at 0
+// (summa), +inf (minimum) or -inf (maksimum), and afterwards the copies are
+// combined into the variable: summa adds them to it, minimum and maksimum
+// keep the extreme. Channels are shared, so a kanal can collect other
+// results. Iterations run in no particular order; slomat stops every
+// worker after its current iteration. Parallel loops inside a parallel
+// loop run on the worker that reaches them.
+void parallel_for(Interpreter* in, Env* env, StmtFor* loop);
+
+#endif
@@ -3,6 +3,8 @@
 #include <string.h>
 
 #include "parser.h"
+#define MEM_KIND MEM_AST
+#include "mem.h"
 
 static void advance(Parser* p) {
     token_free(&p->previous);
@@ -17,11 +19,18 @@ static int match(Parser* p, TokenType t) {
     return 0;
 }
 
+// Reports to on_error, or to stderr. Only the first error of a statement
+// is reported: the ones after it usually follow from it.
+static void error_at(Parser* p, int line, int column, const char* msg) {
+    p->had_error = 1;
+    if (p->panicking) return;
+    p->panicking = true;
+    if (p->on_error) p->on_error(p->error_ctx, line, column, msg);
+    else fprintf(stderr, "Parse error at line %d col %d: %s\n", line, column, msg);
+}
+
 static void consume(Parser* p, TokenType t, const char* msg) {
-    if (!match(p, t)) {
-        fprintf(stderr, "Parse error at line %d col %d: %s\n", p->current.line, p->current.column, msg);
-        p->had_error = 1;
-    }
+    if (!match(p, t)) error_at(p, p->current.line, p->current.column, msg);
 }
 
 static Expr* parse_expression(Parser* p);
@@ -29,15 +38,39 @@ static Stmt* parse_statement(Parser* p);
 static Stmt* parse_declaration(Parser* p);
 
 void parser_init(Parser* p, const char* source) {
-    lexer_init(&p->lexer, source);
+    parser_init_at(p, source, 1, 1);
+}
+
+void parser_init_at(Parser* p, const char* source, int line, int column) {
+    lexer_init_at(&p->lexer, source, line, column);
     p->current.type = TOK_ERROR;
     p->current.lexeme = NULL;
     p->previous.type = TOK_ERROR;
     p->previous.lexeme = NULL;
     p->had_error = 0;
+    p->panicking = false;
+    p->lazy = false;
+    p->on_error = NULL;
+    p->error_ctx = NULL;
     advance(p);
 }
 
+// Comma-separated expressions up to (not including) the closing token
+static Expr** parse_expression_list(Parser* p, TokenType close, int* out_count) {
+    Expr** items = NULL; int count = 0; int capacity = 0;
+    if (!check(p, close)) {
+        do {
+            if (count == capacity) {
+                capacity = capacity < 4 ? 4 : capacity * 2;
+                items = (Expr**)mem_realloc(items, sizeof(Expr*) * capacity);
+            }
+            items[count++] = parse_expression(p);
+        } while (match(p, TOK_COMMA));
+    }
+    *out_count = count;
+    return items;
+}
+
 // Pratt parser precedence
 static Expr* parse_primary(Parser* p) {
     if (match(p, TOK_NUMBER)) return expr_literal(value_number(p->previous.number));
@@ -52,34 +85,58 @@ static Expr* parse_primary(Parser* p) {
     if (match(p, TOK_KW_ISTINA)) return expr_literal(value_bool(true));
     if (match(p, TOK_KW_LOZH)) return expr_literal(value_bool(false));
     if (match(p, TOK_KW_NICHTO)) return expr_literal(value_null());
-    fprintf(stderr, "Unexpected token at %d:%d\n", p->current.line, p->current.column);
-    p->had_error = 1;
-    return expr_literal(value_null());
-}
-
-static Expr* parse_call(Parser* p) {
-    Expr* expr = parse_primary(p);
-    // Only support built-in calls with syntax: identifier '(' args? ')'
-    while (check(p, TOK_LPAREN)) {
-        if (expr->type != EXPR_VARIABLE) break;
-        advance(p); // consume '('
-        // Collect args
-        Expr** args = NULL; int count = 0; int capacity = 0;
-        if (!check(p, TOK_RPAREN)) {
+    if (match(p, TOK_LBRACKET)) {
+        int count = 0;
+        Expr** items = parse_expression_list(p, TOK_RBRACKET, &count);
+        consume(p, TOK_RBRACKET, "] expected after array elements");
+        return expr_array(items, count);
+    }
+    if (match(p, TOK_LBRACE)) {
+        // Map literal; only reachable in expression position, statements
+        // starting with '{' are blocks
+        Expr** keys = NULL; Expr** values = NULL; int count = 0; int capacity = 0;
+        if (!check(p, TOK_RBRACE)) {
             do {
                 if (count == capacity) {
                     capacity = capacity < 4 ? 4 : capacity * 2;
-                    args = (Expr**)realloc(args, sizeof(Expr*) * capacity);
+                    keys = (Expr**)mem_realloc(keys, sizeof(Expr*) * capacity);
+                    values = (Expr**)mem_realloc(values, sizeof(Expr*) * capacity);
                 }
-                args[count++] = parse_expression(p);
+                keys[count] = parse_expression(p);
+                consume(p, TOK_COLON, ": expected after map key");
+                values[count++] = parse_expression(p);
             } while (match(p, TOK_COMMA));
         }
-        consume(p, TOK_RPAREN, ") expected after arguments");
-        Expr* call = expr_call(expr->as.variable.name, args, count);
-        // free temp variable node but keep the name used in call (duplicate there)
-        free(expr->as.variable.name);
-        free(expr);
-        expr = call;
+        consume(p, TOK_RBRACE, "} expected after map entries");
+        return expr_map(keys, values, count);
+    }
+    error_at(p, p->current.line, p->current.column, "unexpected token");
+    // Skip the token so the statement loops above always make progress
+    if (!check(p, TOK_EOF)) advance(p);
+    return expr_literal(value_null());
+}
+
+static Expr* parse_call(Parser* p) {
+    Expr* expr = parse_primary(p);
+    // Calls: identifier '(' args? ')'; indexing: expr '[' index ']'
+    for (;;) {
+        if (check(p, TOK_LPAREN) && expr->type == EXPR_VARIABLE) {
+            advance(p); // consume '('
+            int count = 0;
+            Expr** args = parse_expression_list(p, TOK_RPAREN, &count);
+            consume(p, TOK_RPAREN, ") expected after arguments");
+            Expr* call = expr_call(expr->as.variable.name, args, count);
+            // free temp variable node but keep the name used in call (duplicate there)
+            mem_free(expr->as.variable.name);
+            mem_free(expr);
+            expr = call;
+        } else if (match(p, TOK_LBRACKET)) {
+            Expr* index = parse_expression(p);
+            consume(p, TOK_RBRACKET, "] expected after index");
+            expr = expr_index(expr, index);
+        } else {
+            break;
+        }
     }
     return expr;
 }
@@ -146,14 +203,20 @@ static Expr* parse_logic(Parser* p) {
 static Expr* parse_assignment(Parser* p) {
     Expr* expr = parse_logic(p);
     if (match(p, TOK_EQUAL)) {
+        if (expr->type == EXPR_INDEX) {
+            Expr* value = parse_assignment(p);
+            Expr* assign = expr_index_assign(expr->as.index.object, expr->as.index.index, value);
+            mem_free(expr);
+            return assign;
+        }
         if (expr->type != EXPR_VARIABLE) {
-            fprintf(stderr, "Invalid assignment target at %d:%d\n", p->previous.line, p->previous.column);
-            p->had_error = 1; return expr;
+            error_at(p, p->previous.line, p->previous.column, "invalid assignment target");
+            return expr;
         }
-        char* name = expr->as.variable.name;
         Expr* value = parse_assignment(p);
-        free(expr);
-        return expr_assign(name, value);
+        Expr* assign = expr_assign(expr->as.variable.name, value);
+        expr_free(expr);
+        return assign;
     }
     return expr;
 }
@@ -162,42 +225,96 @@ static Expr* parse_expression(Parser* p) { return parse_assignment(p); }
 
 static Stmt* parse_block(Parser* p) {
     StmtList* list = NULL;
-    while (!check(p, TOK_RBRACE) && !check(p, TOK_EOF)) {
-        Stmt* s = parse_declaration(p);
-        list = stmt_list_append(list, s);
-    }
+    StmtList** tail = &list;
+    while (!check(p, TOK_RBRACE) && !check(p, TOK_EOF)) tail = stmt_list_push(tail, parse_declaration(p));
     consume(p, TOK_RBRACE, "} expected after block");
     return stmt_block(list);
 }
 
-static Stmt* parse_statement(Parser* p) {
+// summa s, minimum lo, maksimum hi: the last clause of dlya parallelno
+static Reduction* parse_reductions(Parser* p, int* out_count) {
+    Reduction* items = NULL; int count = 0; int capacity = 0;
+    do {
+        ReduceOp op;
+        if (check(p, TOK_IDENTIFIER) && strcmp(p->current.lexeme, "summa") == 0) op = REDUCE_SUM;
+        else if (check(p, TOK_IDENTIFIER) && strcmp(p->current.lexeme, "minimum") == 0) op = REDUCE_MIN;
+        else if (check(p, TOK_IDENTIFIER) && strcmp(p->current.lexeme, "maksimum") == 0) op = REDUCE_MAX;
+        else {
+            error_at(p, p->current.line, p->current.column, "summa, minimum or maksimum expected");
+            break;
+        }
+        advance(p);
+        if (!match(p, TOK_IDENTIFIER)) {
+            error_at(p, p->current.line, p->current.column, "variable name expected");
+            break;
+        }
+        if (count == capacity) { capacity = capacity < 4 ? 4 : capacity * 2; items = (Reduction*)mem_realloc(items, sizeof(Reduction) * capacity); }
+        items[count].op = op;
+        items[count].name = (char*)mem_alloc(strlen(p->previous.lexeme)+1); strcpy(items[count].name, p->previous.lexeme);
+        count++;
+    } while (match(p, TOK_COMMA));
+    *out_count = count;
+    return items;
+}
+
+// The range of a parallel loop is worked out before it starts, so the
+// header must have the shape checked by stmt_for_is_range
+static void check_parallel_header(Parser* p, const StmtFor* f, int line, int column) {
+    if (!stmt_for_is_range(f)) {
+        error_at(p, line, column, "dlya parallelno needs a header like (i = a; i < b; i = i + 1)");
+        return;
+    }
+    const char* var = f->init->as.expr.expr->as.assign.name;
+    for (int i = 0; i < f->reduction_count; i++) {
+        if (strcmp(f->reductions[i].name, var) == 0) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "the loop variable %s cannot be a reduction", var);
+            error_at(p, line, column, msg);
+        }
+    }
+}
+
+static Stmt* parse_statement_here(Parser* p) {
     if (match(p, TOK_LBRACE)) return parse_block(p);
     if (match(p, TOK_KW_PRIKOL)) {
         // prikol name(params) { ... }
         if (!match(p, TOK_IDENTIFIER)) {
-            fprintf(stderr, "Function name expected after 'prikol' at %d:%d\n", p->current.line, p->current.column);
-            p->had_error = 1; return stmt_expr(expr_literal(value_null()));
+            error_at(p, p->current.line, p->current.column, "function name expected after prikol");
+            return stmt_expr(expr_literal(value_null()));
         }
-        char* fname = (char*)malloc(strlen(p->previous.lexeme)+1); strcpy(fname, p->previous.lexeme);
+        char* fname = (char*)mem_alloc(strlen(p->previous.lexeme)+1); strcpy(fname, p->previous.lexeme);
         consume(p, TOK_LPAREN, "( expected after function name");
         char** params = NULL; int count = 0; int cap = 0;
         if (!check(p, TOK_RPAREN)) {
             do {
-                if (!match(p, TOK_IDENTIFIER)) { fprintf(stderr, "Parameter name expected at %d:%d\n", p->current.line, p->current.column); p->had_error = 1; break; }
-                if (count == cap) { cap = cap < 4 ? 4 : cap * 2; params = (char**)realloc(params, sizeof(char*) * cap); }
-                params[count] = (char*)malloc(strlen(p->previous.lexeme)+1); strcpy(params[count], p->previous.lexeme); count++;
+                if (!match(p, TOK_IDENTIFIER)) { error_at(p, p->current.line, p->current.column, "parameter name expected"); break; }
+                if (count == cap) { cap = cap < 4 ? 4 : cap * 2; params = (char**)mem_realloc(params, sizeof(char*) * cap); }
+                params[count] = (char*)mem_alloc(strlen(p->previous.lexeme)+1); strcpy(params[count], p->previous.lexeme); count++;
             } while (match(p, TOK_COMMA));
         }
         consume(p, TOK_RPAREN, ") expected after parameters");
         consume(p, TOK_LBRACE, "{ expected to start function body");
-        // Parse block body assuming LBRACE already consumed
-        // Reuse parse_block by expecting it consumes until RBRACE
-        // We need to construct a block body statement
-        // Create body as a block
-        // parse_block expects LBRACE already matched; we matched it, so call parse_block
+        if (p->lazy) {
+            // Only find the matching '}' now; the body is parsed on first call
+            Token first = p->current;
+            int depth = 1;
+            while (!check(p, TOK_EOF)) {
+                if (check(p, TOK_LBRACE)) depth++;
+                else if (check(p, TOK_RBRACE) && --depth == 0) break;
+                advance(p);
+            }
+            consume(p, TOK_RBRACE, "} expected after function body");
+            Stmt* fn = stmt_func(fname, params, count, NULL);
+            fn->as.func.lazy_body = first.start;
+            fn->as.func.lazy_line = first.line;
+            fn->as.func.lazy_column = first.column;
+            mem_free(fname);
+            return fn;
+        }
+        // parse_block expects LBRACE already matched
         Stmt* body = parse_block(p);
         Stmt* fn = stmt_func(fname, params, count, body);
-        free(fname);
+        mem_free(fname);
         return fn;
     }
     if (match(p, TOK_KW_POKA)) {
@@ -205,9 +322,7 @@ static Stmt* parse_statement(Parser* p) {
         Expr* cond = parse_expression(p);
         consume(p, TOK_RPAREN, ") expected after while condition");
         Stmt* body = parse_statement(p);
-        Stmt* w = (Stmt*)malloc(sizeof(Stmt));
-        w->type = STMT_WHILE; w->as.whilestmt.condition = cond; w->as.whilestmt.body = body;
-        return w;
+        return stmt_while(cond, body);
     }
     if (match(p, TOK_KW_SLOMAT)) { consume(p, TOK_SEMICOLON, "; expected after 'slomat'" ); return stmt_break(); }
     if (match(p, TOK_KW_PRODOLZHIT)) { consume(p, TOK_SEMICOLON, "; expected after 'prodolzhit'" ); return stmt_continue(); }
@@ -221,6 +336,10 @@ static Stmt* parse_statement(Parser* p) {
         return stmt_if(cond, thenb, elseb);
     }
     if (match(p, TOK_KW_DLYA)) {
+        // dlya parallelno (...): the name is only special right after dlya
+        int line = p->previous.line, column = p->previous.column;
+        bool parallel = check(p, TOK_IDENTIFIER) && strcmp(p->current.lexeme, "parallelno") == 0;
+        if (parallel) advance(p);
         consume(p, TOK_LPAREN, "( expected after 'dlya'");
         Stmt* init = NULL;
         if (!check(p, TOK_SEMICOLON)) {
@@ -232,10 +351,19 @@ static Stmt* parse_statement(Parser* p) {
         if (!check(p, TOK_SEMICOLON)) cond = parse_expression(p);
         consume(p, TOK_SEMICOLON, "; expected after for condition");
         Expr* inc = NULL;
-        if (!check(p, TOK_RPAREN)) inc = parse_expression(p);
+        if (!check(p, TOK_RPAREN) && !(parallel && check(p, TOK_SEMICOLON))) inc = parse_expression(p);
+        Reduction* reductions = NULL; int reduction_count = 0;
+        if (parallel && match(p, TOK_SEMICOLON)) reductions = parse_reductions(p, &reduction_count);
         consume(p, TOK_RPAREN, ") expected after for clauses");
         Stmt* body = parse_statement(p);
-        return stmt_for(init, cond, inc, body);
+        Stmt* loop = stmt_for(init, cond, inc, body);
+        if (parallel) {
+            loop->as.forstmt.parallel = true;
+            loop->as.forstmt.reductions = reductions;
+            loop->as.forstmt.reduction_count = reduction_count;
+            check_parallel_header(p, &loop->as.forstmt, line, column);
+        }
+        return loop;
     }
     if (match(p, TOK_SEMICOLON)) {
         return stmt_expr(expr_literal(value_null()));
@@ -245,18 +373,86 @@ static Stmt* parse_statement(Parser* p) {
     return stmt_expr(e);
 }
 
+// Every statement remembers where it starts, for the profiler
+static Stmt* parse_statement(Parser* p) {
+    p->panicking = false;
+    int line = p->current.line, column = p->current.column;
+    Stmt* s = parse_statement_here(p);
+    s->line = line;
+    s->column = column;
+    return s;
+}
+
 static Stmt* parse_declaration(Parser* p) {
     return parse_statement(p);
 }
 
+// nachalo / konec followed by '{' start a section; anywhere else the names
+// are ordinary identifiers. Returns the section kind or -1.
+static int section_kind(Parser* p) {
+    if (!check(p, TOK_IDENTIFIER)) return -1;
+    int kind;
+    if (strcmp(p->current.lexeme, "nachalo") == 0) kind = SECTION_BEGIN;
+    else if (strcmp(p->current.lexeme, "konec") == 0) kind = SECTION_END;
+    else return -1;
+    Lexer ahead = p->lexer;
+    Token next = lexer_next(&ahead);
+    int brace = next.type == TOK_LBRACE;
+    token_free(&next);
+    return brace ? kind : -1;
+}
+
+// podklyuchit followed by a string starts an import; anywhere else the
+// name is an ordinary identifier
+static bool import_ahead(Parser* p) {
+    if (!check(p, TOK_IDENTIFIER) || strcmp(p->current.lexeme, "podklyuchit") != 0) return false;
+    Lexer ahead = p->lexer;
+    Token next = lexer_next(&ahead);
+    bool path = next.type == TOK_STRING;
+    token_free(&next);
+    return path;
+}
+
+Stmt* parse_function_body(const char* body, int line, int column, int* had_error) {
+    Parser p;
+    parser_init_at(&p, body, line, column);
+    p.lazy = true;
+    Stmt* block = parse_block(&p);
+    token_free(&p.current);
+    token_free(&p.previous);
+    *had_error = p.had_error;
+    return block;
+}
+
+bool parse_header(Parser* p) {
+    return match(p, TOK_KW_HYPE);
+}
+
+Stmt* parse_top_level(Parser* p) {
+    Stmt* s;
+    p->panicking = false;
+    int line = p->current.line, column = p->current.column;
+    int kind = section_kind(p);
+    if (kind >= 0) {
+        advance(p); advance(p); // name and '{'
+        s = stmt_section((SectionKind)kind, parse_block(p));
+    } else if (import_ahead(p)) {
+        advance(p); advance(p); // podklyuchit and the path
+        s = stmt_import(p->previous.lexeme);
+        consume(p, TOK_SEMICOLON, "; expected after podklyuchit");
+    } else {
+        s = parse_declaration(p);
+    }
+    s->line = line;
+    s->column = column;
+    return s;
+}
+
 StmtList* parse_program(Parser* p) {
-    // Optional leading !HYPE!
-    match(p, TOK_KW_HYPE);
+    parse_header(p);
     StmtList* list = NULL;
-    while (!check(p, TOK_EOF)) {
-        Stmt* s = parse_declaration(p);
-        list = stmt_list_append(list, s);
-    }
+    StmtList** tail = &list;
+    while (!check(p, TOK_EOF)) tail = stmt_list_push(tail, parse_top_level(p));
     return list;
 }
 
@@ -3,16 +3,33 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include <stdbool.h>
 
 typedef struct {
     Lexer lexer;
     Token current;
     Token previous;
     int had_error;
+    bool panicking; // an error of the current statement was reported
+    bool lazy; // only brace-match prikol bodies, see parse_function_body
+    // Where syntax errors go instead of stderr, as in an editor
+    void (*on_error)(void* ctx, int line, int column, const char* message);
+    void* error_ctx;
 } Parser;
 
 void parser_init(Parser* p, const char* source);
+// Starts at `source` as if it were at line:column of a larger text
+void parser_init_at(Parser* p, const char* source, int line, int column);
 StmtList* parse_program(Parser* p);
+// The pieces of parse_program, for parsing a text one top-level statement
+// at a time: the optional leading !HYPE!, then statements until TOK_EOF.
+// A top-level statement depends on no text before it, so one can be
+// parsed again on its own after an edit.
+bool parse_header(Parser* p);
+Stmt* parse_top_level(Parser* p);
+// Parses a body skipped in lazy mode, from StmtFunc.lazy_body up to its
+// closing '}'. Returns the block; *had_error is set on syntax errors.
+Stmt* parse_function_body(const char* body, int line, int column, int* had_error);
 
 #endif
 
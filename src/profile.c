@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "profile.h"
+
+#define PROFILE_INTERVAL_US 1000
+#define MAX_DEPTH 64
+#define STACK_SLOTS 65536     // distinct stacks kept, a power of two
+#define SITE_SLOTS (1 << 20)  // frames of all distinct stacks together
+
+typedef struct {
+    const char* name;
+    int line;
+} Site;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t start; // first frame in sites, innermost first
+    uint32_t depth; // 0 for an empty slot
+    uint64_t count;
+} Stack;
+
+// The signal handler cannot allocate, so everything is set up front
+static struct {
+    Interpreter* in;
+    long thread; // the one running `in`
+    Frame root;
+    Stack* stacks;
+    Site* sites;
+    uint32_t sites_used;
+    uint64_t samples;
+    atomic_ullong lost; // tables full, or two threads sampled at once
+    atomic_flag busy;
+} prof = { .busy = ATOMIC_FLAG_INIT };
+
+static uint64_t hash_sites(const Site* sites, int depth) {
+    uint64_t h = 1469598103934665603ull;
+    for (int i = 0; i < depth; i++) {
+        h = (h ^ (uint64_t)(uintptr_t)sites[i].name) * 1099511628211ull;
+        h = (h ^ (uint64_t)(unsigned)sites[i].line) * 1099511628211ull;
+    }
+    return h;
+}
+
+static bool same_sites(const Site* a, const Site* b, int depth) {
+    for (int i = 0; i < depth; i++)
+        if (a[i].name != b[i].name || a[i].line != b[i].line) return false;
+    return true;
+}
+
+static void record(const Site* sites, int depth) {
+    uint64_t h = hash_sites(sites, depth);
+    for (uint32_t i = 0; i < STACK_SLOTS; i++) {
+        Stack* st = &prof.stacks[(h + i) & (STACK_SLOTS - 1)];
+        if (st->depth == 0) {
+            if (prof.sites_used + (uint32_t)depth > SITE_SLOTS) break;
+            st->hash = h;
+            st->start = prof.sites_used;
+            st->depth = (uint32_t)depth;
+            memcpy(&prof.sites[st->start], sites, sizeof(Site) * (size_t)depth);
+            prof.sites_used += (uint32_t)depth;
+        }
+        if (st->hash == h && st->depth == (uint32_t)depth &&
+            same_sites(&prof.sites[st->start], sites, depth)) {
+            st->count++;
+            prof.samples++;
+            return;
+        }
+    }
+    atomic_fetch_add_explicit(&prof.lost, 1, memory_order_relaxed);
+}
+
+static void on_sample(int sig) {
+    int saved = errno;
+    if (!atomic_flag_test_and_set_explicit(&prof.busy, memory_order_acquire)) {
+        Site sites[MAX_DEPTH];
+        int depth = 0;
+        if (syscall(SYS_gettid) == prof.thread) {
+            for (const Frame* f = prof.in->frame; f && depth < MAX_DEPTH; f = f->parent) {
+                sites[depth].name = f->name;
+                sites[depth].line = f->line;
+                depth++;
+            }
+        }
+        if (depth == 0) {
+            sites[0].name = "<potok>";
+            sites[0].line = 0;
+            depth = 1;
+        }
+        record(sites, depth);
+        atomic_flag_clear_explicit(&prof.busy, memory_order_release);
+    } else {
+        atomic_fetch_add_explicit(&prof.lost, 1, memory_order_relaxed);
+    }
+    errno = saved;
+}
+
+bool profile_start(Interpreter* in) {
+    prof.stacks = (Stack*)calloc(STACK_SLOTS, sizeof(Stack));
+    prof.sites = (Site*)malloc(sizeof(Site) * SITE_SLOTS);
+    if (!prof.stacks || !prof.sites) {
+        free(prof.stacks); free(prof.sites);
+        return false;
+    }
+    prof.in = in;
+    prof.sites_used = 0;
+    prof.samples = 0;
+    atomic_store(&prof.lost, 0);
+    prof.thread = syscall(SYS_gettid);
+    prof.root.name = "<main>";
+    prof.root.line = 0;
+    prof.root.parent = NULL;
+    in->frame = &prof.root;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sample;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    struct itimerval it;
+    it.it_interval.tv_sec = it.it_value.tv_sec = 0;
+    it.it_interval.tv_usec = it.it_value.tv_usec = PROFILE_INTERVAL_US;
+    if (sigaction(SIGPROF, &sa, NULL) != 0 || setitimer(ITIMER_PROF, &it, NULL) != 0) {
+        in->frame = NULL;
+        free(prof.stacks); free(prof.sites);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    const char* name;
+    int line;
+    uint64_t count;
+} Hot;
+
+static int by_site(const void* a, const void* b) {
+    const Hot* x = (const Hot*)a;
+    const Hot* y = (const Hot*)b;
+    int c = strcmp(x->name, y->name);
+    return c ? c : (x->line > y->line) - (x->line < y->line);
+}
+
+static int by_count(const void* a, const void* b) {
+    const Hot* x = (const Hot*)a;
+    const Hot* y = (const Hot*)b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+// Adds up the samples of equal sites and prints the `top` biggest
+static void print_hot(const char* title, Hot* hot, size_t n, int top) {
+    qsort(hot, n, sizeof(Hot), by_site);
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (m > 0 && by_site(&hot[m - 1], &hot[i]) == 0) hot[m - 1].count += hot[i].count;
+        else hot[m++] = hot[i];
+    }
+    qsort(hot, m, sizeof(Hot), by_count);
+    fprintf(stderr, "%s:\n", title);
+    for (size_t i = 0; i < m && i < (size_t)top; i++) {
+        double share = 100.0 * (double)hot[i].count / (double)prof.samples;
+        if (hot[i].line > 0) fprintf(stderr, "  %8llu %5.1f%%  %s:%d\n", (unsigned long long)hot[i].count, share, hot[i].name, hot[i].line);
+        else fprintf(stderr, "  %8llu %5.1f%%  %s\n", (unsigned long long)hot[i].count, share, hot[i].name);
+    }
+}
+
+// Where the samples were taken: the innermost site of every stack
+static size_t innermost(Hot* hot, bool lines) {
+    size_t n = 0;
+    for (size_t i = 0; i < STACK_SLOTS; i++) {
+        const Stack* st = &prof.stacks[i];
+        if (st->depth == 0) continue;
+        hot[n].name = prof.sites[st->start].name;
+        hot[n].line = lines ? prof.sites[st->start].line : 0;
+        hot[n].count = st->count;
+        n++;
+    }
+    return n;
+}
+
+void profile_stop(Interpreter* in, const char* path) {
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    signal(SIGPROF, SIG_IGN);
+    // A handler may still be finishing on another thread
+    while (atomic_flag_test_and_set_explicit(&prof.busy, memory_order_acquire)) {}
+    in->frame = NULL;
+    output_flush(in->out); // the program's output before the summary
+
+    FILE* f = fopen(path, "w");
+    size_t used = 0;
+    for (size_t i = 0; i < STACK_SLOTS; i++) {
+        const Stack* st = &prof.stacks[i];
+        if (st->depth == 0) continue;
+        used++;
+        if (!f) continue;
+        for (uint32_t j = st->depth; j-- > 0;) {
+            const Site* site = &prof.sites[st->start + j];
+            fputs(site->name, f);
+            if (site->line > 0) fprintf(f, ":%d", site->line);
+            if (j > 0) fputc(';', f);
+        }
+        fprintf(f, " %llu\n", (unsigned long long)st->count);
+    }
+    if (f) fclose(f);
+    else fprintf(stderr, "hypescript: could not write profile %s\n", path);
+
+    fprintf(stderr, "profile: %llu samples", (unsigned long long)prof.samples);
+    unsigned long long lost = atomic_load(&prof.lost);
+    if (lost) fprintf(stderr, " (%llu lost)", lost);
+    if (f) fprintf(stderr, ", stacks in %s", path);
+    fputc('\n', stderr);
+    if (prof.samples > 0) {
+        Hot* hot = (Hot*)malloc(sizeof(Hot) * used);
+        print_hot("hot lines", hot, innermost(hot, true), 10);
+        print_hot("hot prikols", hot, innermost(hot, false), 10);
+        free(hot);
+    }
+    free(prof.stacks); free(prof.sites);
+    prof.stacks = NULL; prof.sites = NULL;
+    atomic_flag_clear_explicit(&prof.busy, memory_order_release);
+}
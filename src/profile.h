@@ -0,0 +1,24 @@
+#ifndef HYPESCRIPT_PROFILE_H
+#define HYPESCRIPT_PROFILE_H
+
+#include "interp.h"
+
+// Sampling profiler behind --profile.
+//
+// Every millisecond of CPU time SIGPROF interrupts the program and the
+// handler records the chain of prikol calls the interpreter is in, with
+// the line each of them is running (Interpreter.frame). At the end the
+// samples are written in the collapsed-stack format flame graph tools
+// read, one line per distinct stack:
+//
+//     <main>:12;fib:3;fib:4 118
+//
+// and the hottest lines and prikols are summed up on stderr. Time spent
+// in potok threads is counted as <potok>; tasks start from <zadacha>.
+
+// Starts sampling `in`; false if the profiler could not be set up
+bool profile_start(Interpreter* in);
+// Stops sampling and writes the stacks to path and the summary to stderr
+void profile_stop(Interpreter* in, const char* path);
+
+#endif
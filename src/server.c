@@ -0,0 +1,313 @@
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "budget.h"
+#include "parser.h"
+#include "interp.h"
+#include "mem.h"
+
+#define SERVER_MAGIC 0x48535631u // "HSV1"
+#define SERVER_BACKLOG 64
+
+enum { REQUEST_RECORDS = 1, REQUEST_PRINT = 2 };
+
+// Sent as one SOCK_SEQPACKET message with the client's stdin, stdout and
+// stderr attached, followed by the script path
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t path_length;
+} Request;
+
+// A script kept parsed, with its functions already registered in `warm`;
+// replaced when the file changes. Each child runs the program on its own
+// copy-on-write copy of `warm`, whose globals are still empty.
+typedef struct Resident {
+    char* path;
+    char* dir;         // of path, for podklyuchit
+    struct timespec mtime;
+    off_t size;
+    StmtList* program; // NULL when the file did not parse
+    bool import_failed; // nor a podklyuchit: read again on the next request
+    Interpreter warm;
+    Output out;        // placeholders until the child attaches stdio
+    Input input;
+    struct Resident* next;
+} Resident;
+
+static void resident_clear(Resident* r) {
+    if (!r->program) return;
+    interpreter_free(&r->warm);
+    output_free(&r->out);
+    input_free(&r->input);
+    stmt_list_free(r->program);
+    r->program = NULL;
+}
+
+static bool make_address(const char* socket_path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "hypescript: socket path too long: %s\n", socket_path);
+        return false;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return true;
+}
+
+static char* read_file(const char* path, size_t* length) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    size_t capacity = 4096, n = 0;
+    char* buf = (char*)mem_alloc(capacity);
+    for (;;) {
+        if (n + 1 == capacity) { capacity *= 2; buf = (char*)mem_realloc(buf, capacity); }
+        ssize_t got = read(fd, buf + n, capacity - n - 1);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            close(fd);
+            if (got < 0) { mem_free(buf); return NULL; }
+            break;
+        }
+        n += (size_t)got;
+    }
+    buf[n] = '\0';
+    *length = n;
+    return buf;
+}
+
+// The parsed program for path, parsing it if it is new or has changed.
+// Syntax errors go to the current stderr, which is the client's.
+static Resident* resident_get(Resident** list, const char* path, bool* ok) {
+    struct stat st;
+    *ok = false;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Target file doesn't exists!\n");
+        return NULL;
+    }
+    Resident* r = *list;
+    while (r && strcmp(r->path, path) != 0) r = r->next;
+    if (r && !r->import_failed && r->mtime.tv_sec == st.st_mtim.tv_sec && r->mtime.tv_nsec == st.st_mtim.tv_nsec && r->size == st.st_size) {
+        // Errors were reported to whoever asked first; report them again
+        if (!r->program) fprintf(stderr, "hypescript: %s has syntax errors\n", path);
+        *ok = r->program != NULL;
+        return r;
+    }
+    size_t length;
+    char* src = read_file(path, &length);
+    if (!src) {
+        fprintf(stderr, "Failed to read file\n");
+        return NULL;
+    }
+    // Every body is parsed now so that children never parse anything
+    Parser p; parser_init(&p, src);
+    p.lazy = false;
+    StmtList* program = parse_program(&p);
+    mem_free(src);
+    if (p.had_error) { stmt_list_free(program); program = NULL; }
+    if (!r) {
+        r = (Resident*)mem_calloc(1, sizeof(Resident));
+        r->path = (char*)mem_alloc(strlen(path) + 1);
+        strcpy(r->path, path);
+        size_t dir_length = (size_t)(strrchr(path, '/') - path);
+        r->dir = (char*)mem_alloc(dir_length + 1);
+        memcpy(r->dir, path, dir_length);
+        r->dir[dir_length] = '\0';
+        r->next = *list;
+        *list = r;
+    }
+    resident_clear(r);
+    r->program = program;
+    r->import_failed = false;
+    if (program) {
+        output_init(&r->out, -1, OUTPUT_BLOCK, OUTPUT_DEFAULT_BLOCK);
+        input_init(&r->input, -1, 512);
+        interpreter_init_io(&r->warm, &r->out, &r->input);
+        r->warm.dir = r->dir;
+        // A missing or broken module may be fixed without touching the script
+        r->import_failed = !interpret_define(&r->warm, program);
+        if (r->import_failed) resident_clear(r);
+    }
+    r->mtime = st.st_mtim;
+    r->size = st.st_size;
+    *ok = r->program != NULL;
+    return r;
+}
+
+static void send_status(int conn, int32_t status) {
+    while (send(conn, &status, sizeof(status), MSG_NOSIGNAL) < 0 && errno == EINTR) {}
+}
+
+// Receives one request; the client's descriptors are returned in fds
+static bool receive_request(int conn, Request* req, char* path, int fds[3]) {
+    char data[sizeof(Request) + PATH_MAX];
+    union { struct cmsghdr align; char buf[CMSG_SPACE(3 * sizeof(int))]; } control;
+    struct iovec iov = { data, sizeof(data) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    while ((n = recvmsg(conn, &msg, 0)) < 0 && errno == EINTR) {}
+    fds[0] = fds[1] = fds[2] = -1;
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(3 * sizeof(int)))
+        memcpy(fds, CMSG_DATA(c), 3 * sizeof(int));
+    if (n < (ssize_t)sizeof(Request) || fds[0] < 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) return false;
+    memcpy(req, data, sizeof(*req));
+    if (req->magic != SERVER_MAGIC || req->path_length == 0 || req->path_length >= PATH_MAX
+        || (size_t)n != sizeof(Request) + req->path_length) return false;
+    memcpy(path, data + sizeof(Request), req->path_length);
+    path[req->path_length] = '\0';
+    return true;
+}
+
+// The child's connection, for a runtime error that ends it through exit()
+static int child_conn = -1;
+
+static void report_exit(void) {
+    if (child_conn >= 0) send_status(child_conn, 1);
+}
+
+// In the forked child: the client's descriptors become 0, 1 and 2, so the
+// interpreter and every error message use them as if started directly
+static void run_child(int conn, const Request* req, Resident* r, int fds[3]) {
+    child_conn = conn;
+    atexit(report_exit);
+    for (int i = 0; i < 3; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    Interpreter* in = &r->warm;
+    in->out = output_stdout();
+    in->input = input_stdin();
+    in->input->tie = in->out;
+    // The limits count from this request, on counters of its own
+    budget_restart();
+    budget_init(in);
+    bool ran;
+    if (req->flags & REQUEST_RECORDS) ran = interpret_records(in, r->program, (req->flags & REQUEST_PRINT) != 0);
+    else ran = interpret(in, r->program);
+    output_flush(in->out);
+    int status = !ran || budget_breached() ? 1 : 0;
+    send_status(conn, status);
+    _exit(status);
+}
+
+static void serve(int conn, Resident** residents) {
+    Request req;
+    char path[PATH_MAX];
+    int fds[3];
+    if (!receive_request(conn, &req, path, fds)) {
+        for (int i = 0; i < 3; i++) if (fds[i] >= 0) close(fds[i]);
+        send_status(conn, 1);
+        return;
+    }
+    // Parse errors are for the client's stderr, not the server's
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(fds[2], STDERR_FILENO);
+    bool ok;
+    Resident* r = resident_get(residents, path, &ok);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    pid_t pid = ok ? fork() : -1;
+    if (pid == 0) run_child(conn, &req, r, fds);
+    if (pid < 0) {
+        if (ok) perror("hypescript: fork");
+        send_status(conn, 1);
+    }
+    for (int i = 0; i < 3; i++) close(fds[i]);
+}
+
+int server_run(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (!make_address(socket_path, &addr)) return 1;
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (listener < 0) { perror("hypescript: socket"); return 1; }
+    unlink(socket_path); // left over from an earlier server
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, SERVER_BACKLOG) != 0) {
+        perror("hypescript: cannot listen");
+        close(listener);
+        return 1;
+    }
+    // Children are never waited for; the client learns the outcome from them
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    Resident* residents = NULL;
+    for (;;) {
+        int conn = accept(listener, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("hypescript: accept");
+            break;
+        }
+        serve(conn, &residents);
+        close(conn);
+    }
+    close(listener);
+    return 1;
+}
+
+int server_request(const char* socket_path, const char* script, bool records, bool print_records) {
+    char path[PATH_MAX];
+    if (!realpath(script, path)) {
+        fprintf(stderr, "Target file doesn't exists!\n");
+        return 1;
+    }
+    struct sockaddr_un addr;
+    if (!make_address(socket_path, &addr)) return 1;
+    int conn = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (conn < 0 || connect(conn, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "hypescript: no server at %s\n", socket_path);
+        if (conn >= 0) close(conn);
+        return 1;
+    }
+    Request req = { SERVER_MAGIC, 0, (uint32_t)strlen(path) };
+    if (records) req.flags |= REQUEST_RECORDS;
+    if (print_records) req.flags |= REQUEST_PRINT;
+    char data[sizeof(Request) + PATH_MAX];
+    memcpy(data, &req, sizeof(req));
+    memcpy(data + sizeof(req), path, req.path_length);
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union { struct cmsghdr align; char buf[CMSG_SPACE(sizeof(fds))]; } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { data, sizeof(req) + req.path_length };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    int32_t status = 1;
+    ssize_t n;
+    while ((n = sendmsg(conn, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    if (n >= 0) {
+        // The child holds the connection until the script has finished
+        while ((n = recv(conn, &status, sizeof(status), 0)) < 0 && errno == EINTR) {}
+        if (n != (ssize_t)sizeof(status)) {
+            fprintf(stderr, "hypescript: the server dropped the request\n");
+            status = 1;
+        }
+    }
+    close(conn);
+    return status;
+}
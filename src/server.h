@@ -0,0 +1,19 @@
+#ifndef HYPESCRIPT_SERVER_H
+#define HYPESCRIPT_SERVER_H
+
+#include <stdbool.h>
+
+// Pre-warmed fork server. `hypescript --serve SOCK` listens on a Unix
+// domain socket and keeps every script it has run parsed in memory, keyed
+// by path, modification time and size. `hypescript --connect=SOCK file`
+// sends the file's path together with its own stdin, stdout and stderr;
+// the server forks, and the child runs the resident program on those
+// descriptors in a fresh interpreter, then reports back. A request thus
+// costs a fork instead of process startup plus lexing and parsing.
+
+// Serves until the process is killed; returns 1 if the socket cannot be set up
+int server_run(const char* socket_path);
+// Runs `script` on the server; the exit status to use, 1 on failure
+int server_request(const char* socket_path, const char* script, bool records, bool print_records);
+
+#endif
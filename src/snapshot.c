@@ -0,0 +1,395 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "task.h"
+#include "codec.h"
+#include "array.h"
+#include "map.h"
+#include "builtins.h"
+#include "token.h"
+#include "mem.h"
+
+// Bump whenever the image encoding changes
+#define SNAPSHOT_FORMAT 3
+#define SNAPSHOT_LAYOUT ((uint32_t)TOK_OR_OR << 16 | (uint32_t)BI_COUNT << 8 | (uint32_t)sizeof(void*))
+
+// Strings at least this long come back as views into the mapped image;
+// shorter ones are copied so they do not pin the mapping
+#define SNAPSHOT_VIEW_MIN 64
+// Nesting limit when decoding, so a damaged image cannot exhaust the stack
+#define SNAPSHOT_MAX_DEPTH 10000
+
+typedef struct {
+    char magic[8];            // "HSSNAP\0\0"
+    uint32_t format;          // SNAPSHOT_FORMAT
+    uint32_t layout;          // SNAPSHOT_LAYOUT
+    uint64_t version;         // hash of the interpreter version string
+    uint64_t source_hash[2];  // the image is only valid for this source
+    uint64_t source_length;
+    uint64_t payload_length;
+    uint64_t payload_hash;
+} SnapshotHeader;
+
+static const char snapshot_magic[8] = "HSSNAP";
+
+enum { TAG_NULL, TAG_FALSE, TAG_TRUE, TAG_NUMBER, TAG_STRING, TAG_ARRAY, TAG_MAP, TAG_REF };
+
+static void fill_header(SnapshotHeader* h, const char* version, const char* source, size_t length) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, snapshot_magic, sizeof(h->magic));
+    h->format = SNAPSHOT_FORMAT;
+    h->layout = SNAPSHOT_LAYOUT;
+    h->version = codec_hash(version, strlen(version), 1);
+    h->source_hash[0] = codec_hash(source, length, 2);
+    h->source_hash[1] = codec_hash(source, length, 3);
+    h->source_length = length;
+}
+
+// ---- saving ----
+
+// Arrays and maps already written, by address, to the number they got
+typedef struct {
+    const void** keys;
+    uint32_t* ids;
+    size_t mask;
+    uint32_t count;
+} Seen;
+
+static size_t seen_slot(const Seen* s, const void* p) {
+    uintptr_t h = (uintptr_t)p;
+    h ^= h >> 17;
+    h *= (uintptr_t)0x9E3779B97F4A7C15ull;
+    size_t i = (size_t)(h >> 7) & s->mask;
+    while (s->keys[i] && s->keys[i] != p) i = (i + 1) & s->mask;
+    return i;
+}
+
+static void seen_grow(Seen* s) {
+    Seen old = *s;
+    s->mask = old.mask ? old.mask * 2 + 1 : 63;
+    s->keys = (const void**)mem_calloc(s->mask + 1, sizeof(void*));
+    s->ids = (uint32_t*)mem_alloc(sizeof(uint32_t) * (s->mask + 1));
+    for (size_t i = 0; old.keys && i <= old.mask; i++) {
+        if (!old.keys[i]) continue;
+        size_t j = seen_slot(s, old.keys[i]);
+        s->keys[j] = old.keys[i];
+        s->ids[j] = old.ids[i];
+    }
+    mem_free(old.keys);
+    mem_free(old.ids);
+}
+
+// Writes a reference and returns false if p was written before; otherwise
+// numbers it and returns true so the caller writes it out in full
+static bool seen_first(Seen* s, CodecWriter* w, const void* p) {
+    if ((s->count + 1) * 4 > (s->mask + 1) * 3) seen_grow(s);
+    size_t i = seen_slot(s, p);
+    if (s->keys[i]) {
+        codec_put_u8(w, TAG_REF);
+        codec_put_u32(w, s->ids[i]);
+        return false;
+    }
+    s->keys[i] = p;
+    s->ids[i] = s->count++;
+    return true;
+}
+
+static void put_value(CodecWriter* w, Seen* seen, const Value* v) {
+    switch (v->type) {
+        case VAL_NULL: codec_put_u8(w, TAG_NULL); break;
+        case VAL_BOOL: codec_put_u8(w, v->data.as_bool ? TAG_TRUE : TAG_FALSE); break;
+        case VAL_NUMBER:
+            codec_put_u8(w, TAG_NUMBER);
+            codec_put_f64(w, v->data.as_number);
+            break;
+        case VAL_STRING:
+            codec_put_u8(w, TAG_STRING);
+            codec_put_str(w, v->data.as_string->chars, v->data.as_string->length);
+            break;
+        case VAL_ARRAY: {
+            const Array* a = v->data.as_array;
+            if (!seen_first(seen, w, a)) break;
+            codec_put_u8(w, TAG_ARRAY);
+            codec_put_u8(w, a->boxed);
+            codec_put_u32(w, (uint32_t)a->length);
+            if (!a->boxed) { if (a->length) codec_put(w, a->nums, sizeof(double) * a->length); }
+            else for (size_t i = 0; i < a->length; i++) put_value(w, seen, &a->items[i]);
+            break;
+        }
+        case VAL_MAP: {
+            const Map* m = v->data.as_map;
+            if (!seen_first(seen, w, m)) break;
+            codec_put_u8(w, TAG_MAP);
+            codec_put_u32(w, (uint32_t)m->count);
+            size_t cursor = 0;
+            Value key, value;
+            while (map_next(m, &cursor, &key, &value)) {
+                put_value(w, seen, &key);
+                put_value(w, seen, &value);
+            }
+            break;
+        }
+        case VAL_OBJECT:
+            // Channels and threads only make sense in the running process
+            w->failed = true;
+            break;
+    }
+}
+
+static void put_function(CodecWriter* w, const FunctionDef* def) {
+    codec_put_str(w, def->name, strlen(def->name));
+    codec_put_u32(w, (uint32_t)def->param_count);
+    for (int i = 0; i < def->param_count; i++) codec_put_str(w, def->params[i], strlen(def->params[i]));
+    if (def->body) {
+        codec_put_u8(w, 1);
+        codec_put_stmt(w, def->body);
+        return;
+    }
+    const char* body = def->lazy_body;
+    if (!body || body < w->source || body > w->source + w->source_length) { w->failed = true; return; }
+    codec_put_u8(w, 0);
+    codec_put_u32(w, (uint32_t)(body - w->source));
+    codec_put_u32(w, (uint32_t)def->lazy_line);
+    codec_put_u32(w, (uint32_t)def->lazy_column);
+}
+
+bool snapshot_save(const char* path, const char* version, const char* source, size_t length, const Interpreter* in) {
+    // Started tasks live on stacks of their own, which cannot be saved
+    if (tasks_pending(in)) return false;
+    CodecWriter w = {0};
+    w.source = source;
+    w.source_length = length;
+
+    // Both lists are newest-first; write them oldest-first so that
+    // re-registering in file order rebuilds the same lists
+    uint32_t count = 0;
+    for (const FunctionDef* d = in->functions.head; d; d = d->next) count++;
+    const FunctionDef** defs = (const FunctionDef**)mem_alloc(sizeof(*defs) * (count ? count : 1));
+    uint32_t i = count;
+    for (const FunctionDef* d = in->functions.head; d; d = d->next) defs[--i] = d;
+    codec_put_u32(&w, count);
+    for (i = 0; i < count; i++) put_function(&w, defs[i]);
+    mem_free(defs);
+
+    count = 0;
+    for (const VarEntry* v = in->globals->head; v; v = v->next) count++;
+    const VarEntry** vars = (const VarEntry**)mem_alloc(sizeof(*vars) * (count ? count : 1));
+    i = count;
+    for (const VarEntry* v = in->globals->head; v; v = v->next) vars[--i] = v;
+    Seen seen = {0};
+    codec_put_u32(&w, count);
+    for (i = 0; i < count; i++) {
+        codec_put_str(&w, vars[i]->name, strlen(vars[i]->name));
+        put_value(&w, &seen, &vars[i]->value);
+    }
+    mem_free(vars);
+    mem_free(seen.keys);
+    mem_free(seen.ids);
+
+    bool ok = false;
+    if (!w.failed) {
+        SnapshotHeader h;
+        fill_header(&h, version, source, length);
+        h.payload_length = w.length;
+        h.payload_hash = codec_hash(w.data, w.length, 4);
+        ok = codec_write_file(path, &h, sizeof(h), &w);
+    }
+    mem_free(w.data);
+    return ok;
+}
+
+// ---- loading ----
+
+typedef struct {
+    CodecReader r;
+    String* image;   // the mapped file, for string views
+    Value* objects;  // arrays and maps by number, borrowed
+    uint32_t count;
+    uint32_t capacity;
+    int depth;
+} Loader;
+
+static void remember(Loader* l, Value object) {
+    if (l->count == l->capacity) {
+        l->capacity = l->capacity ? l->capacity * 2 : 64;
+        l->objects = (Value*)mem_realloc(l->objects, sizeof(Value) * l->capacity);
+    }
+    l->objects[l->count++] = object;
+}
+
+// An array or map is numbered before its elements are read, so elements
+// can refer back to it
+static bool get_value(Loader* l, Value* out) {
+    *out = value_null();
+    CodecReader* r = &l->r;
+    if (++l->depth > SNAPSHOT_MAX_DEPTH) r->failed = true;
+    uint8_t tag = codec_get_u8(r);
+    switch (r->failed ? TAG_NULL : tag) {
+        case TAG_NULL: break;
+        case TAG_FALSE: *out = value_bool(false); break;
+        case TAG_TRUE: *out = value_bool(true); break;
+        case TAG_NUMBER: *out = value_number(codec_get_f64(r)); break;
+        case TAG_STRING: {
+            size_t n;
+            const char* s = codec_get_str(r, &n);
+            if (!s) break;
+            // "&name" pointers must stay owned strings to keep working
+            if (n >= SNAPSHOT_VIEW_MIN && s[0] != '&')
+                *out = value_from_string(string_slice(l->image, (size_t)(s - l->image->chars), n));
+            else
+                *out = value_string_len(s, n);
+            break;
+        }
+        case TAG_ARRAY: {
+            bool boxed = codec_get_u8(r) != 0;
+            uint32_t length = codec_get_u32(r);
+            // Every element takes at least one byte
+            if (r->failed || length > (size_t)(r->end - r->p)) { r->failed = true; break; }
+            Array* a = array_new(boxed ? 0 : length);
+            *out = value_array(a);
+            remember(l, *out);
+            if (!boxed) {
+                if (length == 0 || codec_get(r, a->nums, sizeof(double) * length)) a->length = length;
+                break;
+            }
+            for (uint32_t i = 0; i < length; i++) {
+                Value item;
+                if (!get_value(l, &item)) break;
+                array_push(a, item);
+            }
+            break;
+        }
+        case TAG_MAP: {
+            int count = codec_get_count(r);
+            Map* m = map_new();
+            *out = value_map(m);
+            remember(l, *out);
+            for (int i = 0; i < count; i++) {
+                Value key, value;
+                if (!get_value(l, &key)) break;
+                if (!get_value(l, &value) || !map_key_ok(&key)) {
+                    value_free(&key);
+                    value_free(&value);
+                    r->failed = true;
+                    break;
+                }
+                map_set(m, &key, value);
+                value_free(&key);
+            }
+            break;
+        }
+        case TAG_REF: {
+            uint32_t id = codec_get_u32(r);
+            if (r->failed || id >= l->count) { r->failed = true; break; }
+            *out = value_clone(&l->objects[id]);
+            break;
+        }
+        default: r->failed = true; break;
+    }
+    l->depth--;
+    return !r->failed;
+}
+
+static char* get_name(CodecReader* r) {
+    size_t n;
+    const char* s = codec_get_str(r, &n);
+    if (!s) return NULL;
+    char* out = (char*)mem_alloc(n + 1);
+    memcpy(out, s, n + 1);
+    return out;
+}
+
+static bool get_function(CodecReader* r, Functions* functions) {
+    char* name = get_name(r);
+    int count = codec_get_count(r);
+    char** params = count ? (char**)mem_alloc(sizeof(char*) * (size_t)count) : NULL;
+    int got = 0;
+    while (got < count && (params[got] = get_name(r))) got++;
+    Stmt* body = NULL;
+    uint32_t offset = 0, line = 0, column = 0;
+    if (codec_get_u8(r)) {
+        body = codec_get_stmt(r);
+        if (!body) r->failed = true;
+    } else {
+        offset = codec_get_u32(r);
+        line = codec_get_u32(r);
+        column = codec_get_u32(r);
+        if (offset > r->source_length) r->failed = true;
+    }
+    if (r->failed || !name) {
+        mem_free(name);
+        for (int i = 0; i < got; i++) mem_free(params[i]);
+        mem_free(params);
+        stmt_free(body);
+        return false;
+    }
+    FunctionDef* def = funcs_register(functions, name, params, got, body);
+    def->owns_params = true;
+    mem_free(name);
+    if (body) {
+        def->owns_body = true;
+    } else {
+        def->lazy_body = r->source + offset;
+        def->lazy_line = (int)line;
+        def->lazy_column = (int)column;
+    }
+    return true;
+}
+
+static bool decode(Loader* l, Functions* functions, Env* globals) {
+    CodecReader* r = &l->r;
+    uint32_t count = codec_get_u32(r);
+    for (uint32_t i = 0; i < count && !r->failed; i++) get_function(r, functions);
+    count = codec_get_u32(r);
+    for (uint32_t i = 0; i < count && !r->failed; i++) {
+        char* name = get_name(r);
+        Value v;
+        get_value(l, &v);
+        if (r->failed || !name) { mem_free(name); value_free(&v); break; }
+        env_set(globals, name, v);
+        mem_free(name);
+    }
+    return !r->failed && r->p == r->end;
+}
+
+bool snapshot_load(const char* path, const char* version, const char* source, size_t length, Interpreter* in) {
+    String* image = string_map_file(path);
+    if (!image) return false;
+    SnapshotHeader expected, h;
+    fill_header(&expected, version, source, length);
+    bool valid = image->length >= sizeof(h);
+    if (valid) {
+        memcpy(&h, image->chars, sizeof(h));
+        const unsigned char* payload = (const unsigned char*)image->chars + sizeof(h);
+        valid = memcmp(h.magic, expected.magic, sizeof(h.magic)) == 0
+            && h.format == expected.format && h.layout == expected.layout
+            && h.version == expected.version
+            && h.source_hash[0] == expected.source_hash[0] && h.source_hash[1] == expected.source_hash[1]
+            && h.source_length == expected.source_length
+            && h.payload_length == image->length - sizeof(h)
+            && h.payload_hash == codec_hash(payload, (size_t)h.payload_length, 4);
+    }
+    if (valid) {
+        const unsigned char* payload = (const unsigned char*)image->chars + sizeof(h);
+        Loader l = { { payload, payload + h.payload_length, false, source, length }, image, NULL, 0, 0, 0 };
+        Functions functions;
+        funcs_init(&functions);
+        Env* globals = env_create(NULL);
+        valid = decode(&l, &functions, globals);
+        mem_free(l.objects);
+        if (valid) {
+            env_free(in->globals);
+            funcs_free(&in->functions);
+            in->globals = globals;
+            in->functions = functions;
+        } else {
+            env_free(globals);
+            funcs_free(&functions);
+        }
+    }
+    // Views taken from the image keep the mapping alive on their own
+    string_release(image);
+    return valid;
+}
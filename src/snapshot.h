@@ -0,0 +1,23 @@
+#ifndef HYPESCRIPT_SNAPSHOT_H
+#define HYPESCRIPT_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "interp.h"
+
+// Interpreter snapshots for warm starts. After interpret_start() the
+// registered prikol functions (with their bodies) and the global variables
+// are written to an image; a later run of the same source maps the image,
+// rebuilds that state and goes straight to interpret_finish(). The image
+// holds no pointers: arrays and maps are numbered so shared and cyclic
+// ones come back shared, and long strings are views into the mapping.
+// Output written and input read before the snapshot are not replayed.
+
+// Writes the image atomically (temporary file + rename); false on failure
+bool snapshot_save(const char* path, const char* version, const char* source, size_t length, const Interpreter* in);
+// Replaces in's globals and functions with the image's. False, leaving `in`
+// untouched, when the file is missing, damaged, or made by another build
+// or from another source.
+bool snapshot_load(const char* path, const char* version, const char* source, size_t length, Interpreter* in);
+
+#endif
@@ -0,0 +1,92 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "stats.h"
+
+bool stats_enabled = false;
+_Thread_local Stats stats_local;
+
+static Stats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* const expr_names[STATS_EXPR_TYPES] = {
+    [EXPR_LITERAL] = "literal",
+    [EXPR_VARIABLE] = "variable",
+    [EXPR_ASSIGN] = "assign",
+    [EXPR_BINARY] = "binary",
+    [EXPR_UNARY] = "unary",
+    [EXPR_CALL] = "call",
+    [EXPR_ARRAY] = "array",
+    [EXPR_MAP] = "map",
+    [EXPR_INDEX] = "index",
+    [EXPR_INDEX_ASSIGN] = "index_assign",
+};
+
+static const char* const stmt_names[STATS_STMT_TYPES] = {
+    [STMT_EXPR] = "expr",
+    [STMT_BLOCK] = "block",
+    [STMT_IF] = "if",
+    [STMT_WHILE] = "while",
+    [STMT_FOR] = "for",
+    [STMT_BREAK] = "break",
+    [STMT_CONTINUE] = "continue",
+    [STMT_FUNC] = "func",
+    [STMT_SECTION] = "section",
+    [STMT_IMPORT] = "import",
+};
+
+void stats_merge(void) {
+    if (!stats_enabled) return;
+    // Stats is all counters: add it up as an array
+    const uint64_t* from = (const uint64_t*)&stats_local;
+    uint64_t* to = (uint64_t*)&totals;
+    pthread_mutex_lock(&totals_lock);
+    for (size_t i = 0; i < sizeof(Stats) / sizeof(uint64_t); i++) to[i] += from[i];
+    pthread_mutex_unlock(&totals_lock);
+    memset(&stats_local, 0, sizeof(stats_local));
+}
+
+static double average(uint64_t total, uint64_t count) {
+    return count ? (double)total / (double)count : 0;
+}
+
+static void write_counts(FILE* f, const char* key, const uint64_t* counts, const char* const* names, int n) {
+    fprintf(f, "  \"%s\": {", key);
+    bool first = true;
+    for (int i = 0; i < n; i++) {
+        if (!counts[i] || !names[i] || !*names[i]) continue;
+        fprintf(f, "%s\"%s\": %llu", first ? "" : ", ", names[i], (unsigned long long)counts[i]);
+        first = false;
+    }
+    fprintf(f, "},\n");
+}
+
+void stats_write(FILE* f) {
+    stats_merge();
+    pthread_mutex_lock(&totals_lock);
+    const Stats* s = &totals;
+    const char* builtin_names[BI_COUNT];
+    for (int i = 0; i < BI_COUNT; i++) builtin_names[i] = builtin_name((BuiltinId)i);
+    fprintf(f, "{\n");
+    write_counts(f, "exprs", s->exprs, expr_names, STATS_EXPR_TYPES);
+    write_counts(f, "stmts", s->stmts, stmt_names, STATS_STMT_TYPES);
+    fprintf(f, "  \"env_get\": {\"calls\": %llu, \"avg_scopes\": %.3f, \"avg_names\": %.3f},\n",
+            (unsigned long long)s->env_gets, average(s->env_get_scopes, s->env_gets), average(s->env_get_entries, s->env_gets));
+    fprintf(f, "  \"env_assign\": {\"calls\": %llu, \"avg_scopes\": %.3f, \"avg_names\": %.3f},\n",
+            (unsigned long long)s->env_assigns, average(s->env_assign_scopes, s->env_assigns),
+            average(s->env_assign_entries, s->env_assigns));
+    fprintf(f, "  \"funcs_lookup\": {\"calls\": %llu, \"misses\": %llu},\n",
+            (unsigned long long)s->func_lookups, (unsigned long long)s->func_misses);
+    fprintf(f, "  \"memo\": {\"hits\": %llu, \"misses\": %llu, \"evictions\": %llu, \"uncached\": %llu},\n",
+            (unsigned long long)s->memo_hits, (unsigned long long)s->memo_misses,
+            (unsigned long long)s->memo_evictions, (unsigned long long)s->memo_uncached);
+    fprintf(f, "  \"modules\": {\"parsed\": %llu, \"reused\": %llu},\n",
+            (unsigned long long)s->modules_parsed, (unsigned long long)s->modules_reused);
+    write_counts(f, "builtins", s->builtins, builtin_names, BI_COUNT);
+    fprintf(f, "  \"envs_created\": {\"block\": %llu, \"dlya\": %llu},\n",
+            (unsigned long long)s->block_envs, (unsigned long long)s->loop_envs);
+    fprintf(f, "  \"strings\": {\"allocated\": %llu, \"bytes\": %llu}\n",
+            (unsigned long long)s->strings, (unsigned long long)s->string_bytes);
+    fprintf(f, "}\n");
+    pthread_mutex_unlock(&totals_lock);
+}
@@ -0,0 +1,55 @@
+#ifndef HYPESCRIPT_STATS_H
+#define HYPESCRIPT_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast.h"
+#include "builtins.h"
+
+// Counters of the interpreter's hot paths, behind --stats.
+//
+// They are always compiled in and cost one predictable branch each while
+// off. Every thread counts into its own copy, so counting needs no atomics;
+// a thread adds its copy to the totals when it ends, and stats_write
+// prints the totals as JSON.
+
+#define STATS_EXPR_TYPES (EXPR_INDEX_ASSIGN + 1)
+#define STATS_STMT_TYPES (STMT_IMPORT + 1)
+
+typedef struct {
+    uint64_t exprs[STATS_EXPR_TYPES]; // evaluated, by type
+    uint64_t stmts[STATS_STMT_TYPES]; // executed, by type
+    uint64_t env_gets;
+    uint64_t env_get_scopes;          // Envs walked by env_get
+    uint64_t env_get_entries;         // names compared by env_get
+    uint64_t env_assigns;
+    uint64_t env_assign_scopes;
+    uint64_t env_assign_entries;
+    uint64_t func_lookups;
+    uint64_t func_misses;
+    uint64_t memo_hits;               // --memo, see memo.h
+    uint64_t memo_misses;
+    uint64_t memo_evictions;
+    uint64_t memo_uncached;           // calls with an array, map or object in or out
+    uint64_t modules_parsed;          // by podklyuchit, see module.h
+    uint64_t modules_reused;          // found already parsed
+    uint64_t builtins[BI_COUNT];
+    uint64_t block_envs;              // Envs created for a block
+    uint64_t loop_envs;               // and for a dlya loop
+    uint64_t strings;                 // strings allocated
+    uint64_t string_bytes;
+} Stats;
+
+extern bool stats_enabled;
+extern _Thread_local Stats stats_local;
+
+#define STAT_ADD(field, n) do { if (stats_enabled) stats_local.field += (n); } while (0)
+
+// Adds the calling thread's counters to the totals and clears them
+void stats_merge(void);
+// stats_merge, then the totals as a JSON object
+void stats_write(FILE* f);
+
+#endif
@@ -0,0 +1,471 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "task.h"
+#include "object.h"
+#include "mem.h"
+
+// As deep as the usual main stack; only reserved, so a task only costs
+// the pages it touches
+#define TASK_STACK (8 * 1024 * 1024)
+
+typedef enum {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_WAITING,
+    TASK_DONE
+} TaskState;
+
+typedef struct Task {
+    Object base;            // the zadacha handle
+    Scheduler* scheduler;
+    TaskState state;
+    ucontext_t context;
+    char* stack;            // NULL for the code outside tasks
+    size_t stack_size;      // mapped, guard page included
+    char* name;
+    int argc;
+    Value* argv;
+    struct Task* next;      // in the ready queue, the readers or the zombies
+    struct Task* waiters;   // in zhdat on this task
+    struct Task* next_waiter;
+    struct Task* prev_live; // started and not finished
+    struct Task* next_live;
+    Frame* frame;           // its innermost call while it is switched out
+    Frame root;             // the bottom of its calls, while profiling
+} Task;
+
+typedef struct {
+    uint64_t deadline; // CLOCK_MONOTONIC, ns
+    uint64_t seq;      // equal deadlines wake in the order they were set
+    Task* task;
+} Timer;
+
+typedef enum { INPUT_UNKNOWN, INPUT_POLLABLE, INPUT_DIRECT } InputKind;
+
+struct Scheduler {
+    Interpreter* in;
+    Task main;      // the code outside tasks, on the interpreter's own stack
+    Task* current;
+    Task* ready_head;
+    Task* ready_tail;
+    Task* readers_head; // waiting in vhod, served in order
+    Task* readers_tail;
+    Timer* timers;      // binary min-heap
+    size_t timer_count;
+    size_t timer_capacity;
+    uint64_t timer_seq;
+    Task* live;
+    size_t live_count;
+    size_t stuck;       // live tasks known to wait for each other forever
+    Task* zombies;      // finished; their stacks are freed from another one
+    int epoll_fd;
+    int timer_fd;
+    InputKind input;
+    bool watching_input;
+    bool draining;      // main waits for every task to finish
+    bool gave_up;       // main was woken because nothing else could happen
+};
+
+// Where a new task finds its scheduler; a task starts on the thread that
+// switches to it
+static _Thread_local Scheduler* starting;
+
+static void task_destroy(Object* o) {
+    Task* t = (Task*)o;
+    mem_free(t->name);
+    mem_free(t);
+}
+
+static const ObjectType task_type = { "zadacha", task_destroy };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// ---- queues ----
+
+static void ready_push(Scheduler* s, Task* t) {
+    t->state = TASK_READY;
+    t->next = NULL;
+    if (s->ready_tail) s->ready_tail->next = t;
+    else s->ready_head = t;
+    s->ready_tail = t;
+}
+
+static Task* ready_pop(Scheduler* s) {
+    Task* t = s->ready_head;
+    if (t) {
+        s->ready_head = t->next;
+        if (!s->ready_head) s->ready_tail = NULL;
+    }
+    return t;
+}
+
+static void reader_push(Scheduler* s, Task* t) {
+    t->state = TASK_WAITING;
+    t->next = NULL;
+    if (s->readers_tail) s->readers_tail->next = t;
+    else s->readers_head = t;
+    s->readers_tail = t;
+}
+
+static Task* reader_pop(Scheduler* s) {
+    Task* t = s->readers_head;
+    if (t) {
+        s->readers_head = t->next;
+        if (!s->readers_head) s->readers_tail = NULL;
+    }
+    return t;
+}
+
+static bool timer_before(const Timer* a, const Timer* b) {
+    return a->deadline < b->deadline || (a->deadline == b->deadline && a->seq < b->seq);
+}
+
+static void timer_push(Scheduler* s, uint64_t deadline, Task* t) {
+    if (s->timer_count == s->timer_capacity) {
+        s->timer_capacity = s->timer_capacity ? s->timer_capacity * 2 : 16;
+        s->timers = (Timer*)mem_realloc(s->timers, sizeof(Timer) * s->timer_capacity);
+    }
+    Timer timer = { deadline, s->timer_seq++, t };
+    size_t i = s->timer_count++;
+    while (i > 0 && timer_before(&timer, &s->timers[(i - 1) / 2])) {
+        s->timers[i] = s->timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    s->timers[i] = timer;
+    t->state = TASK_WAITING;
+}
+
+static Task* timer_pop(Scheduler* s) {
+    Task* t = s->timers[0].task;
+    Timer last = s->timers[--s->timer_count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= s->timer_count) break;
+        if (child + 1 < s->timer_count && timer_before(&s->timers[child + 1], &s->timers[child])) child++;
+        if (!timer_before(&s->timers[child], &last)) break;
+        s->timers[i] = s->timers[child];
+        i = child;
+    }
+    if (s->timer_count) s->timers[i] = last;
+    return t;
+}
+
+// ---- switching ----
+
+static void reap(Scheduler* s) {
+    while (s->zombies) {
+        Task* t = s->zombies;
+        s->zombies = t->next;
+        munmap(t->stack, t->stack_size);
+        t->stack = NULL;
+        object_release(&t->base); // the scheduler's reference
+    }
+}
+
+static void switch_to(Scheduler* s, Task* next) {
+    Task* self = s->current;
+    next->state = TASK_RUNNING;
+    if (next == self) return;
+    // Each task has its own chain of calls for the profiler
+    self->frame = s->in->frame;
+    s->in->frame = next->frame;
+    s->current = next;
+    starting = s;
+    swapcontext(&self->context, &next->context);
+    // Back on this task's stack, so any finished one can go
+    reap(s);
+}
+
+// Input is watched only while someone waits for it: a closed pipe would
+// otherwise wake every epoll_wait
+static void watch_input(Scheduler* s, bool on) {
+    if (on == s->watching_input) return;
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = s->in->input->fd;
+    epoll_ctl(s->epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, s->in->input->fd, &ev);
+    s->watching_input = on;
+}
+
+// Waits for a timer or for input (at most timeout_ms, -1 for as long as it
+// takes) and makes the tasks that were waiting for it ready. False when
+// nothing is being waited for.
+static bool poll_events(Scheduler* s, int timeout_ms) {
+    if (s->timer_count == 0 && !s->readers_head) return false;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (s->timer_count) {
+        uint64_t deadline = s->timers[0].deadline;
+        its.it_value.tv_sec = (time_t)(deadline / 1000000000u);
+        its.it_value.tv_nsec = (long)(deadline % 1000000000u);
+    }
+    timerfd_settime(s->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    watch_input(s, s->readers_head != NULL);
+    struct epoll_event events[4];
+    int n = epoll_wait(s->epoll_fd, events, 4, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == s->timer_fd) {
+            uint64_t expirations;
+            if (read(s->timer_fd, &expirations, sizeof(expirations)) < 0) {}
+        } else if (!input_has_line(s->in->input)) {
+            input_fill(s->in->input);
+        }
+    }
+    uint64_t now = now_ns();
+    while (s->timer_count && s->timers[0].deadline <= now) ready_push(s, timer_pop(s));
+    if (s->readers_head && input_has_line(s->in->input)) ready_push(s, reader_pop(s));
+    return true;
+}
+
+// Nothing is ready and nothing can make anything ready: every task left
+// waits for another. The code outside tasks is then the one waiting for
+// them, and it stops waiting.
+static void give_up(Scheduler* s) {
+    if (s->live_count > s->stuck) {
+        fprintf(stderr, "zadacha: %zu task(s) wait for each other and will never finish\n", s->live_count - s->stuck);
+        s->stuck = s->live_count;
+    }
+    s->gave_up = true;
+    ready_push(s, &s->main);
+}
+
+// The current task has registered what it waits for (or has finished);
+// runs others until it is ready again
+static void block(Scheduler* s) {
+    for (;;) {
+        Task* next = ready_pop(s);
+        if (next) { switch_to(s, next); return; }
+        // Everyone waits: what was printed so far should be seen meanwhile
+        output_flush(s->in->out);
+        if (!poll_events(s, -1) && s->main.state == TASK_WAITING) give_up(s);
+    }
+}
+
+static void task_entry(void) {
+    Scheduler* s = starting;
+    Task* t = s->current;
+    reap(s);
+    if (!interpret_call(s->in, t->name, t->argc, t->argv))
+        fprintf(stderr, "zadacha: no prikol named %s\n", t->name);
+    mem_free(t->argv);
+    t->argv = NULL;
+    t->argc = 0;
+    t->state = TASK_DONE;
+    if (t->prev_live) t->prev_live->next_live = t->next_live;
+    else s->live = t->next_live;
+    if (t->next_live) t->next_live->prev_live = t->prev_live;
+    s->live_count--;
+    for (Task* w = t->waiters; w; w = w->next_waiter) ready_push(s, w);
+    t->waiters = NULL;
+    if (s->draining && s->live_count == s->stuck) ready_push(s, &s->main);
+    t->next = s->zombies;
+    s->zombies = t;
+    block(s); // never returns: nothing makes a finished task ready
+}
+
+static Scheduler* scheduler_get(Interpreter* in) {
+    if (in->scheduler) return in->scheduler;
+    Scheduler* s = (Scheduler*)mem_calloc(1, sizeof(Scheduler));
+    s->in = in;
+    object_init(&s->main.base, &task_type);
+    s->main.scheduler = s;
+    s->main.state = TASK_RUNNING;
+    s->current = &s->main;
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    s->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = s->timer_fd;
+    if (s->epoll_fd < 0 || s->timer_fd < 0 || epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->timer_fd, &ev) != 0) {
+        perror("zadacha: cannot set up the event loop");
+        if (s->epoll_fd >= 0) close(s->epoll_fd);
+        if (s->timer_fd >= 0) close(s->timer_fd);
+        mem_free(s);
+        return NULL;
+    }
+    in->scheduler = s;
+    return s;
+}
+
+// Whether waits have to go through the scheduler: there are tasks, or
+// this is one
+static Scheduler* active(Interpreter* in) {
+    Scheduler* s = in->scheduler;
+    return s && (s->current != &s->main || s->live_count > s->stuck) ? s : NULL;
+}
+
+// ---- builtins ----
+
+// Kept apart: getcontext returns twice as far as the compiler knows
+static void prepare_context(Task* t, char* stack) {
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = stack;
+    t->context.uc_stack.ss_size = TASK_STACK;
+    t->context.uc_link = NULL;
+    makecontext(&t->context, task_entry, 0);
+}
+
+Value builtin_zadacha(Interpreter* in, int argc, Value* argv) {
+    if (argc < 1 || argv[0].type != VAL_STRING) return value_null();
+    Scheduler* s = scheduler_get(in);
+    if (!s) return value_null();
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = TASK_STACK + (size_t)page;
+    char* stack = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        fprintf(stderr, "zadacha: cannot allocate a stack\n");
+        return value_null();
+    }
+    mprotect(stack, (size_t)page, PROT_NONE); // overflow faults instead of corrupting
+    Task* t = (Task*)mem_calloc(1, sizeof(Task));
+    object_init(&t->base, &task_type);
+    t->scheduler = s;
+    t->stack = stack;
+    t->stack_size = size;
+    const String* name = argv[0].data.as_string;
+    t->name = (char*)mem_alloc(name->length + 1);
+    memcpy(t->name, name->chars, name->length);
+    t->name[name->length] = '\0';
+    // Same thread, same heap: arguments are shared like in a call
+    t->argc = argc - 1;
+    t->argv = (Value*)mem_alloc(sizeof(Value) * (size_t)(argc > 1 ? argc - 1 : 1));
+    for (int i = 1; i < argc; i++) t->argv[i - 1] = value_clone(&argv[i]);
+    prepare_context(t, stack + page);
+    if (in->frame) {
+        t->root.name = "<zadacha>";
+        t->frame = &t->root;
+    }
+    t->next_live = s->live;
+    if (s->live) s->live->prev_live = t;
+    s->live = t;
+    s->live_count++;
+    ready_push(s, t);
+    return value_object(object_retain(&t->base)); // one for the scheduler
+}
+
+void task_sleep(Interpreter* in, double ms) {
+    Scheduler* s = active(in);
+    if (!s) {
+        if (ms > 0) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)(ms / 1000);
+            ts.tv_nsec = (long)((ms - (double)ts.tv_sec * 1000) * 1000000.0);
+            // The profiler's signals must not cut the sleep short
+            while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+        }
+        return;
+    }
+    Task* self = s->current;
+    if (ms > 0) {
+        timer_push(s, now_ns() + (uint64_t)(ms * 1000000.0), self);
+    } else {
+        // Just a turn for the others; timers that are due get theirs too
+        poll_events(s, 0);
+        ready_push(s, self);
+    }
+    block(s);
+}
+
+String* task_read_line(Interpreter* in) {
+    Scheduler* s = active(in);
+    Input* input = in->input;
+    if (s && s->input == INPUT_UNKNOWN) {
+        // Regular files cannot be polled, but reading them never waits long
+        struct epoll_event ev = { .events = EPOLLIN };
+        ev.data.fd = input->fd;
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, input->fd, &ev) == 0) {
+            epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, input->fd, &ev);
+            s->input = INPUT_POLLABLE;
+        } else {
+            s->input = INPUT_DIRECT;
+        }
+    }
+    if (!s || s->input == INPUT_DIRECT) return input_read_line(input);
+    while (!input_has_line(input)) {
+        reader_push(s, s->current);
+        block(s);
+    }
+    String* line = input_read_line(input);
+    // Another line may already be buffered for the next reader
+    if (s->readers_head && input_has_line(input)) ready_push(s, reader_pop(s));
+    return line;
+}
+
+bool task_join(Interpreter* in, const Value* v) {
+    if (v->type != VAL_OBJECT || v->data.as_object->type != &task_type) return false;
+    Task* t = (Task*)v->data.as_object;
+    Scheduler* s = in->scheduler;
+    // Tasks of other interpreters cannot finish while this one waits
+    if (t->scheduler != s || t->state == TASK_DONE) return true;
+    Task* self = s->current;
+    if (t == self) return true;
+    while (t->state != TASK_DONE) {
+        self->state = TASK_WAITING;
+        self->next_waiter = t->waiters;
+        t->waiters = self;
+        s->gave_up = false;
+        block(s);
+        if (self == &s->main && s->gave_up) {
+            for (Task** w = &t->waiters; *w; w = &(*w)->next_waiter)
+                if (*w == self) { *w = self->next_waiter; break; }
+            break;
+        }
+    }
+    return true;
+}
+
+void tasks_finish(Interpreter* in) {
+    Scheduler* s = in->scheduler;
+    if (!s || s->current != &s->main) return;
+    while (s->live_count > s->stuck) {
+        s->main.state = TASK_WAITING;
+        s->draining = true;
+        s->gave_up = false;
+        block(s);
+        s->draining = false;
+        if (s->gave_up) break;
+    }
+}
+
+bool tasks_pending(const Interpreter* in) {
+    return in->scheduler && in->scheduler->live_count > 0;
+}
+
+void tasks_free(Interpreter* in) {
+    Scheduler* s = in->scheduler;
+    if (!s) return;
+    tasks_finish(in);
+    reap(s);
+    // Stuck tasks are dropped where they wait; what their frames hold leaks
+    while (s->live) {
+        Task* t = s->live;
+        s->live = t->next_live;
+        for (int i = 0; i < t->argc; i++) value_free(&t->argv[i]);
+        mem_free(t->argv);
+        t->argv = NULL;
+        t->state = TASK_DONE;
+        t->waiters = NULL;
+        munmap(t->stack, t->stack_size);
+        t->stack = NULL;
+        object_release(&t->base);
+    }
+    close(s->epoll_fd);
+    close(s->timer_fd);
+    mem_free(s->timers);
+    mem_free(s);
+    in->scheduler = NULL;
+}
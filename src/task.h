@@ -0,0 +1,37 @@
+#ifndef HYPESCRIPT_TASK_H
+#define HYPESCRIPT_TASK_H
+
+#include "interp.h"
+
+// Cooperative tasks and the event loop that runs them.
+//
+// zadacha("f", args...) starts the prikol f as a task: a coroutine with a
+// stack of its own, running on the same thread and interpreter as the
+// code that started it, so it sees the same globals. Tasks switch only
+// where one has to wait: son(ms) sleeps on a timer, vhod waits until a
+// line can be read, zhdat(t) waits for the task t to finish, and son(0)
+// just lets the others run. Nothing runs in parallel, so tasks need no
+// locks. The waits go through one epoll instance with a timerfd for the
+// nearest timer, so hundreds of sleeping or reading tasks cost no threads.
+//
+// The code outside any task takes part too: its son, vhod and zhdat let
+// tasks run. A program ends after all of its tasks; tasks waiting for
+// each other with nothing else left to happen are reported and dropped.
+
+typedef struct Scheduler Scheduler;
+
+Value builtin_zadacha(Interpreter* in, int argc, Value* argv);
+// son(ms); suspends only the current task once tasks exist
+void task_sleep(Interpreter* in, double ms);
+// vhod's line; other tasks run while it waits for input
+String* task_read_line(Interpreter* in);
+// zhdat for a task handle; false if v is not a task of this interpreter
+bool task_join(Interpreter* in, const Value* v);
+
+// Runs the tasks until all have finished (from outside any task)
+void tasks_finish(Interpreter* in);
+bool tasks_pending(const Interpreter* in);
+// tasks_finish, then frees the event loop
+void tasks_free(Interpreter* in);
+
+#endif
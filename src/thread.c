@@ -0,0 +1,390 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "thread.h"
+#include "object.h"
+#include "array.h"
+#include "map.h"
+#include "stats.h"
+#include "mem.h"
+
+// ---- deep copy ----
+
+// Arrays and maps copied so far, by address, so shared and cyclic
+// structure comes out the same
+typedef struct {
+    const void** keys;
+    Value* copies;
+    size_t mask;
+    size_t count;
+} CopyMemo;
+
+static size_t memo_slot(const CopyMemo* m, const void* p) {
+    uintptr_t h = (uintptr_t)p;
+    h ^= h >> 17;
+    h *= (uintptr_t)0x9E3779B97F4A7C15ull;
+    size_t i = (size_t)(h >> 7) & m->mask;
+    while (m->keys[i] && m->keys[i] != p) i = (i + 1) & m->mask;
+    return i;
+}
+
+static void memo_put(CopyMemo* m, const void* p, Value copy) {
+    if ((m->count + 1) * 4 > (m->mask + 1) * 3) {
+        CopyMemo old = *m;
+        m->mask = old.mask ? old.mask * 2 + 1 : 15;
+        m->keys = (const void**)mem_calloc(m->mask + 1, sizeof(void*));
+        m->copies = (Value*)mem_alloc(sizeof(Value) * (m->mask + 1));
+        for (size_t i = 0; old.keys && i <= old.mask; i++) {
+            if (!old.keys[i]) continue;
+            size_t j = memo_slot(m, old.keys[i]);
+            m->keys[j] = old.keys[i];
+            m->copies[j] = old.copies[i];
+        }
+        mem_free(old.keys);
+        mem_free(old.copies);
+    }
+    size_t i = memo_slot(m, p);
+    m->keys[i] = p;
+    m->copies[i] = copy; // borrowed: the result owns the copy
+    m->count++;
+}
+
+static bool memo_get(const CopyMemo* m, const void* p, Value* out) {
+    if (!m->keys) return false;
+    size_t i = memo_slot(m, p);
+    if (!m->keys[i]) return false;
+    *out = value_clone(&m->copies[i]);
+    return true;
+}
+
+static Value copy_value(CopyMemo* memo, const Value* v) {
+    switch (v->type) {
+        case VAL_STRING: {
+            // Literals too: they belong to a program the receiver may outlive
+            String* s = v->data.as_string;
+            return value_string_len(s->chars, s->length);
+        }
+        case VAL_ARRAY: {
+            const Array* a = v->data.as_array;
+            Value out;
+            if (memo_get(memo, a, &out)) return out;
+            Array* copy = array_new(a->boxed ? 0 : a->length);
+            out = value_array(copy);
+            memo_put(memo, a, out);
+            if (!a->boxed) {
+                if (a->length) memcpy(copy->nums, a->nums, sizeof(double) * a->length);
+                copy->length = a->length;
+            } else {
+                for (size_t i = 0; i < a->length; i++) array_push(copy, copy_value(memo, &a->items[i]));
+            }
+            return out;
+        }
+        case VAL_MAP: {
+            const Map* m = v->data.as_map;
+            Value out;
+            if (memo_get(memo, m, &out)) return out;
+            Map* copy = map_new();
+            out = value_map(copy);
+            memo_put(memo, m, out);
+            size_t cursor = 0;
+            Value key, item;
+            while (map_next(m, &cursor, &key, &item)) {
+                Value k = copy_value(memo, &key);
+                map_set(copy, &k, copy_value(memo, &item));
+                value_free(&k);
+            }
+            return out;
+        }
+        default:
+            // Scalars, and objects, whose counts are atomic
+            return value_clone(v);
+    }
+}
+
+Value value_transfer(const Value* v) {
+    CopyMemo memo = {0};
+    Value out = copy_value(&memo, v);
+    mem_free(memo.keys);
+    mem_free(memo.copies);
+    return out;
+}
+
+Env* env_transfer(Env* env) {
+    // Collected innermost first, the order lookups see them in, and set
+    // in reverse so the copy finds the same entry first
+    size_t count = 0, capacity = 16;
+    VarEntry** entries = (VarEntry**)mem_alloc(sizeof(VarEntry*) * capacity);
+    for (Env* e = env; e; e = e->parent) {
+        for (VarEntry* v = e->head; v; v = v->next) {
+            if (count == capacity) { capacity *= 2; entries = (VarEntry**)mem_realloc(entries, sizeof(VarEntry*) * capacity); }
+            entries[count++] = v;
+        }
+    }
+    CopyMemo memo = {0};
+    Env* copy = env_create(NULL);
+    while (count > 0) {
+        VarEntry* v = entries[--count];
+        env_set(copy, v->name, copy_value(&memo, &v->value));
+    }
+    mem_free(entries);
+    mem_free(memo.keys);
+    mem_free(memo.copies);
+    return copy;
+}
+
+// ---- channels ----
+
+typedef struct {
+    atomic_size_t sequence;
+    Value value;
+} Cell;
+
+typedef struct {
+    Object base;
+    Cell* cells;
+    size_t mask;
+    atomic_bool closed;
+    // Producers and consumers each hammer their own cache line
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+} Channel;
+
+static void channel_destroy(Object* o) {
+    Channel* ch = (Channel*)o;
+    Value v;
+    size_t pos = atomic_load(&ch->dequeue_pos), end = atomic_load(&ch->enqueue_pos);
+    for (; pos != end; pos++) {
+        v = ch->cells[pos & ch->mask].value;
+        value_free(&v);
+    }
+    mem_free(ch->cells);
+    free(ch); // posix_memalign'd in builtin_kanal
+}
+
+static const ObjectType channel_type = { "kanal", channel_destroy };
+
+static Channel* as_channel(int argc, Value* argv) {
+    if (argc < 1 || argv[0].type != VAL_OBJECT || argv[0].data.as_object->type != &channel_type) return NULL;
+    return (Channel*)argv[0].data.as_object;
+}
+
+static bool channel_try_send(Channel* ch, Value v) {
+    size_t pos = atomic_load_explicit(&ch->enqueue_pos, memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &ch->cells[pos & ch->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ch->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false; // full
+        } else {
+            pos = atomic_load_explicit(&ch->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->value = v;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+static bool channel_try_receive(Channel* ch, Value* out) {
+    size_t pos = atomic_load_explicit(&ch->dequeue_pos, memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &ch->cells[pos & ch->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ch->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false; // empty
+        } else {
+            pos = atomic_load_explicit(&ch->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    *out = cell->value;
+    atomic_store_explicit(&cell->sequence, pos + ch->mask + 1, memory_order_release);
+    return true;
+}
+
+// Spin briefly, then yield, then sleep for up to a millisecond
+static void backoff(unsigned* round) {
+    unsigned r = (*round)++;
+    if (r < 32) return;
+    if (r < 64) { sched_yield(); return; }
+    unsigned shift = r - 64 < 10 ? r - 64 : 10;
+    struct timespec ts = { 0, 1000L << shift };
+    nanosleep(&ts, NULL);
+}
+
+Value builtin_kanal(int argc, Value* argv) {
+    size_t capacity = 64;
+    if (argc > 0 && argv[0].type == VAL_NUMBER && argv[0].data.as_number >= 1)
+        capacity = argv[0].data.as_number < (double)(1u << 24) ? (size_t)argv[0].data.as_number : (size_t)1 << 24;
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    void* mem = NULL;
+    if (posix_memalign(&mem, 64, sizeof(Channel)) != 0) return value_null();
+    Channel* ch = (Channel*)mem;
+    object_init(&ch->base, &channel_type);
+    ch->cells = (Cell*)mem_alloc(sizeof(Cell) * size);
+    for (size_t i = 0; i < size; i++) atomic_init(&ch->cells[i].sequence, i);
+    ch->mask = size - 1;
+    atomic_init(&ch->closed, false);
+    atomic_init(&ch->enqueue_pos, 0);
+    atomic_init(&ch->dequeue_pos, 0);
+    return value_object(&ch->base);
+}
+
+Value builtin_otpravit(int argc, Value* argv) {
+    Channel* ch = as_channel(argc, argv);
+    if (!ch) return value_bool(false);
+    Value v = argc > 1 ? value_transfer(&argv[1]) : value_null();
+    for (unsigned round = 0; !atomic_load_explicit(&ch->closed, memory_order_acquire); backoff(&round))
+        if (channel_try_send(ch, v)) return value_bool(true);
+    value_free(&v);
+    return value_bool(false);
+}
+
+Value builtin_poluchit(int argc, Value* argv) {
+    Channel* ch = as_channel(argc, argv);
+    if (!ch) return value_null();
+    Value v;
+    for (unsigned round = 0;; backoff(&round)) {
+        if (channel_try_receive(ch, &v)) return v;
+        // Closed: one more look for a value sent just before the close
+        if (atomic_load_explicit(&ch->closed, memory_order_acquire))
+            return channel_try_receive(ch, &v) ? v : value_null();
+    }
+}
+
+Value builtin_zakryt(int argc, Value* argv) {
+    Channel* ch = as_channel(argc, argv);
+    if (ch) atomic_store_explicit(&ch->closed, true, memory_order_release);
+    return value_null();
+}
+
+// ---- threads ----
+
+struct Thread {
+    Object base;
+    pthread_t id;
+    pthread_mutex_t lock;
+    bool joined;
+    Thread* next; // in the list of the interpreter that started it
+    // Handed to the thread, which frees them
+    StmtList* program;
+    const char* dir; // for the program's podklyuchit
+    char* name;
+    int argc;
+    Value* argv;
+    int fd;
+    OutputMode mode;
+};
+
+static void thread_destroy(Object* o) {
+    Thread* t = (Thread*)o;
+    pthread_mutex_destroy(&t->lock);
+    mem_free(t->name);
+    mem_free(t);
+}
+
+static const ObjectType thread_type = { "potok", thread_destroy };
+
+static void* thread_main(void* arg) {
+    Thread* t = (Thread*)arg;
+    Output out;
+    Input input;
+    Interpreter in;
+    output_init(&out, t->fd, t->mode, OUTPUT_DEFAULT_BLOCK);
+    input_init(&input, -1, 512);
+    input.eof = true;
+    interpreter_init_io(&in, &out, &input);
+    in.dir = t->dir;
+    interpret_define(&in, t->program);
+    if (!interpret_call(&in, t->name, t->argc, t->argv))
+        fprintf(stderr, "potok: no prikol named %s\n", t->name);
+    mem_free(t->argv);
+    t->argv = NULL;
+    interpreter_free(&in);
+    output_free(&out);
+    input_free(&input);
+    stats_merge();
+    object_release(&t->base);
+    return NULL;
+}
+
+static void thread_join(Thread* t) {
+    // Joining itself would never return
+    if (pthread_equal(pthread_self(), t->id)) return;
+    pthread_mutex_lock(&t->lock);
+    if (!t->joined) {
+        pthread_join(t->id, NULL);
+        t->joined = true;
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+Value builtin_potok(Interpreter* in, int argc, Value* argv) {
+    if (argc < 1 || argv[0].type != VAL_STRING || !in->program) return value_null();
+    const String* name = argv[0].data.as_string;
+    Thread* t = (Thread*)mem_alloc(sizeof(Thread));
+    object_init(&t->base, &thread_type);
+    pthread_mutex_init(&t->lock, NULL);
+    t->joined = false;
+    t->program = in->program;
+    t->dir = in->dir;
+    t->name = (char*)mem_alloc(name->length + 1);
+    memcpy(t->name, name->chars, name->length);
+    t->name[name->length] = '\0';
+    t->argc = argc - 1;
+    t->argv = (Value*)mem_alloc(sizeof(Value) * (size_t)(argc > 1 ? argc - 1 : 1));
+    for (int i = 1; i < argc; i++) t->argv[i - 1] = value_transfer(&argv[i]);
+    // Printed where the starting interpreter prints, as a library may have chosen
+    t->fd = in->out->fd;
+    t->mode = in->out->mode == OUTPUT_UNBUFFERED ? OUTPUT_UNBUFFERED : OUTPUT_LINE;
+    // What was printed so far comes before anything the thread prints
+    output_flush(in->out);
+    object_retain(&t->base); // for the thread itself
+    if (pthread_create(&t->id, NULL, thread_main, t) != 0) {
+        fprintf(stderr, "potok: cannot start a thread\n");
+        for (int i = 0; i < t->argc; i++) value_free(&t->argv[i]);
+        mem_free(t->argv);
+        t->id = pthread_self();
+        t->joined = true;
+        object_release(&t->base);
+        object_release(&t->base);
+        return value_null();
+    }
+    t->next = in->threads;
+    in->threads = t;
+    return value_object(object_retain(&t->base));
+}
+
+Value builtin_zhdat(int argc, Value* argv) {
+    if (argc > 0 && argv[0].type == VAL_OBJECT && argv[0].data.as_object->type == &thread_type)
+        thread_join((Thread*)argv[0].data.as_object);
+    return value_null();
+}
+
+void threads_join(Thread** list) {
+    Thread* t = *list;
+    *list = NULL;
+    while (t) {
+        Thread* next = t->next;
+        thread_join(t);
+        object_release(&t->base);
+        t = next;
+    }
+}
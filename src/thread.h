@@ -0,0 +1,39 @@
+#ifndef HYPESCRIPT_THREAD_H
+#define HYPESCRIPT_THREAD_H
+
+#include "interp.h"
+
+// Script-level threads and channels.
+//
+// potok("f", args...) runs the prikol f on a new OS thread in an
+// interpreter of its own: the thread shares the program's AST, which is
+// read-only, and nothing else. Arguments, and everything sent through a
+// channel, are deep-copied so that no string, array or map is ever
+// reachable from two threads (literal strings, which are immortal, and
+// channels themselves are shared). pechat from a thread is line-buffered
+// so that lines do not mix; vhod in a thread reads nothing.
+//
+// kanal(n) is a bounded multi-producer multi-consumer queue (Vyukov's
+// array-based algorithm: one CAS per operation, no locks). otpravit and
+// poluchit wait with backoff while it is full or empty; after zakryt,
+// otpravit fails and poluchit drains what is left, then returns NICHTO.
+
+typedef struct Thread Thread;
+
+Value builtin_potok(Interpreter* in, int argc, Value* argv);
+Value builtin_zhdat(int argc, Value* argv);
+Value builtin_kanal(int argc, Value* argv);
+Value builtin_otpravit(int argc, Value* argv);
+Value builtin_poluchit(int argc, Value* argv);
+Value builtin_zakryt(int argc, Value* argv);
+
+// Waits for every thread in the list and empties it
+void threads_join(Thread** list);
+
+// Copy of v that shares nothing mutable with it (cycles are preserved)
+Value value_transfer(const Value* v);
+// Copy of every variable visible in env, as one scope without a parent;
+// values shared between variables stay shared in the copy
+Env* env_transfer(Env* env);
+
+#endif
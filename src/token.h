@@ -35,7 +35,10 @@ typedef enum {
     TOK_RPAREN,     // )
     TOK_LBRACE,     // {
     TOK_RBRACE,     // }
+    TOK_LBRACKET,   // [
+    TOK_RBRACKET,   // ]
     TOK_COMMA,      // ,
+    TOK_COLON,      // :
     TOK_DOT,        // .
     TOK_SEMICOLON,  // ;
     TOK_PLUS,       // +
@@ -61,6 +64,7 @@ typedef struct {
     double number;   // For number literals
     int line;
     int column;
+    const char* start; // where the token begins in the source
 } Token;
 
 static inline bool token_is_eof(TokenType t) { return t == TOK_EOF; }
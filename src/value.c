@@ -1,7 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "value.h"
+#include "array.h"
+#include "map.h"
+#include "object.h"
+#include "stats.h"
+#define MEM_KIND MEM_STRING
+#include "mem.h"
+
+String* string_alloc(size_t length) {
+    String* s = (String*)mem_alloc(sizeof(String) + length + 1);
+    STAT_ADD(strings, 1);
+    STAT_ADD(string_bytes, sizeof(String) + length + 1);
+    s->refcount = 1;
+    s->hash = 0;
+    s->length = length;
+    s->chars = (char*)(s + 1);
+    s->chars[length] = '\0';
+    s->owner = NULL;
+    return s;
+}
+
+String* string_new(const char* chars, size_t length) {
+    String* s = string_alloc(length);
+    memcpy(s->chars, chars, length);
+    return s;
+}
+
+// A negative count marks an immortal string
+String* string_retain(String* s) {
+    if (s && s->refcount > 0) s->refcount++;
+    return s;
+}
+
+// External headers are allocated one byte longer than the struct, so their
+// chars can never point right behind the header as owned chars do
+static String* external_alloc(void) {
+    return (String*)mem_alloc(sizeof(String) + 1);
+}
+
+bool string_is_external(const String* s) {
+    return s->chars != (const char*)(s + 1);
+}
+
+void string_release(String* s) {
+    if (!s || s->refcount < 0 || --s->refcount > 0) return;
+    if (s->owner) string_release(s->owner);
+    else if (string_is_external(s)) munmap(s->chars, s->length);
+    mem_free(s);
+}
+
+String* string_slice(String* s, size_t from, size_t length) {
+    if (!string_is_external(s)) return string_new(s->chars + from, length);
+    String* root = s->owner ? s->owner : s;
+    String* view = external_alloc();
+    view->refcount = 1;
+    view->hash = 0;
+    view->length = length;
+    view->chars = s->chars + from;
+    view->owner = string_retain(root);
+    return view;
+}
+
+String* string_map_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(fd); return NULL; }
+    // An empty file cannot be mapped; it is just the empty string
+    if (st.st_size == 0) { close(fd); return string_alloc(0); }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    String* s = external_alloc();
+    s->refcount = 1;
+    s->hash = 0;
+    s->length = (size_t)st.st_size;
+    s->chars = (char*)data;
+    s->owner = NULL;
+    return s;
+}
+
+// 64-bit multiply/xor mix over 8-byte words, folded to 32 bits
+uint32_t string_hash(String* s) {
+    if (s->hash) return s->hash;
+    const unsigned char* p = (const unsigned char*)s->chars;
+    size_t n = s->length;
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ (uint64_t)n;
+    while (n >= 8) {
+        uint64_t w; memcpy(&w, p, 8);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+        p += 8; n -= 8;
+    }
+    uint64_t tail = 0;
+    for (size_t i = 0; i < n; i++) tail |= (uint64_t)p[i] << (8 * i);
+    h = (h ^ tail) * 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    uint32_t out = (uint32_t)h;
+    s->hash = out ? out : 1;
+    return s->hash;
+}
+
+void string_make_immortal(String* s) {
+    string_hash(s);
+    s->refcount = -1;
+}
+
+void string_free_immortal(String* s) {
+    s->refcount = 1;
+    string_release(s);
+}
 
 Value value_null() {
     Value v; v.type = VAL_NULL; return v;
@@ -16,22 +134,37 @@ Value value_number(double n) {
 }
 
 Value value_string(const char* s) {
-    Value v; v.type = VAL_STRING; 
-    if (s) {
-        size_t len = strlen(s);
-        v.data.as_string = (char*)malloc(len + 1);
-        memcpy(v.data.as_string, s, len + 1);
-    } else {
-        v.data.as_string = NULL;
-    }
-    return v;
+    return value_string_len(s ? s : "", s ? strlen(s) : 0);
+}
+
+Value value_string_len(const char* s, size_t length) {
+    Value v; v.type = VAL_STRING; v.data.as_string = string_new(s, length); return v;
+}
+
+Value value_from_string(String* s) {
+    Value v; v.type = VAL_STRING; v.data.as_string = s; return v;
+}
+
+Value value_array(Array* a) {
+    Value v; v.type = VAL_ARRAY; v.data.as_array = a; return v;
+}
+
+Value value_map(Map* m) {
+    Value v; v.type = VAL_MAP; v.data.as_map = m; return v;
+}
+
+Value value_object(Object* o) {
+    Value v; v.type = VAL_OBJECT; v.data.as_object = o; return v;
 }
 
 void value_free(Value* v) {
     if (!v) return;
-    if (v->type == VAL_STRING && v->data.as_string) {
-        free(v->data.as_string);
-        v->data.as_string = NULL;
+    switch (v->type) {
+        case VAL_STRING: string_release(v->data.as_string); break;
+        case VAL_ARRAY: array_release(v->data.as_array); break;
+        case VAL_MAP: map_release(v->data.as_map); break;
+        case VAL_OBJECT: object_release(v->data.as_object); break;
+        default: break;
     }
     v->type = VAL_NULL;
 }
@@ -42,7 +175,10 @@ bool value_is_truthy(const Value* v) {
         case VAL_NULL: return false;
         case VAL_BOOL: return v->data.as_bool;
         case VAL_NUMBER: return v->data.as_number != 0.0;
-        case VAL_STRING: return v->data.as_string && v->data.as_string[0] != '\0';
+        case VAL_STRING: return v->data.as_string->length > 0;
+        case VAL_ARRAY: return v->data.as_array->length > 0;
+        case VAL_MAP: return v->data.as_map->count > 0;
+        case VAL_OBJECT: return true;
     }
     return false;
 }
@@ -53,9 +189,53 @@ Value value_clone(const Value* v) {
         case VAL_NULL: return value_null();
         case VAL_BOOL: return value_bool(v->data.as_bool);
         case VAL_NUMBER: return value_number(v->data.as_number);
-        case VAL_STRING: return value_string(v->data.as_string ? v->data.as_string : "");
+        case VAL_STRING: return value_from_string(string_retain(v->data.as_string));
+        case VAL_ARRAY: return value_array(array_retain(v->data.as_array));
+        case VAL_MAP: return value_map(map_retain(v->data.as_map));
+        case VAL_OBJECT: return value_object(object_retain(v->data.as_object));
     }
     return value_null();
 }
 
+bool enclosing_has(const Enclosing* e, const void* a, const void* b) {
+    for (; e; e = e->outer) if (e->a == a && e->b == b) return true;
+    return false;
+}
+
+bool value_equals(const Value* a, const Value* b) {
+    return value_equals_within(a, b, NULL);
+}
 
+bool value_equals_within(const Value* a, const Value* b, const Enclosing* outer) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case VAL_NULL: return true;
+        case VAL_BOOL: return a->data.as_bool == b->data.as_bool;
+        case VAL_NUMBER: return a->data.as_number == b->data.as_number;
+        case VAL_STRING: {
+            String* x = a->data.as_string;
+            String* y = b->data.as_string;
+            if (x == y) return true;
+            if (x->length != y->length) return false;
+            if (x->hash && y->hash && x->hash != y->hash) return false;
+            return memcmp(x->chars, y->chars, x->length) == 0;
+        }
+        case VAL_ARRAY: {
+            const Array* x = a->data.as_array;
+            const Array* y = b->data.as_array;
+            if (x == y || enclosing_has(outer, x, y)) return true;
+            if (x->length != y->length) return false;
+            Enclosing here = { x, y, outer };
+            for (size_t i = 0; i < x->length; i++) {
+                Value xi = array_peek(x, i), yi = array_peek(y, i);
+                if (!value_equals_within(&xi, &yi, &here)) return false;
+            }
+            return true;
+        }
+        case VAL_MAP:
+            return map_equals(a->data.as_map, b->data.as_map, outer);
+        case VAL_OBJECT:
+            return a->data.as_object == b->data.as_object;
+    }
+    return false;
+}
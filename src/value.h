@@ -2,32 +2,95 @@
 #define HYPESCRIPT_VALUE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     VAL_NULL = 0,
     VAL_BOOL,
     VAL_NUMBER,
-    VAL_STRING
+    VAL_STRING,
+    VAL_ARRAY,
+    VAL_MAP,
+    VAL_OBJECT
 } ValueType;
 
+// Immutable, reference-counted string. The hash is computed on first use
+// and cached, so a key that is looked up repeatedly is hashed only once.
+// Most strings own their characters, stored right after the header and
+// NUL-terminated. A file mapped with string_map_file() and the slices taken
+// from it are external instead: chars points into the read-only mapping,
+// is not NUL-terminated, and a slice (a view) keeps the mapping alive
+// through `owner` rather than copying.
+typedef struct String {
+    int refcount;
+    uint32_t hash;         // 0 until string_hash computes it
+    size_t length;
+    char* chars;
+    struct String* owner;  // views only: the mapped file chars points into
+} String;
+
+typedef struct Array Array;
+typedef struct Map Map;
+typedef struct Object Object;
+
 typedef struct {
     ValueType type;
     union {
         bool as_bool;
         double as_number;
-        char* as_string;
+        String* as_string;  // never NULL for VAL_STRING
+        Array* as_array;    // reference-counted, see array.h
+        Map* as_map;        // reference-counted, see map.h
+        Object* as_object;  // atomically reference-counted, see object.h
     } data;
 } Value;
 
+String* string_alloc(size_t length); // chars left for the caller to fill
+String* string_new(const char* s, size_t length);
+String* string_retain(String* s);
+void string_release(String* s);
+// Makes s read-only shared data: its hash is computed now and retain and
+// release stop touching its count, so any number of threads can use it at
+// once. Used for string literals in the AST; freed with string_free_immortal.
+void string_make_immortal(String* s);
+void string_free_immortal(String* s);
+uint32_t string_hash(String* s);
+bool string_is_external(const String* s); // mapped file or view: no NUL
+// Characters [from, from + length) of s: a view when s is external, a copy
+// otherwise. The range must lie within s.
+String* string_slice(String* s, size_t from, size_t length);
+// Maps a file read-only; NULL if it cannot be opened or mapped
+String* string_map_file(const char* path);
+
 Value value_null();
 Value value_bool(bool b);
 Value value_number(double n);
 Value value_string(const char* s);
+Value value_string_len(const char* s, size_t length);
+Value value_from_string(String* s); // takes over the caller's reference
+Value value_array(Array* a);        // takes over the caller's reference
+Value value_map(Map* m);            // takes over the caller's reference
+Value value_object(Object* o);      // takes over the caller's reference
 
+// Ownership: a Value holding a string, array or map owns one reference to
+// it. value_clone retains, value_free releases.
 void value_free(Value* v);
 bool value_is_truthy(const Value* v);
 Value value_clone(const Value* v);
+bool value_equals(const Value* a, const Value* b);
 
-#endif
+// Arrays and maps being compared (or printed) further up. A pair met again
+// is taken as equal, any difference showing elsewhere in the walk, so
+// ones that hold themselves compare without recursing forever.
+typedef struct Enclosing {
+    const void* a;
+    const void* b;
+    const struct Enclosing* outer;
+} Enclosing;
+
+bool enclosing_has(const Enclosing* e, const void* a, const void* b);
+bool value_equals_within(const Value* a, const Value* b, const Enclosing* outer);
 
+#endif
 
@@ -0,0 +1,34 @@
+# --cache: a miss writes the entry, a hit leaves it alone, and a damaged
+# entry is ignored and written again; every run prints the same
+dir=$(mktemp -d)
+run() {
+    $BIN --cache="$dir" "$1" >"$dir/out" 2>&1
+    echo "status $?"
+    cmp -s "$dir/out" "$dir/first" || cat "$dir/out"
+}
+entry() {
+    ls "$dir"/*.hsc 2>/dev/null | wc -l
+    stat -c %i "$dir"/*.hsc
+}
+
+: >"$dir/first"
+run "$1"
+cp "$dir/out" "$dir/first"
+before=$(entry)
+run "$1"
+[ "$(entry)" = "$before" ] && echo "hit: entry kept"
+
+# Damage the payload: same size, so only the checksum can tell
+f=$(ls "$dir"/*.hsc)
+size=$(wc -c <"$f")
+printf 'XXXXXXXX' | dd of="$f" bs=1 seek=$((size - 12)) conv=notrunc 2>/dev/null
+run "$1"
+[ "$(entry)" != "$before" ] && echo "damaged: entry written again"
+before=$(entry)
+run "$1"
+[ "$(entry)" = "$before" ] && echo "hit: entry kept"
+
+# A truncated entry too
+: >"$f.tmp"; head -c 20 "$f" >"$f.tmp"; mv "$f.tmp" "$f"
+run "$1"
+rm -rf "$dir"
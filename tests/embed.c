@@ -0,0 +1,33 @@
+// Host for tests/embed.sh: runs a script twice on one interpreter through
+// libhypescript, exchanging globals, with pechat output on a file
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hypescript.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) return 2;
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) return 2;
+    static char source[1 << 16];
+    size_t length = fread(source, 1, sizeof(source) - 1, f);
+    fclose(f);
+
+    HsProgram* program = hs_compile(source, length);
+    if (!program) return 1;
+    int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    HsInterpreter* in = hs_interpreter_new(-1, fd);
+    for (int run = 1; run <= 2; run++) {
+        hs_set(in, "vhodnoe", hs_number(10 * run));
+        hs_run(in, program);
+        HsValue* result = hs_get(in, "rezultat");
+        printf("host: run %d, rezultat %g\n", run, result ? hs_as_number(result) : -1);
+        hs_value_free(result);
+    }
+    hs_interpreter_free(in);
+    hs_program_free(program);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,8 @@
+# The embedding API: tests/embed.c runs tests/embed.hype through
+# libhypescript.a, and pechat writes to the descriptor the host gave
+dir=$(mktemp -d)
+${CC:-cc} -std=c11 -Isrc -o "$dir/embed" tests/embed.c libhypescript.a -pthread || exit 1
+"$dir/embed" "$1" "$dir/out"; echo "status $?"
+echo "output_fd:"
+cat "$dir/out"
+rm -rf "$dir"
@@ -0,0 +1,20 @@
+# --max-steps, --timeout-ms and --max-depth stop a runaway program where it
+# is, konec included, with status 1; a program within its limits runs to
+# the end. Under --serve the limits apply to every request.
+run() {
+    echo "$1" | $BIN $2 "$3" 2>&1; echo "status $?"
+}
+run nichego --max-steps=1000 "$1"
+run cikl --max-steps=1000 "$1"
+run cikl --timeout-ms=50 "$1"
+run vglub --max-depth=100 "$1"
+run potok --max-depth=100 "$1"
+run nichego --max-steps=-1 "$1"
+dir=$(mktemp -d)
+$BIN --max-steps=1000 --serve "$dir/sock" & server=$!
+while [ ! -S "$dir/sock" ]; do sleep 0.1; done
+run cikl --connect="$dir/sock" "$1"
+run cikl --connect="$dir/sock" "$1"
+run nichego --connect="$dir/sock" "$1"
+kill $server
+rm -rf "$dir"
@@ -0,0 +1,22 @@
+# --lsp: initialize, the .hype file opened with its syntax error, an edit that fixes
+# it and one that breaks another line, then shutdown and exit. A bad
+# Content-Length ends the server with status 1.
+msg() {
+    printf 'Content-Length: %d\r\n\r\n%s' "$(printf '%s' "$1" | wc -c)" "$1"
+}
+uri=file:///tmp/lsp.hype
+text=$(awk '{ printf "%s\\n", $0 }' "$1")
+dir=$(mktemp -d)
+{
+    msg '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+    msg '{"jsonrpc":"2.0","method":"initialized","params":{}}'
+    msg '{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"'$uri'","languageId":"hypescript","version":1,"text":"'"$text"'"}}}'
+    msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'$uri'","version":2},"contentChanges":[{"range":{"start":{"line":2,"character":6},"end":{"line":2,"character":8}},"text":"+ 2;"}]}}'
+    msg '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"'$uri'","version":3},"contentChanges":[{"range":{"start":{"line":3,"character":25},"end":{"line":3,"character":26}},"text":""}]}}'
+    msg '{"jsonrpc":"2.0","id":2,"method":"shutdown"}'
+    msg '{"jsonrpc":"2.0","method":"exit"}'
+} | $BIN --lsp >"$dir/out"; echo "status $?"
+tr -d '\r' <"$dir/out" | sed 's/}Content-Length/}\nContent-Length/g'
+echo
+rm -rf "$dir"
+printf 'Content-Length: 99999999999\r\n\r\n{}' | $BIN --lsp; echo "status $?"
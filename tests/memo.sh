@@ -0,0 +1,11 @@
+# --memo must not change what the program prints; the memo counters in
+# --stats show which calls were answered from the cache
+dir=$(mktemp -d)
+$BIN "$1" >"$dir/plain" 2>&1; echo "status $?"
+$BIN --memo --stats="$dir/stats" "$1" >"$dir/memo" 2>&1; echo "status $?"
+cat "$dir/memo"
+cmp -s "$dir/plain" "$dir/memo" && echo "same output without --memo"
+grep '"memo"' "$dir/stats"
+$BIN --memo=1 --stats="$dir/stats" "$1" >"$dir/memo" 2>&1; echo "status $?"
+cmp -s "$dir/plain" "$dir/memo" && echo "same output with one entry"
+rm -rf "$dir"
@@ -0,0 +1,11 @@
+# pamyat(); --max-heap, which stops the program but keeps what it printed
+# so far; and the --trace-alloc report
+dir=$(mktemp -d)
+$BIN "$1"; echo "status $?"
+$BIN --max-heap=16m "$1" 2>"$dir/err"; echo "status $?"
+sed 's/(src[^)]*)/(LOCATION)/' "$dir/err"
+$BIN --max-heap=16q "$1"; echo "status $?"
+$BIN --trace-alloc "$1" >/dev/null 2>"$dir/err"; echo "status $?"
+grep -q '^heap: peak [0-9]* bytes, [0-9]* still in use$' "$dir/err" && echo "heap: peak N bytes, N still in use"
+sed -n '3,8s/ *[0-9].*//p' "$dir/err"
+rm -rf "$dir"
@@ -0,0 +1,9 @@
+# The same results with any number of workers
+dir=$(mktemp -d)
+for n in 1 2 3 8; do
+    HYPESCRIPT_THREADS=$n $BIN "$1" >"$dir/out" 2>&1
+    echo "threads $n: status $?"
+    [ $n = 1 ] && cp "$dir/out" "$dir/first" && cat "$dir/out"
+    cmp -s "$dir/out" "$dir/first" || cat "$dir/out"
+done
+rm -rf "$dir"
@@ -0,0 +1,6 @@
+# Runs tests/podklyuchit.hype; --stats shows that each module was parsed
+# once and then found in the cache
+dir=$(mktemp -d)
+$BIN --stats="$dir/stats" "$1"; echo "status $?"
+grep '"modules"' "$dir/stats"
+rm -rf "$dir"
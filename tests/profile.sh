@@ -0,0 +1,9 @@
+# --profile=FILE: the program runs as usual, the report goes to stderr and
+# FILE gets one "frame;frame count" line per sampled stack
+dir=$(mktemp -d)
+$BIN --profile="$dir/stacks" "$1" 2>"$dir/err"; echo "status $?"
+sed -n 1p "$dir/err" | sed "s|^profile: [0-9]* samples, stacks in $dir/|profile: N samples, stacks in |"
+grep -q '^ *[0-9]*  *[0-9.]*%  vnutr:5$' "$dir/err" && echo "hot line: vnutr:5"
+grep -Evq '^<main>:[0-9]+(;[a-z]+:[0-9]+)* [0-9]+$' "$dir/stacks" || echo "stacks: collapsed format"
+grep -q '^<main>:10;vnesh:8;vnutr:5 ' "$dir/stacks" && echo "stack: <main>:10;vnesh:8;vnutr:5"
+rm -rf "$dir"
@@ -0,0 +1,33 @@
+# Runs each tests/NAME.hype, with the flags in tests/NAME.args and stdin
+# from tests/NAME.in when there are such, and compares all it prints,
+# stderr included, with tests/NAME.out: with prikol bodies parsed on first
+# call, with --strict, and run by a --serve server. A test that needs more
+# than one run has a tests/NAME.sh instead, which gets $BIN and the .hype
+# path.
+BIN=${BIN:-./hypescript}
+export BIN
+sock=tests/.sock
+
+rm -f $sock
+$BIN --serve $sock & server=$!
+while [ ! -S $sock ]; do sleep 0.1; done
+
+status=0
+for t in tests/*.hype; do
+    name=${t%.hype}
+    if [ -f "$name.sh" ]; then
+        sh "$name.sh" "$t" 2>&1 | diff -u "$name.out" - || { echo "FAIL $name.sh"; status=1; }
+        continue
+    fi
+    args=
+    [ -f "$name.args" ] && args=$(cat "$name.args")
+    input=/dev/null
+    [ -f "$name.in" ] && input=$name.in
+    for mode in "" --strict --connect=$sock; do
+        $BIN $mode $args "$t" <"$input" 2>&1 | diff -u "$name.out" - || { echo "FAIL $t $mode $args"; status=1; }
+    done
+done
+kill $server
+rm -f $sock
+[ $status = 0 ] && echo "tests passed"
+exit $status
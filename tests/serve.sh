@@ -0,0 +1,17 @@
+# --serve keeps the script parsed between requests and reparses it when the
+# file changes; each --connect gets the status its program ended with
+dir=$(mktemp -d)
+$BIN --serve "$dir/sock" & server=$!
+while [ ! -S "$dir/sock" ]; do sleep 0.1; done
+cp "$1" "$dir/s.hype"
+printf 'a\nb\n' | $BIN --connect="$dir/sock" "$dir/s.hype"; echo "status $?"
+printf 'a\nb\n' | $BIN --connect="$dir/sock" "$dir/s.hype"; echo "status $?"
+printf 'a\nstop\n' | $BIN --connect="$dir/sock" "$dir/s.hype"; echo "status $?"
+sleep 0.01
+echo 'pechat("changed");' >>"$dir/s.hype"
+printf 'a\n' | $BIN --connect="$dir/sock" "$dir/s.hype"; echo "status $?"
+echo 'pechat(' >>"$dir/s.hype"
+$BIN --connect="$dir/sock" "$dir/s.hype" </dev/null; echo "status $?"
+$BIN --connect="$dir/sock" "$dir/net.hype" </dev/null; echo "status $?"
+kill $server
+rm -rf "$dir"
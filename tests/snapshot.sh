@@ -0,0 +1,12 @@
+# --snapshot writes the state after nachalo; --resume starts from it
+# without running nachalo again, and a bad image is ignored with a warning
+dir=$(mktemp -d)
+$BIN --snapshot="$dir/s.snap" "$1"; echo "status $?"
+$BIN --resume="$dir/s.snap" "$1"; echo "status $?"
+$BIN --resume="$dir/s.snap" "$1"; echo "status $?"
+head -c 40 "$dir/s.snap" >"$dir/bad.snap"
+for image in bad.snap net.snap; do
+    $BIN --resume="$dir/$image" "$1" >"$dir/out" 2>&1; echo "status $?"
+    sed "s|$dir/||" "$dir/out"
+done
+rm -rf "$dir"
@@ -0,0 +1,11 @@
+# --stats=FILE writes the counters as JSON at exit. The work counted does
+# not depend on how many threads the parallel loop used; only the variable
+# lookups that set each worker up do
+dir=$(mktemp -d)
+HYPESCRIPT_THREADS=1 $BIN --stats="$dir/one" "$1"; echo "status $?"
+cat "$dir/one"
+HYPESCRIPT_THREADS=4 $BIN --stats="$dir/four" "$1" >/dev/null
+grep -v '"env_' "$dir/one" >"$dir/one.work"
+grep -v '"env_' "$dir/four" >"$dir/four.work"
+cmp -s "$dir/one.work" "$dir/four.work" && echo "same work with 4 threads"
+rm -rf "$dir"
@@ -0,0 +1,24 @@
+// Starts `hypescript --lsp` for .hype files: syntax errors are shown as
+// you type, re-parsed by the interpreter's own parser.
+const vscode = require('vscode');
+const { LanguageClient } = require('vscode-languageclient/node');
+
+let client;
+
+function activate(context) {
+  const command = vscode.workspace.getConfiguration('hypescript').get('path') || 'hypescript';
+  client = new LanguageClient(
+    'hypescript',
+    'HypeScript',
+    { command, args: ['--lsp'] },
+    { documentSelector: [{ scheme: 'file', language: 'hypescript' }] }
+  );
+  context.subscriptions.push(client);
+  client.start();
+}
+
+function deactivate() {
+  return client ? client.stop() : undefined;
+}
+
+module.exports = { activate, deactivate };